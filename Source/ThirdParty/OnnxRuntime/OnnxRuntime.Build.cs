@@ -0,0 +1,47 @@
+// Copyright Epic Games, Inc. All Rights Reserved.
+
+using UnrealBuildTool;
+using System.IO;
+
+// Prebuilt ONNX Runtime (CPU, 1.14 or newer) for nn.Backend ORT. Unpack the release package of the platform here:
+//   include/onnxruntime_c_api.h (and the other headers of the package)
+//   lib/Win64/onnxruntime.lib, lib/Win64/onnxruntime.dll
+//   lib/Linux/libonnxruntime.so
+// Without it the module still builds and WITH_ONNXRUNTIME is 0, the ORT backend then falls back to NNI.
+public class OnnxRuntime : ModuleRules
+{
+	public OnnxRuntime(ReadOnlyTargetRules Target) : base(Target)
+	{
+		Type = ModuleType.External;
+
+		string IncludeDir = Path.Combine(ModuleDirectory, "include");
+		string LibDir = Path.Combine(ModuleDirectory, "lib", Target.Platform.ToString());
+		bool bHasHeaders = File.Exists(Path.Combine(IncludeDir, "onnxruntime_c_api.h"));
+		bool bHasLibraries = false;
+
+		if (bHasHeaders && Target.Platform == UnrealTargetPlatform.Win64)
+		{
+			bHasLibraries = File.Exists(Path.Combine(LibDir, "onnxruntime.lib"));
+			if (bHasLibraries)
+			{
+				PublicAdditionalLibraries.Add(Path.Combine(LibDir, "onnxruntime.lib"));
+				RuntimeDependencies.Add("$(BinaryOutputDir)/onnxruntime.dll", Path.Combine(LibDir, "onnxruntime.dll"));
+			}
+		}
+		else if (bHasHeaders && Target.Platform == UnrealTargetPlatform.Linux)
+		{
+			bHasLibraries = File.Exists(Path.Combine(LibDir, "libonnxruntime.so"));
+			if (bHasLibraries)
+			{
+				PublicAdditionalLibraries.Add(Path.Combine(LibDir, "libonnxruntime.so"));
+				RuntimeDependencies.Add("$(BinaryOutputDir)/libonnxruntime.so", Path.Combine(LibDir, "libonnxruntime.so"));
+			}
+		}
+
+		if (bHasLibraries)
+		{
+			PublicSystemIncludePaths.Add(IncludeDir);
+		}
+		PublicDefinitions.Add("WITH_ONNXRUNTIME=" + (bHasLibraries ? "1" : "0"));
+	}
+}
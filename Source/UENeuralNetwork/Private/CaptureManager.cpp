@@ -16,17 +16,68 @@
 #include <ThirdParty/OpenCV/include/opencv2/imgproc.hpp>
 #include <ThirdParty/OpenCV/include/opencv2/core.hpp>
 
+#include "Async/Async.h"
+#include "LatentActions.h"
+#include "Engine/AssetManager.h"
+#include "CanvasItem.h"
 #include "Kismet/KismetRenderingLibrary.h"
+#include "Kismet/GameplayStatics.h"
+#include "SceneViewExtension.h"
 #include "Misc/AssertionMacros.h"
+#include "Misc/ScopeExit.h"
+#include "UObject/StrongObjectPtr.h"
 #include "Materials/MaterialInstanceDynamic.h"
 #include "UENeuralNetwork/UENeuralNetworkGameMode.h"
+#include "DetectionKernels.h"
+#include "PipelineSettings.h"
+#include "PipelineAutoTuner.h"
+#include "InferenceThreadPool.h"
+#include "FrameTrace.h"
+#include "DetectionStream.h"
+#include "DetectionLog.h"
+#include "DetectionLabels.h"
+#include "DetectionClassFilter.h"
+#include "PipelineMemory.h"
 
 // statics
 UMaterialInstanceDynamic* UCaptureManager::DynamicMaterialInstance = nullptr;
 UCanvasRenderTarget2D* UCaptureManager::BoundingBoxRenderTarget2D = nullptr;
 UMyNeuralNetwork::FBoxCoordinates UCaptureManager::BoundingBoxCoordinates = UMyNeuralNetwork::FBoxCoordinates();
 TMap<int, TArray<UMyNeuralNetwork::FBoxCoordinates>> UCaptureManager::BoundingBoxCoordinatesMap = TMap<int, TArray<UMyNeuralNetwork::FBoxCoordinates>>();
-TMap<int, FString> UCaptureManager::CocoDatasetClassIntToStringMap = TMap<int, FString>();
+TArray<FDetectionMask> UCaptureManager::DetectionMasks;
+std::atomic<int64> UCaptureManager::PublishedFrameId{ -1 };
+FCaptureView UCaptureManager::PublishedCaptureView;
+int64 UCaptureManager::NextFrameId = 0;
+
+static TAutoConsoleVariable<int32> CVarNNReprojectEnable(
+    TEXT("nn.Reproject.Enable"), 1,
+    TEXT("Move the overlay boxes with the camera between inferences, from the view they were captured with to the current one."),
+    ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarNNReprojectDefaultDepth(
+    TEXT("nn.Reproject.DefaultDepth"), 1000.f,
+    TEXT("Depth in cm assumed for boxes without a depth sample (no depth capture) when they are reprojected."),
+    ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarNNCaptureSource(
+    TEXT("nn.Capture.Source"), -1,
+    TEXT("-1: UCaptureManager::CaptureSource, 0: scene capture component, 1: copy of the main view (no second scene render)."),
+    ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarNNDebugSaveCaptures(
+    TEXT("nn.Debug.SaveCaptures"), 0,
+    TEXT("Write the capture render target to Saved/DetectionCaptures/capture.png on every readback (slow, debugging only)."),
+    ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarNNRelevanceEnable(
+    TEXT("nn.Relevance.Enable"), 1,
+    TEXT("Throttle or suspend capture managers nobody needs right now (UCaptureManager::bEnableRelevance). 0 runs every one at full rate."),
+    ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarNNRelevanceThrottleFactor(
+    TEXT("nn.Relevance.ThrottleFactor"), 4,
+    TEXT("A throttled capture manager captures this many times less often than nn.FrameMod."),
+    ECVF_Default);
 
 // Sets default values for this component's properties
 UCaptureManager::UCaptureManager()
@@ -47,20 +98,586 @@ void UCaptureManager::BeginPlay()
         return;
     }
     SetupColorCaptureComponent(ColorCaptureComponents);
+    if (AtlasSensors.Num() > 0) {
+        SetupAtlas();
+    }
+
+    // tuned values for this machine go into the console variables before anything reads them
+    FPipelineTuningConfig TunedConfig;
+    if (FPipelineAutoTuner::LoadMachineConfig(TunedConfig)) {
+        FPipelineAutoTuner::ApplyToConsoleVariables(TunedConfig);
+    } else if (bAutoTuneOnStartup) {
+        StartAutoTune();
+    }
+
+    // load off the game thread, the networks are configured and warmed up once everything arrived
+    TArray<FSoftObjectPath> ModelPaths;
+    for (const FModelVariant& Variant : ModelVariants) {
+        ModelPaths.Add(Variant.Model.ToSoftObjectPath());
+    }
+    if (ModelPaths.Num() == 0 && !ModelAsset.IsNull()) {
+        ModelPaths.Add(ModelAsset.ToSoftObjectPath());
+    }
+    if (!LabelTable.IsNull()) {
+        ModelPaths.Add(LabelTable.ToSoftObjectPath());
+    }
+    if (!GateModel.IsNull()) {
+        ModelPaths.Add(GateModel.ToSoftObjectPath());
+    }
+
+    if (ModelPaths.Num() > 0) {
+        UAssetManager::GetStreamableManager().RequestAsyncLoad(ModelPaths,
+            FStreamableDelegate::CreateUObject(this, &UCaptureManager::OnModelsLoaded));
+    } else if (myNeuralNetwork != nullptr) {
+        StartWarmUp();
+    }
+}
+
+void UCaptureManager::OnModelsLoaded()
+{
+    LLM_SCOPE_BYTAG(DetectionPipeline_Inference);
+    if (const UDetectionLabelTable* Labels = LabelTable.Get()) {
+        FDetectionLabels::Get().SetLabels(Labels->Labels);
+    }
+    if (UNeuralNetwork* LoadedGate = GateModel.Get()) {
+        LoadedGate->SetSynchronousMode(ENeuralSynchronousMode::Synchronous);
+        LoadedGate->SetDeviceType(ENeuralDeviceType::CPU);
+        GateNetwork = LoadedGate;
+        Gate.SetNetwork(GateNetwork);
+    }
+
+    TArray<UNeuralNetwork*> Models;
+    if (ModelVariants.Num() == 0 && ModelAsset.IsNull()) {
+        // only labels / gate were loaded, the network came from SetNeuralNetwork
+        if (myNeuralNetwork != nullptr) {
+            StartWarmUp();
+        }
+        return;
+    }
+    if (ModelVariants.Num() > 0) {
+        for (const FModelVariant& Variant : ModelVariants) {
+            Models.Add(Variant.Model.Get());
+        }
+    } else {
+        Models.Add(ModelAsset.Get());
+    }
+
+    ModelVariantNetworks.Reset();
+    for (int32 i = 0; i < Models.Num(); i++) {
+        if (Models[i] == nullptr) {
+            UE_LOG(LogTemp, Error, TEXT("Failed to load model variant %d"), i);
+            return;
+        }
+        Models[i]->SetSynchronousMode(ENeuralSynchronousMode::Synchronous);
+        ModelVariantNetworks.Add(CreateNeuralNetwork(Models[i]));
+    }
+
+    ActivateModelVariant(FMath::Clamp(InitialVariantIndex, 0, ModelVariantNetworks.Num() - 1));
+    StartWarmUp();
 }
 
 namespace {
+    // the pool tasks keep the networks alive while they run even if the component is destroyed or the variants are replaced.
+    // created here and moved back into the game thread task, so every reference is also released on the game thread
+    TArray<TStrongObjectPtr<UMyNeuralNetwork>> MakeStrongNetworks(const TArray<UMyNeuralNetwork*>& Networks) {
+        TArray<TStrongObjectPtr<UMyNeuralNetwork>> Result;
+        Result.Reserve(Networks.Num());
+        for (UMyNeuralNetwork* NeuralNetwork : Networks) {
+            Result.Emplace(NeuralNetwork);
+        }
+        return Result;
+    }
+}
+
+/**
+ * @brief Creates the backends nn.Backend asks for on the thread pool and swaps them in, then warms every variant up
+ */
+void UCaptureManager::StartWarmUp()
+{
+    bPipelineReady = false;
+    const int32 Generation = ++WarmUpGeneration;
+    TWeakObjectPtr<UCaptureManager> WeakThis(this);
+    TArray<TStrongObjectPtr<UMyNeuralNetwork>> NeuralNetworks = MakeStrongNetworks(ModelVariantNetworks);
+
+    // the runtime nn.Backend asks for (ORT session creation, graph optimization) is built off the game thread and swapped
+    // in here, before anything runs on it
+    AsyncPool(*FInferenceThreadPool::Get().GetPool(), [WeakThis, NeuralNetworks = MoveTemp(NeuralNetworks), Generation]() mutable {
+        FInferenceThreadPool::Get().EnterPoolThread();
+        for (const TStrongObjectPtr<UMyNeuralNetwork>& NeuralNetwork : NeuralNetworks) {
+            NeuralNetwork->PrepareRequestedBackend();
+        }
+        AsyncTask(ENamedThreads::GameThread, [WeakThis, NeuralNetworks = MoveTemp(NeuralNetworks), Generation]() {
+            if (!WeakThis.IsValid() || WeakThis->WarmUpGeneration != Generation) {
+                return;
+            }
+            bool bChanged = false;
+            for (UMyNeuralNetwork* NeuralNetwork : WeakThis->ModelVariantNetworks) {
+                bChanged |= NeuralNetwork->ApplyPendingBackend();
+            }
+            // the capture follows the geometry of the new backend
+            if (bChanged && WeakThis->ModelVariantNetworks.IsValidIndex(WeakThis->ActiveVariantIndex)) {
+                WeakThis->ActivateModelVariant(WeakThis->ActiveVariantIndex);
+            }
+            WeakThis->RunWarmUp(Generation);
+            });
+        });
+}
+
+/**
+ * @brief Runs WarmUpInferenceCount dummy inferences for every model variant on the thread pool, then marks the pipeline ready
+ */
+void UCaptureManager::RunWarmUp(int32 Generation)
+{
+    TWeakObjectPtr<UCaptureManager> WeakThis(this);
+    TArray<TStrongObjectPtr<UMyNeuralNetwork>> NeuralNetworks = MakeStrongNetworks(ModelVariantNetworks);
+    const int32 Count = WarmUpInferenceCount;
+
+    AsyncPool(*FInferenceThreadPool::Get().GetPool(), [WeakThis, NeuralNetworks = MoveTemp(NeuralNetworks), Count, Generation]() mutable {
+        FInferenceThreadPool::Get().EnterPoolThread();
+        for (const TStrongObjectPtr<UMyNeuralNetwork>& NeuralNetwork : NeuralNetworks) {
+            NeuralNetwork->WarmUp(Count);
+        }
+        AsyncTask(ENamedThreads::GameThread, [WeakThis, NeuralNetworks = MoveTemp(NeuralNetworks), Generation]() {
+            if (WeakThis.IsValid() && WeakThis->WarmUpGeneration == Generation) {
+                WeakThis->bPipelineReady = true;
+                UE_LOG(LogTemp, Log, TEXT("Detection pipeline ready"));
+            }
+            });
+        });
+}
+
+UMyNeuralNetwork* UCaptureManager::CreateNeuralNetwork(UNeuralNetwork* Model)
+{
+    LLM_SCOPE_BYTAG(DetectionPipeline_Inference);
+    Model->AddToRoot();
+    UMyNeuralNetwork* NeuralNetwork = NewObject<UMyNeuralNetwork>(this);
+    // gpu is usually slower than cpu for this model, nn.UseGPU / the auto-tuner decide per machine
+    bUsingGPU = CVarNNUseGPU.GetValueOnGameThread() != 0;
+    Model->SetDeviceType(bUsingGPU ? ENeuralDeviceType::GPU : ENeuralDeviceType::CPU);
+    NeuralNetwork->Network = Model;
+    NeuralNetwork->ConfigureFromModel();
+    return NeuralNetwork;
+}
+
+void UCaptureManager::ActivateModelVariant(int32 Index)
+{
+    LLM_SCOPE_BYTAG(DetectionPipeline_Capture);
+    ActiveVariantIndex = Index;
+    myNeuralNetwork = ModelVariantNetworks[Index];
+    neuralNetwork = myNeuralNetwork->Network;
+    LatencyTracker.Reset();
+
+    // capture and overlay follow the model geometry, so preprocessing never has to resize
+    const FModelImageProperties NewModelImage = { myNeuralNetwork->ModelWidth, myNeuralNetwork->ModelHeight };
+    if (NewModelImage.width != ModelImageProperties.width || NewModelImage.height != ModelImageProperties.height) {
+        ModelImageProperties = NewModelImage;
+        if (RenderTarget2D != nullptr) {
+            RenderTarget2D->ResizeTarget(NewModelImage.width, NewModelImage.height);
+        }
+        if (BoundingBoxRenderTarget2D != nullptr) {
+            BoundingBoxRenderTarget2D->ResizeTarget(NewModelImage.width, NewModelImage.height);
+        }
+        if (DepthRenderTarget2D != nullptr) {
+            DepthRenderTarget2D->ResizeTarget(NewModelImage.width, NewModelImage.height);
+        }
+        // the resize recreated the resource the main view is copied into
+        if (MainViewExtension.IsValid()) {
+            MainViewExtension->SetTarget(RenderTarget2D);
+        }
+        if (AtlasRenderTarget2D != nullptr) {
+            SetupAtlas();
+        }
+    }
+    UE_LOG(LogTemp, Log, TEXT("Active model variant: %s (%dx%d)"), *GetActiveModelName().ToString(),
+        ModelImageProperties.width, ModelImageProperties.height);
+}
+
+void UCaptureManager::UpdateQualityOfService()
+{
+    if (!bEnableQualityOfService) {
+        return;
+    }
+    QualityController.BudgetSeconds = LatencyBudgetMs / 1000.0;
+    const int32 NextIndex = QualityController.Evaluate(LatencyTracker, ActiveVariantIndex, ModelVariantNetworks.Num());
+    if (NextIndex != ActiveVariantIndex) {
+        UE_LOG(LogTemp, Log, TEXT("QoS: p95 %.1f ms against budget %.1f ms, switching model variant %d -> %d"),
+            GetInferenceLatencyP95Ms(), LatencyBudgetMs, ActiveVariantIndex, NextIndex);
+        ActivateModelVariant(NextIndex);
+    }
+}
+
+void UCaptureManager::SyncDeviceType()
+{
+    // only called with no inference task running
+    const bool bWantGPU = CVarNNUseGPU.GetValueOnGameThread() != 0;
+    if (bWantGPU != bUsingGPU) {
+        SetDeviceType(bWantGPU);
+    }
+}
+
+void UCaptureManager::SetDeviceType(bool bGPU)
+{
+    for (UMyNeuralNetwork* NeuralNetwork : ModelVariantNetworks) {
+        NeuralNetwork->Network->SetDeviceType(bGPU ? ENeuralDeviceType::GPU : ENeuralDeviceType::CPU);
+    }
+    bUsingGPU = bGPU;
+    UE_LOG(LogTemp, Log, TEXT("Detection running on %s"), bUsingGPU ? TEXT("GPU") : TEXT("CPU"));
+}
+
+void UCaptureManager::UpdateCaptureSource()
+{
+    const int32 SourceOverride = CVarNNCaptureSource.GetValueOnGameThread();
+    const bool bWantMainView = SourceOverride >= 0 ? SourceOverride == 1 : CaptureSource == EDetectionCaptureSource::MainView;
+    if (bWantMainView && !MainViewExtension.IsValid()) {
+        MainViewExtension = FSceneViewExtensions::NewExtension<FDetectionViewExtension>(GetWorld());
+    }
+    if (MainViewExtension.IsValid()) {
+        MainViewExtension->SetTarget(RenderTarget2D);
+    }
+    if (bWantMainView == bCapturingMainView || !IsValid(ColorCaptureComponents)) {
+        return;
+    }
+
+    bCapturingMainView = bWantMainView;
+    MainViewExtension->SetEnabled(bWantMainView && Relevance != EDetectionRelevance::Suspended);
+    // the scene capture writes into the same target, it only renders while it is the source
+    ApplySceneCaptureState();
+    UE_LOG(LogTemp, Log, TEXT("Capture source: %s"), bWantMainView ? TEXT("main view") : TEXT("scene capture"));
+}
+
+void UCaptureManager::ApplySceneCaptureState()
+{
+    if (!IsValid(ColorCaptureComponents)) {
+        return;
+    }
+    const bool bActive = !bCapturingMainView && Relevance != EDetectionRelevance::Suspended;
+    if (bActive == bSceneCaptureActive) {
+        return;
+    }
+    if (!bActive) {
+        bSceneCaptureEveryFrame = ColorCaptureComponents->bCaptureEveryFrame;
+        bSceneCaptureOnMovement = ColorCaptureComponents->bCaptureOnMovement;
+    }
+    bSceneCaptureActive = bActive;
+    ColorCaptureComponents->bCaptureEveryFrame = bActive && bSceneCaptureEveryFrame;
+    ColorCaptureComponents->bCaptureOnMovement = bActive && bSceneCaptureOnMovement;
+    if (DepthCaptureComponent != nullptr) {
+        DepthCaptureComponent->bCaptureEveryFrame = ColorCaptureComponents->bCaptureEveryFrame;
+        DepthCaptureComponent->bCaptureOnMovement = ColorCaptureComponents->bCaptureOnMovement;
+    }
+}
+
+EDetectionRelevance UCaptureManager::EvaluateRelevance() const
+{
+    // a DetectAsync request is answered no matter what, and the tuner needs its frames
+    if (!bEnableRelevance || CVarNNRelevanceEnable.GetValueOnGameThread() == 0 || PendingDetections.Num() > 0
+        || AutoTuneState != EAutoTuneState::Idle) {
+        return EDetectionRelevance::Full;
+    }
+
+    // the overlay shows what the viewed pawn detects
+    const AActor* Owner = GetOwner();
+    const APawn* Pawn = Cast<APawn>(Owner);
+    const APlayerCameraManager* CameraManager = UGameplayStatics::GetPlayerCameraManager(this, 0);
+    if ((CameraManager != nullptr && CameraManager->GetViewTarget() == Owner)
+        || (Pawn != nullptr && Pawn->IsLocallyControlled() && Pawn->IsPlayerControlled())) {
+        return EDetectionRelevance::Full;
+    }
+    if (!bAlwaysRelevant && !OnDetectionsReady.IsBound() && !OnSensorDetectionsReady.IsBound()) {
+        return EDetectionRelevance::Suspended;
+    }
+
+    const float Distance = CameraManager != nullptr && Owner != nullptr
+        ? FVector::Dist(CameraManager->GetCameraLocation(), Owner->GetActorLocation()) : 0.f;
+    if (SuspendDistance > 0.f && Distance > SuspendDistance) {
+        return EDetectionRelevance::Suspended;
+    }
+    // an owner without primitives is never rendered, only its view distance counts then
+    const bool bOffScreen = Owner != nullptr && Owner->FindComponentByClass<UPrimitiveComponent>() != nullptr && !Owner->WasRecentlyRendered(0.5f);
+    if ((ThrottleDistance > 0.f && Distance > ThrottleDistance) || bOffScreen) {
+        return EDetectionRelevance::Throttled;
+    }
+    return EDetectionRelevance::Full;
+}
+
+void UCaptureManager::UpdateRelevance()
+{
+    const EDetectionRelevance NewRelevance = EvaluateRelevance();
+    if (NewRelevance == Relevance) {
+        // whatever could not be freed while frames were in flight
+        if (Relevance == EDetectionRelevance::Suspended && !bSuspendedMemoryReleased) {
+            ReleaseSuspendedMemory();
+        }
+        return;
+    }
+
+    const bool bWasSuspended = Relevance == EDetectionRelevance::Suspended;
+    Relevance = NewRelevance;
+    UE_LOG(LogTemp, Log, TEXT("%s: detection relevance %s"), *GetNameSafe(GetOwner()), *UEnum::GetValueAsString(Relevance));
+    if (bWasSuspended) {
+        RestoreSuspendedMemory();
+        bResumingCapture = true;
+    }
+    ApplySceneCaptureState();
+    if (MainViewExtension.IsValid()) {
+        MainViewExtension->SetEnabled(bCapturingMainView && Relevance != EDetectionRelevance::Suspended);
+    }
+    if (Relevance == EDetectionRelevance::Suspended) {
+        ReleaseSuspendedMemory();
+    }
+}
+
+TArray<UTextureRenderTarget2D*> UCaptureManager::GetCaptureRenderTargets() const
+{
+    TArray<UTextureRenderTarget2D*> Targets = { RenderTarget2D, DepthRenderTarget2D, AtlasRenderTarget2D };
+    Targets.Append(AtlasSensorTargets);
+    Targets.Remove(nullptr);
+    return Targets;
+}
+
+void UCaptureManager::ReleaseSuspendedMemory()
+{
+    // frames in flight still read the targets and the network buffers
+    if (CurrentInferenceTask != nullptr || !InferenceTaskQueue.IsEmpty() || !RenderRequestQueue.IsEmpty()) {
+        return;
+    }
+    // the resources go away on the render thread after every command already enqueued
+    for (UTextureRenderTarget2D* Target : GetCaptureRenderTargets()) {
+        Target->ReleaseResource();
+    }
+    for (UMyNeuralNetwork* NeuralNetwork : ModelVariantNetworks) {
+        NeuralNetwork->ReleaseScratchMemory();
+    }
+    // the readback arrays belong to the render requests, which are all done here. the overlay masks are drawn again
+    // from the next published frame
+    MaskTexture = nullptr;
+    MaskTextureFrameId = -1;
+    ReleaseDepthStaging();
+    bSuspendedMemoryReleased = true;
+}
+
+void UCaptureManager::ReleaseDepthStaging()
+{
+    if (!DepthStagingTexture.IsValid()) {
+        return;
+    }
+    // the last reference goes away on the render thread, never after the rhi shut down
+    ENQUEUE_RENDER_COMMAND(ReleaseDepthStaging)([Staging = MoveTemp(DepthStagingTexture)](FRHICommandListImmediate& RHICmdList) {
+        Staging->SafeRelease();
+        });
+}
+
+void UCaptureManager::RestoreSuspendedMemory()
+{
+    if (!bSuspendedMemoryReleased) {
+        return;
+    }
+    // same size and format as before, the main view extension picks up the new resource in UpdateCaptureSource
+    for (UTextureRenderTarget2D* Target : GetCaptureRenderTargets()) {
+        Target->UpdateResource();
+    }
+    bSuspendedMemoryReleased = false;
+}
+
+bool UCaptureManager::GetCurrentSourceView(int32 Width, int32 Height, FCaptureView& OutView) const
+{
+    if (bCapturingMainView) {
+        // the player camera, cropped like the copy (see FDetectionViewExtension)
+        const APlayerCameraManager* CameraManager = UGameplayStatics::GetPlayerCameraManager(this, 0);
+        const UGameViewportClient* ViewportClient = GetWorld()->GetGameViewport();
+        if (CameraManager == nullptr || ViewportClient == nullptr) {
+            return false;
+        }
+        FVector2D ViewportSize;
+        ViewportClient->GetViewportSize(ViewportSize);
+        const float FOVDegrees = FDetectionViewExtension::GetCroppedFOV(CameraManager->GetFOVAngle(),
+            FIntPoint(FMath::RoundToInt(ViewportSize.X), FMath::RoundToInt(ViewportSize.Y)), FIntPoint(Width, Height));
+        OutView = { FTransform(CameraManager->GetCameraRotation(), CameraManager->GetCameraLocation()), FOVDegrees, Width, Height };
+        return true;
+    }
+    if (!IsValid(ColorCaptureComponents)) {
+        return false;
+    }
+    OutView = { ColorCaptureComponents->GetComponentTransform(), ColorCaptureComponents->FOVAngle, Width, Height };
+    return true;
+}
+
+void UCaptureManager::StartAutoTune()
+{
+    if (AutoTuneState != EAutoTuneState::Idle) {
+        return;
+    }
+    AutoTuneFrames.Reset();
+    AutoTuneState = EAutoTuneState::Recording;
+    UE_LOG(LogTemp, Log, TEXT("AutoTune: recording %d frames"), AutoTuneFrameCount);
+}
+
+/**
+ * @brief Runs the sweep on the thread pool with capture paused, then applies and saves the best configuration
+ */
+void UCaptureManager::RunAutoTune()
+{
+    AutoTuneState = EAutoTuneState::Running;
+    TWeakObjectPtr<UCaptureManager> WeakThis(this);
+    TStrongObjectPtr<UMyNeuralNetwork> NeuralNetwork(myNeuralNetwork);
+    const FScreenImageProperties ScreenImage = AutoTuneScreenImage;
+    const FModelImageProperties ModelImage = ModelImageProperties;
+    // one inference per frameMod game frames is what the capture cadence has to match
+    const double GameFrameSeconds = FApp::GetDeltaTime();
+
+    AsyncPool(*FInferenceThreadPool::Get().GetPool(), [WeakThis, Frames = MoveTemp(AutoTuneFrames), ScreenImage, ModelImage, NeuralNetwork = MoveTemp(NeuralNetwork), GameFrameSeconds]() mutable {
+        FInferenceThreadPool::Get().EnterPoolThread();
+        const FPipelineTuningResult Result = FPipelineAutoTuner::Run(Frames, ScreenImage, ModelImage, NeuralNetwork.Get(), GameFrameSeconds);
+        // the console variables are only ever written on the game thread
+        AsyncTask(ENamedThreads::GameThread, [WeakThis, NeuralNetwork = MoveTemp(NeuralNetwork), Result]() {
+            UE_LOG(LogTemp, Log, TEXT("AutoTune: picked %s workers=%d minbatch=%d framemod=%d (p95 %.2f ms)"),
+                Result.Config.bUseGPU ? TEXT("gpu") : TEXT("cpu"), Result.Config.WorkerCount, Result.Config.ParallelForMinBatch,
+                Result.Config.FrameMod, Result.P95LatencySeconds * 1000.0);
+            FPipelineAutoTuner::ApplyToConsoleVariables(Result.Config);
+            FPipelineAutoTuner::SaveMachineConfig(Result.Config);
+            if (WeakThis.IsValid()) {
+                // the sweep left the tuned network on whatever device it measured last, every variant is set explicitly
+                WeakThis->SetDeviceType(CVarNNUseGPU.GetValueOnGameThread() != 0);
+                WeakThis->AutoTuneState = EAutoTuneState::Idle;
+            }
+            });
+        });
+}
+
+FName UCaptureManager::GetActiveModelName() const
+{
+    if (ModelVariants.IsValidIndex(ActiveVariantIndex)) {
+        return ModelVariants[ActiveVariantIndex].Name;
+    }
+    return neuralNetwork != nullptr ? neuralNetwork->GetFName() : NAME_None;
+}
+
+namespace {
+    // the R32F depth target as it is, 4 bytes per pixel (ReadSurfaceData only returns FColor / FLinearColor, 16 bytes per
+    // pixel for one channel). copied into Staging, a cpu readable texture of the manager that is kept while the size stays
+    // the same
+    void ReadDepth_RenderThread(FRHICommandListImmediate& RHICmdList, FRHITexture* Source, FTextureRHIRef& Staging, TArray<float>& OutDepth) {
+        check(IsInRenderingThread());
+        const FIntPoint Size = Source->GetSizeXY();
+        if (!Staging.IsValid() || Staging->GetSizeXY() != Size) {
+            Staging = RHICreateTexture(FRHITextureCreateDesc::Create2D(TEXT("DetectionDepthReadback"), Size, PF_R32_FLOAT)
+                .SetFlags(ETextureCreateFlags::CPUReadback));
+        }
+        RHICmdList.Transition(FRHITransitionInfo(Source, ERHIAccess::Unknown, ERHIAccess::CopySrc));
+        RHICmdList.Transition(FRHITransitionInfo(Staging, ERHIAccess::Unknown, ERHIAccess::CopyDest));
+        RHICmdList.CopyTexture(Source, Staging, FRHICopyTextureInfo());
+        RHICmdList.Transition(FRHITransitionInfo(Source, ERHIAccess::CopySrc, ERHIAccess::SRVMask));
+        RHICmdList.Transition(FRHITransitionInfo(Staging, ERHIAccess::CopyDest, ERHIAccess::CPURead));
+
+        // maps once the copy is done, the row pitch is returned in pixels
+        void* Data = nullptr;
+        int32 RowPitch = 0;
+        int32 MappedHeight = 0;
+        RHICmdList.MapStagingSurface(Staging, Data, RowPitch, MappedHeight);
+        OutDepth.SetNumUninitialized(Size.X * Size.Y);
+        if (Data == nullptr) {
+            OutDepth.Reset(); // FCaptureDepth::IsValid fails, the frame is not deprojected
+            return;
+        }
+        const float* Src = static_cast<const float*>(Data);
+        for (int32 Y = 0; Y < Size.Y; Y++) {
+            FMemory::Memcpy(OutDepth.GetData() + Y * Size.X, Src + static_cast<int64>(Y) * RowPitch, Size.X * sizeof(float));
+        }
+        RHICmdList.UnmapStagingSurface(Staging);
+    }
+
     void ArrayFColorToUint8(const TArray<FColor>& RawImage, TArray<uint8>& InputImageCPU, int32 Width, int32 Height) {
         const int PixelCount = Width * Height;
         InputImageCPU.SetNumZeroed(PixelCount * 3);
 
-        ParallelFor(RawImage.Num(), [&](int32 Idx) {
-            const int i = Idx * 3;
-            const FColor& Pixel = RawImage[Idx];
+        PipelineParallelFor(RawImage.Num(), [&](int32 Begin, int32 End) {
+            for (int32 Idx = Begin; Idx < End; Idx++) {
+                const int i = Idx * 3;
+                const FColor& Pixel = RawImage[Idx];
+
+                InputImageCPU[i] = Pixel.R;
+                InputImageCPU[i + 1] = Pixel.G;
+                InputImageCPU[i + 2] = Pixel.B;
+            }
+            });
+    }
+
+    // FColor (bgra) straight to one plane per channel (rgb), scaled by Scale. skips the interleaved copy when no resize is needed
+    template<typename T>
+    void ArrayFColorToPlanar(const TArray<FColor>& RawImage, TArray<T>& ModelInputImage, T Scale) {
+        const int32 PixelCount = RawImage.Num();
+        ModelInputImage.SetNumUninitialized(PixelCount * 3);
 
-            InputImageCPU[i] = Pixel.R;
-            InputImageCPU[i + 1] = Pixel.G;
-            InputImageCPU[i + 2] = Pixel.B;
+        const FColor* Src = RawImage.GetData();
+        T* R = ModelInputImage.GetData();
+        T* G = R + PixelCount;
+        T* B = G + PixelCount;
+        PipelineParallelFor(PixelCount, [&](int32 Begin, int32 End) {
+            for (int32 Idx = Begin; Idx < End; Idx++) {
+                const FColor& Pixel = Src[Idx];
+                R[Idx] = static_cast<T>(Pixel.R * Scale);
+                G[Idx] = static_cast<T>(Pixel.G * Scale);
+                B[Idx] = static_cast<T>(Pixel.B * Scale);
+            }
+            });
+    }
+
+    // heap bytes of a decoded frame
+    int64 GetResultsBytes(const FBoxCoordinatesMap& Boxes, const TArray<FDetectionMask>& Masks) {
+        int64 Bytes = Boxes.GetAllocatedSize() + Masks.GetAllocatedSize();
+        for (const auto& Pair : Boxes) {
+            Bytes += Pair.Value.GetAllocatedSize();
+        }
+        for (const FDetectionMask& Mask : Masks) {
+            Bytes += Mask.Runs.GetAllocatedSize();
+        }
+        return Bytes;
+    }
+
+    // one tile of an atlas frame (RowStride pixels per atlas row) into one batch entry of the input tensor, read in place
+    void PreprocessTile(const FColor* Tile, int32 RowStride, int32 Width, int32 Height, EModelInputFormat Format, uint8* Out) {
+        const int32 PixelCount = Width * Height;
+        PipelineParallelFor(Height, [&](int32 Begin, int32 End) {
+            for (int32 Y = Begin; Y < End; Y++) {
+                const FColor* Src = Tile + static_cast<int64>(Y) * RowStride;
+                const int32 Row = Y * Width;
+                if (Format == EModelInputFormat::Float32NCHW) {
+                    float* R = reinterpret_cast<float*>(Out);
+                    for (int32 X = 0; X < Width; X++) {
+                        R[Row + X] = Src[X].R * (1.f / 255);
+                        R[Row + X + PixelCount] = Src[X].G * (1.f / 255);
+                        R[Row + X + PixelCount * 2] = Src[X].B * (1.f / 255);
+                    }
+                } else if (Format == EModelInputFormat::UInt8NCHW) {
+                    for (int32 X = 0; X < Width; X++) {
+                        Out[Row + X] = Src[X].R;
+                        Out[Row + X + PixelCount] = Src[X].G;
+                        Out[Row + X + PixelCount * 2] = Src[X].B;
+                    }
+                } else {
+                    for (int32 X = 0; X < Width; X++) {
+                        Out[(Row + X) * 3] = Src[X].R;
+                        Out[(Row + X) * 3 + 1] = Src[X].G;
+                        Out[(Row + X) * 3 + 2] = Src[X].B;
+                    }
+                }
+            }
+            });
+    }
+
+    // interleaved rgb bytes to one plane per channel
+    void Uint8InterleavedToPlanar(const TArray<uint8>& Interleaved, TArray<uint8>& Planar) {
+        const int32 PixelCount = Interleaved.Num() / 3;
+        Planar.SetNumUninitialized(PixelCount * 3);
+
+        const uint8* Src = Interleaved.GetData();
+        uint8* Dst = Planar.GetData();
+        PipelineParallelFor(PixelCount, [&](int32 Begin, int32 End) {
+            for (int32 Idx = Begin; Idx < End; Idx++) {
+                Dst[Idx] = Src[Idx * 3];
+                Dst[Idx + PixelCount] = Src[Idx * 3 + 1];
+                Dst[Idx + PixelCount * 2] = Src[Idx * 3 + 2];
+            }
             });
     }
 }
@@ -69,11 +686,14 @@ void UCaptureManager::SetNeuralNetwork(UNeuralNetwork* Model)
 {
     //log model
     UE_LOG(LogTemp, Warning, TEXT("Model: %s"), *Model->GetName());
-    Model->AddToRoot();
-    UCaptureManager::myNeuralNetwork = NewObject<UMyNeuralNetwork>();
-    //Model->SetDeviceType(ENeuralDeviceType::GPU); //gpu currently slower than cpu
-    Model->SetDeviceType(ENeuralDeviceType::CPU);
-    UCaptureManager::myNeuralNetwork->Network = Model;
+    ModelVariantNetworks.Reset();
+    ModelVariantNetworks.Add(CreateNeuralNetwork(Model));
+    ActivateModelVariant(0);
+
+    // a network set before BeginPlay is warmed up from there
+    if (HasBegunPlay()) {
+        StartWarmUp();
+    }
 }
 
 UNeuralNetwork* UCaptureManager::GetNeuralNetwork()
@@ -81,62 +701,124 @@ UNeuralNetwork* UCaptureManager::GetNeuralNetwork()
     return UCaptureManager::neuralNetwork;
 }
 
-void UCaptureManager::OnCanvasRenderTargetUpdate2(UCanvas* Canvas, int32 Width, int32 Height) {
-    // loop BoundingBoxCoordinatesMap and draw boxes and labels
-    // set of boxes that were drawn
-    TArray<UMyNeuralNetwork::FBoxCoordinates> drawnBoxes;
-    for(auto const& pair : BoundingBoxCoordinatesMap)
-    {
-        int classIndex = pair.Key;
-        // convert index to string
-        FString classLabel = FString::FromInt(classIndex);
-        if(CocoDatasetClassIntToStringMap.Contains(classIndex))
-        {
-            classLabel = CocoDatasetClassIntToStringMap[classIndex];
-        }
-        TArray<UMyNeuralNetwork::FBoxCoordinates> boundingBoxCoordinates = pair.Value;
+const UCaptureManager::FClassLabelLayout& UCaptureManager::GetLabelLayout(UCanvas* Canvas, UFont* Font, int32 ClassIndex) {
+    if (LabelLayouts.Num() <= ClassIndex) {
+        LabelLayouts.SetNum(ClassIndex + 1);
+    }
+    FClassLabelLayout& Layout = LabelLayouts[ClassIndex];
+    if (Layout.Text.IsEmpty()) {
+        // first use of this class since the labels changed
+        Layout.Text = FDetectionLabels::Get().GetLabel(ClassIndex);
+        float Width = 0.f;
+        float Height = 0.f;
+        Canvas->TextSize(Font, Layout.Text.ToString(), Width, Height, 2.f, 2.f);
+        Layout.Size = FVector2D(Width, Height);
+    }
+    return Layout;
+}
 
-        // keep track of the boxes, and if there are overlapping boxes, only draw the one with the highest confidence.
-        // need to find a way of detecting overlapping boxes by comparing their coordinates
-        for(auto box: boundingBoxCoordinates)
-        {
-            FBox Box = FBox(FVector(box.x1, box.y1, 0.f), FVector(box.x1 + box.width, box.y1 + box.height, 0.f));
-            // loop through drawn boxes and get the box coordinates. Then do a calculation with current box and see if they overlap.
-            bool canDraw = true;
-            for (auto cbox : drawnBoxes)
-            {
-                // Create an FBox from the drawn box coordinates
-                FBox DrawnBox = FBox(FVector(cbox.x1, cbox.y1, 0.f), FVector(cbox.x1 + cbox.width, cbox.y1 + cbox.height, 0.f));
-
-                // Check if the boxes intersect
-                if (Box.Intersect(DrawnBox))
-                {
-                    // Do something if the boxes overlap
-                    // log the box coordinates
-                    UE_LOG(LogTemp, Warning, TEXT("Box intersects"));
-                    canDraw = false;
-                    break;
-                } else
-                {
+bool UCaptureManager::UpdateMaskTexture(int32 Width, int32 Height) {
+    if (DetectionMasks.Num() == 0 || Width <= 0 || Height <= 0) {
+        return false;
+    }
+    if (MaskTexture == nullptr || MaskTexture->GetSizeX() != Width || MaskTexture->GetSizeY() != Height) {
+        MaskTexture = UTexture2D::CreateTransient(Width, Height, PF_B8G8R8A8);
+        MaskTexture->Filter = TF_Nearest;
+        MaskTexture->SRGB = true;
+        MaskTexture->UpdateResource();
+        MaskTextureFrameId = -1;
+    }
+    const int64 FrameId = PublishedFrameId;
+    if (FrameId == MaskTextureFrameId) {
+        return true;
+    }
+    MaskTextureFrameId = FrameId;
+
+    // transparent apart from the foreground runs, in model image pixels like the boxes. the render thread frees the
+    // pixels once they are uploaded
+    TArray<FColor>* pixels = new TArray<FColor>();
+    pixels->SetNumZeroed(Width * Height);
+    for (const FDetectionMask& mask : DetectionMasks) {
+        FLinearColor linearColor = FLinearColor::MakeFromHSV8(static_cast<uint8>(mask.ClassIndex * 47), 200, 255);
+        linearColor.A = 0.4f;
+        const FColor maskColor = linearColor.ToFColor(true);
+        int32 position = 0;
+        for (int32 run = 0; run < mask.Runs.Num() && mask.Width > 0; run++) {
+            // odd runs are foreground
+            if ((run & 1) == 1) {
+                for (int32 pixel = position; pixel < position + mask.Runs[run]; pixel++) {
+                    const int32 x = mask.X + pixel % mask.Width;
+                    const int32 y = mask.Y + pixel / mask.Width;
+                    if (x < Width && y < Height) {
+                        (*pixels)[y * Width + x] = maskColor;
+                    }
                 }
             }
-            if(canDraw)
-            {
-                float x = box.x1;
-                float y = box.y1;
-                float width = box.width;
-                float height = box.height;
-                Canvas->K2_DrawBox(FVector2D(x, y), FVector2D(width, height), 5, FLinearColor::Red);
-                UFont* ufont = GEngine->GetSmallFont();
-                Canvas->K2_DrawText(ufont, classLabel, FVector2D(x, y - 32), FVector2D(2, 2), FLinearColor::Green);
-                // FLinearColor TextCol(FLinearColor::Green);
-                // TextCol.A = 255;
-                // FCanvasTextItem TextItem(FVector2D(x, y - 32), FText::FromString(classLabel), ufont, TextCol);
-                // Canvas->DrawItem(TextItem);
-                drawnBoxes.Add(box);
-            }
+            position += mask.Runs[run];
         }
     }
+    FUpdateTextureRegion2D* region = new FUpdateTextureRegion2D(0, 0, 0, 0, Width, Height);
+    MaskTexture->UpdateTextureRegions(0, 1, region, Width * sizeof(FColor), sizeof(FColor), reinterpret_cast<uint8*>(pixels->GetData()),
+        [pixels](uint8*, const FUpdateTextureRegion2D* regions) {
+            delete pixels;
+            delete regions;
+        });
+    return true;
+}
+
+void UCaptureManager::OnCanvasRenderTargetUpdate2(UCanvas* Canvas, int32 Width, int32 Height) {
+    LLM_SCOPE_BYTAG(DetectionPipeline_Overlay);
+    // the flow of a frame ends at the first draw that shows its detections
+    const int64 DrawnFrameId = PublishedFrameId;
+    FScopedFrameTrace Trace(TEXT("OverlayDraw"), DrawnFrameId,
+        DrawnFrameId != LastDrawnFrameId ? EFrameTraceFlow::End : EFrameTraceFlow::None);
+    LastDrawnFrameId = DrawnFrameId;
+
+    // instance masks under the boxes, one translucent tile for all of them
+    if (UpdateMaskTexture(Width, Height)) {
+        FCanvasTileItem tile(FVector2D::ZeroVector, MaskTexture->GetResource(), FVector2D(Width, Height), FLinearColor::White);
+        tile.BlendMode = SE_BLEND_Translucent;
+        Canvas->DrawItem(tile);
+    }
+
+    UFont* labelFont = GEngine->GetSmallFont();
+    if (LabelLayoutGeneration != FDetectionLabels::Get().GetGeneration()) {
+        LabelLayoutGeneration = FDetectionLabels::Get().GetGeneration();
+        LabelLayouts.Reset();
+    }
+
+    // boxes that overlap an earlier drawn box are skipped (see SuppressOverlappingBoxes)
+    TArray<TPair<int, UMyNeuralNetwork::FBoxCoordinates>> drawnBoxes;
+    SuppressOverlappingBoxes(BoundingBoxCoordinatesMap, drawnBoxes);
+
+    // the boxes are from the last inference, move them to where they are seen from the capture component now
+    FCaptureView currentView;
+    if (CVarNNReprojectEnable.GetValueOnGameThread() != 0 && PublishedCaptureView.IsValid() && GetCurrentSourceView(Width, Height, currentView)) {
+        TArray<UMyNeuralNetwork::FBoxCoordinates*, TInlineAllocator<64>> boxRefs;
+        for (auto& pair : drawnBoxes) {
+            boxRefs.Add(&pair.Value);
+        }
+        ReprojectBoxes(PublishedCaptureView, currentView, CVarNNReprojectDefaultDepth.GetValueOnGameThread(), boxRefs);
+    }
+
+    for (auto const& pair : drawnBoxes)
+    {
+        const UMyNeuralNetwork::FBoxCoordinates& box = pair.Value;
+        if (box.width <= 0.f || box.height <= 0.f) {
+            continue; // behind the camera since it was captured
+        }
+        const FClassLabelLayout& label = GetLabelLayout(Canvas, labelFont, pair.Key);
+
+        float x = box.x1;
+        float y = box.y1;
+        float width = box.width;
+        float height = box.height;
+        Canvas->K2_DrawBox(FVector2D(x, y), FVector2D(width, height), 5, FLinearColor::Red);
+        // label sits on top of the box, the text item takes the cached FText as is
+        FCanvasTextItem textItem(FVector2D(x, y - label.Size.Y), label.Text, labelFont, FLinearColor::Green);
+        textItem.Scale = FVector2D(2, 2);
+        Canvas->DrawItem(textItem);
+    }
     
         
     // for(auto const& box : boundingBoxCoordinates)
@@ -166,6 +848,7 @@ void UCaptureManager::OnCanvasRenderTargetUpdate2(UCanvas* Canvas, int32 Width,
  * @brief Initializes the render targets and material
  */
 void UCaptureManager::SetupColorCaptureComponent(USceneCaptureComponent2D* CaptureComponent) {
+    LLM_SCOPE_BYTAG(DetectionPipeline_Capture);
     UObject* worldContextObject = GetWorld();
 
     // scene capture component render target (stores frame that is then pulled from gpu to cpu for neural network input)
@@ -201,6 +884,24 @@ void UCaptureManager::SetupColorCaptureComponent(USceneCaptureComponent2D* Captu
     // Set Camera Properties
     CaptureComponent->CaptureSource = ESceneCaptureSource::SCS_FinalColorLDR;
     CaptureComponent->ShowFlags.SetTemporalAA(true);
+
+    if (bCaptureDepth) {
+        // second capture on the same transform and fov, linear scene depth into a float target of the same size
+        DepthRenderTarget2D = NewObject<UTextureRenderTarget2D>(this);
+        DepthRenderTarget2D->InitAutoFormat(256, 256);
+        DepthRenderTarget2D->InitCustomFormat(ModelImageProperties.width, ModelImageProperties.height, PF_R32_FLOAT, true);
+        DepthRenderTarget2D->RenderTargetFormat = ETextureRenderTargetFormat::RTF_R32f;
+        DepthRenderTarget2D->bGPUSharedFlag = true;
+
+        DepthCaptureComponent = NewObject<USceneCaptureComponent2D>(GetOwner(), TEXT("DepthCapture"));
+        DepthCaptureComponent->SetupAttachment(CaptureComponent);
+        DepthCaptureComponent->CaptureSource = ESceneCaptureSource::SCS_SceneDepth;
+        DepthCaptureComponent->TextureTarget = DepthRenderTarget2D;
+        DepthCaptureComponent->FOVAngle = CaptureComponent->FOVAngle;
+        DepthCaptureComponent->bCaptureEveryFrame = CaptureComponent->bCaptureEveryFrame;
+        DepthCaptureComponent->bCaptureOnMovement = CaptureComponent->bCaptureOnMovement;
+        DepthCaptureComponent->RegisterComponent();
+    }
 }
 
 /**
@@ -208,12 +909,13 @@ void UCaptureManager::SetupColorCaptureComponent(USceneCaptureComponent2D* Captu
  * @param CaptureComponent 
  * @param IsSegmentation 
  */
-void UCaptureManager::CaptureColorNonBlocking(USceneCaptureComponent2D* CaptureComponent, bool IsSegmentation) {
+int64 UCaptureManager::CaptureColorNonBlocking(USceneCaptureComponent2D* CaptureComponent, bool IsSegmentation) {
     if (!IsValid(CaptureComponent)) {
         UE_LOG(LogTemp, Error, TEXT("CaptureColorNonBlocking: CaptureComponent was not valid!"));
-        return;
+        return -1;
     }
 
+    LLM_SCOPE_BYTAG(DetectionPipeline_Capture);
     FTextureRenderTargetResource* renderTargetResource = CaptureComponent->TextureTarget->GameThread_GetRenderTargetResource();
     
     const int32& rtx = CaptureComponent->TextureTarget->SizeX;
@@ -229,12 +931,27 @@ void UCaptureManager::CaptureColorNonBlocking(USceneCaptureComponent2D* CaptureC
     // Init new RenderRequest
     FRenderRequest* renderRequest = new FRenderRequest();
     renderRequest->isPNG = IsSegmentation;
+    renderRequest->FrameId = NextFrameId++;
+    renderRequest->CaptureCycles = FPlatformTime::Cycles64();
+    renderRequest->CaptureTimestampNs = static_cast<uint64>((FDateTime::UtcNow() - FDateTime(1970, 1, 1)).GetTicks()) * 100;
+    FScopedFrameTrace Trace(TEXT("Capture"), renderRequest->FrameId, EFrameTraceFlow::Start);
 
     int32 width = rtx; 
     int32 height = rty;
     ScreenImageProperties = { width, height };
+    renderRequest->ScreenImage = ScreenImageProperties;
+    if (bCapturingMainView) {
+        // the copy is from the last rendered frame, its view replaces this estimate when it is read back
+        GetCurrentSourceView(width, height, renderRequest->CaptureView);
+    } else {
+        renderRequest->CaptureView.Transform = CaptureComponent->GetComponentTransform();
+        renderRequest->CaptureView.FOVDegrees = CaptureComponent->FOVAngle;
+    }
+    TSharedPtr<FDetectionViewExtension, ESPMode::ThreadSafe> viewExtension = bCapturingMainView ? MainViewExtension : nullptr;
+    FCaptureView* captureView = &renderRequest->CaptureView;
 
     // Setup GPU command. send the same command again but use the render target that is in the widget, and modify it to add the box
+    const int64 FrameId = renderRequest->FrameId;
     FReadSurfaceContext readSurfaceContext = {
         renderTargetResource,
         &(renderRequest->Image), // store frame in render request
@@ -242,14 +959,42 @@ void UCaptureManager::CaptureColorNonBlocking(USceneCaptureComponent2D* CaptureC
         FReadSurfaceDataFlags(RCM_UNorm, CubeFace_MAX)
     };
     
+    // depth comes back in the same command, so both images of a request are from the same frame
+    FRenderTarget* depthRenderTarget = nullptr;
+    if (DepthCaptureComponent != nullptr && DepthRenderTarget2D != nullptr && !bCapturingMainView) {
+        DepthCaptureComponent->FOVAngle = CaptureComponent->FOVAngle;
+        depthRenderTarget = DepthRenderTarget2D->GameThread_GetRenderTargetResource();
+        renderRequest->Depth.Width = DepthRenderTarget2D->SizeX;
+        renderRequest->Depth.Height = DepthRenderTarget2D->SizeY;
+        renderRequest->Depth.PixelToWorld = MakeDepthPixelToWorld(DepthCaptureComponent->GetComponentTransform(),
+            DepthCaptureComponent->FOVAngle, DepthRenderTarget2D->SizeX, DepthRenderTarget2D->SizeY);
+    }
+    TArray<float>* depthData = &renderRequest->Depth.Pixels;
+    if (depthRenderTarget != nullptr && !DepthStagingTexture.IsValid()) {
+        DepthStagingTexture = MakeShared<FTextureRHIRef, ESPMode::ThreadSafe>();
+    }
+    TSharedPtr<FTextureRHIRef, ESPMode::ThreadSafe> depthStaging = DepthStagingTexture;
+    // the readback arrays are filled on the render thread, counted here with their final size
+    renderRequest->TrackedBytes = static_cast<int64>(width) * height * sizeof(FColor)
+        + static_cast<int64>(renderRequest->Depth.Width) * renderRequest->Depth.Height * sizeof(float);
+    FPipelineMemory::Add(EPipelineMemoryStage::Readback, renderRequest->TrackedBytes);
+
     ENQUEUE_RENDER_COMMAND(SceneDrawCompletion)(
-        [readSurfaceContext](FRHICommandListImmediate& RHICmdList) {
+        [readSurfaceContext, FrameId, depthRenderTarget, depthStaging, depthData, viewExtension, captureView](FRHICommandListImmediate& RHICmdList) {
+            LLM_SCOPE_BYTAG(DetectionPipeline_Capture);
+            if (viewExtension.IsValid() && viewExtension->GetCopiedView_RenderThread().IsValid()) {
+                *captureView = viewExtension->GetCopiedView_RenderThread();
+            }
+            FScopedFrameTrace Trace(TEXT("ReadSurfaceData"), FrameId, EFrameTraceFlow::Step);
             RHICmdList.ReadSurfaceData(
                 readSurfaceContext.SrcRenderTarget->GetRenderTargetTexture(),
                 readSurfaceContext.Rect,
                 *readSurfaceContext.OutData,
                 readSurfaceContext.Flags
             );
+            if (depthRenderTarget != nullptr) {
+                ReadDepth_RenderThread(RHICmdList, depthRenderTarget->GetRenderTargetTexture(), *depthStaging, *depthData);
+            }
         });
 
     // Add new task to RenderQueue
@@ -258,6 +1003,127 @@ void UCaptureManager::CaptureColorNonBlocking(USceneCaptureComponent2D* CaptureC
     // Set RenderCommandFence
     // TODO: should pass true or false?
     renderRequest->RenderFence.BeginFence(false);
+    return FrameId;
+}
+
+/**
+ * @brief Creates a render target per atlas sensor and the atlas they are copied into, all at the model size
+ */
+void UCaptureManager::SetupAtlas() {
+    LLM_SCOPE_BYTAG(DetectionPipeline_Capture);
+    const int32 NumSensors = AtlasSensors.Num();
+    AtlasColumns = FMath::Max(1, FMath::CeilToInt(FMath::Sqrt(static_cast<float>(NumSensors))));
+    const int32 Rows = FMath::DivideAndRoundUp(NumSensors, AtlasColumns);
+    const int32 TileWidth = ModelImageProperties.width;
+    const int32 TileHeight = ModelImageProperties.height;
+
+    auto InitTarget = [](UTextureRenderTarget2D* Target, int32 Width, int32 Height) {
+        Target->InitCustomFormat(Width, Height, PF_B8G8R8A8, true);
+        Target->RenderTargetFormat = ETextureRenderTargetFormat::RTF_RGBA8;
+        Target->bGPUSharedFlag = true;
+        Target->TargetGamma = 1.2f;
+    };
+    if (AtlasRenderTarget2D == nullptr) {
+        AtlasRenderTarget2D = NewObject<UTextureRenderTarget2D>(this);
+    }
+    InitTarget(AtlasRenderTarget2D, AtlasColumns * TileWidth, Rows * TileHeight);
+
+    AtlasSensorTargets.SetNum(NumSensors);
+    for (int32 i = 0; i < NumSensors; i++) {
+        if (AtlasSensorTargets[i] == nullptr) {
+            AtlasSensorTargets[i] = NewObject<UTextureRenderTarget2D>(this);
+        }
+        InitTarget(AtlasSensorTargets[i], TileWidth, TileHeight);
+        USceneCaptureComponent2D* Sensor = AtlasSensors[i];
+        if (!IsValid(Sensor)) {
+            UE_LOG(LogTemp, Warning, TEXT("Atlas sensor %d not set, its tile stays empty"), i);
+            continue;
+        }
+        // rendered only when the atlas is captured
+        Sensor->TextureTarget = AtlasSensorTargets[i];
+        Sensor->CaptureSource = ESceneCaptureSource::SCS_FinalColorLDR;
+        Sensor->bCaptureEveryFrame = false;
+        Sensor->bCaptureOnMovement = false;
+    }
+    UE_LOG(LogTemp, Log, TEXT("Atlas: %d sensors in %dx%d tiles of %dx%d"), NumSensors, AtlasColumns, Rows, TileWidth, TileHeight);
+}
+
+/**
+ * @brief Renders every atlas sensor, copies the tiles into the atlas on the gpu and reads the atlas back with one fence
+ */
+int64 UCaptureManager::CaptureAtlasNonBlocking() {
+    if (AtlasRenderTarget2D == nullptr || AtlasSensorTargets.Num() != AtlasSensors.Num()) {
+        UE_LOG(LogTemp, Error, TEXT("CaptureAtlasNonBlocking: atlas was not set up!"));
+        return -1;
+    }
+
+    LLM_SCOPE_BYTAG(DetectionPipeline_Capture);
+    FRenderRequest* renderRequest = new FRenderRequest();
+    renderRequest->FrameId = NextFrameId++;
+    renderRequest->CaptureCycles = FPlatformTime::Cycles64();
+    renderRequest->CaptureTimestampNs = static_cast<uint64>((FDateTime::UtcNow() - FDateTime(1970, 1, 1)).GetTicks()) * 100;
+    FScopedFrameTrace Trace(TEXT("Capture"), renderRequest->FrameId, EFrameTraceFlow::Start);
+
+    const FIntPoint tileSize(AtlasSensorTargets[0]->SizeX, AtlasSensorTargets[0]->SizeY);
+    const int32 width = AtlasRenderTarget2D->SizeX;
+    const int32 height = AtlasRenderTarget2D->SizeY;
+    renderRequest->ScreenImage = { width, height };
+    renderRequest->AtlasColumns = AtlasColumns;
+    renderRequest->AtlasTileSize = tileSize;
+
+    // CaptureScene enqueues the sensor renders right away, so they run before the copy below
+    TArray<FTextureRenderTargetResource*> tileResources;
+    for (int32 i = 0; i < AtlasSensors.Num(); i++) {
+        USceneCaptureComponent2D* Sensor = AtlasSensors[i];
+        FCaptureView& view = renderRequest->AtlasViews.AddDefaulted_GetRef();
+        if (!IsValid(Sensor)) {
+            continue;
+        }
+        Sensor->CaptureScene();
+        view = { Sensor->GetComponentTransform(), Sensor->FOVAngle, tileSize.X, tileSize.Y };
+        tileResources.Add(AtlasSensorTargets[i]->GameThread_GetRenderTargetResource());
+    }
+    // tile index of every entry of tileResources
+    TArray<int32> tileIndices;
+    for (int32 i = 0; i < renderRequest->AtlasViews.Num(); i++) {
+        if (renderRequest->AtlasViews[i].IsValid()) {
+            tileIndices.Add(i);
+        }
+    }
+
+    FTextureRenderTargetResource* atlasResource = AtlasRenderTarget2D->GameThread_GetRenderTargetResource();
+    TArray<FColor>* outData = &renderRequest->Image;
+    const int32 columns = AtlasColumns;
+    const int64 FrameId = renderRequest->FrameId;
+    renderRequest->TrackedBytes = static_cast<int64>(width) * height * sizeof(FColor);
+    FPipelineMemory::Add(EPipelineMemoryStage::Readback, renderRequest->TrackedBytes);
+
+    ENQUEUE_RENDER_COMMAND(AtlasDrawCompletion)(
+        [tileResources = MoveTemp(tileResources), tileIndices = MoveTemp(tileIndices), atlasResource, columns, tileSize, width, height, FrameId, outData](FRHICommandListImmediate& RHICmdList) {
+            LLM_SCOPE_BYTAG(DetectionPipeline_Capture);
+            FRHITexture* atlasTexture = atlasResource->GetRenderTargetTexture();
+            {
+                FScopedFrameTrace Trace(TEXT("AtlasCopy"), FrameId);
+                RHICmdList.Transition(FRHITransitionInfo(atlasTexture, ERHIAccess::Unknown, ERHIAccess::CopyDest));
+                for (int32 i = 0; i < tileResources.Num(); i++) {
+                    FRHITexture* tileTexture = tileResources[i]->GetRenderTargetTexture();
+                    FRHICopyTextureInfo copyInfo;
+                    copyInfo.Size = FIntVector(tileSize.X, tileSize.Y, 1);
+                    copyInfo.DestPosition = FIntVector((tileIndices[i] % columns) * tileSize.X, (tileIndices[i] / columns) * tileSize.Y, 0);
+                    RHICmdList.Transition(FRHITransitionInfo(tileTexture, ERHIAccess::Unknown, ERHIAccess::CopySrc));
+                    RHICmdList.CopyTexture(tileTexture, atlasTexture, copyInfo);
+                    RHICmdList.Transition(FRHITransitionInfo(tileTexture, ERHIAccess::CopySrc, ERHIAccess::SRVMask));
+                }
+                RHICmdList.Transition(FRHITransitionInfo(atlasTexture, ERHIAccess::CopyDest, ERHIAccess::SRVMask));
+            }
+            // one readback for every sensor
+            FScopedFrameTrace Trace(TEXT("ReadSurfaceData"), FrameId, EFrameTraceFlow::Step);
+            RHICmdList.ReadSurfaceData(atlasTexture, FIntRect(0, 0, width, height), *outData, FReadSurfaceDataFlags(RCM_UNorm, CubeFace_MAX));
+        });
+
+    RenderRequestQueue.Enqueue(renderRequest);
+    renderRequest->RenderFence.BeginFence(false);
+    return FrameId;
 }
 
 /**
@@ -271,20 +1137,68 @@ void UCaptureManager::TickComponent(float DeltaTime, ELevelTick TickType, FActor
 {
     Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
 
-    if (!InferenceTaskQueue.IsEmpty()) { // Check if there is a task in queue and start it, and delete the old one
-        if (CurrentInferenceTask == nullptr || CurrentInferenceTask->IsDone()) {
-            FAsyncTask<AsyncInferenceTask>* task = nullptr;
-            InferenceTaskQueue.Dequeue(task);
-            task->StartBackgroundTask();
-            if (CurrentInferenceTask != nullptr && CurrentInferenceTask->IsDone()) delete CurrentInferenceTask;
-            CurrentInferenceTask = task;
+    // nothing to submit frames to until the model is loaded and warmed up
+    if (!bPipelineReady) {
+        return;
+    }
+
+    if (CurrentInferenceTask != nullptr && CurrentInferenceTask->IsDone()) { // harvest the finished task
+        // gated frames are not what the quality controller budgets for
+        if (CurrentInferenceTask->GetTask().RanDetection()) {
+            // an atlas frame ran every tile, QoS budgets one model run
+            const int32 NumRuns = FMath::Max(1, CurrentInferenceTask->GetTask().GetAtlasViews().Num());
+            LatencyTracker.AddSample(CurrentInferenceTask->GetTask().GetElapsedSeconds() / NumRuns);
         }
+        PublishTaskResults(CurrentInferenceTask->GetTask());
+        delete CurrentInferenceTask;
+        CurrentInferenceTask = nullptr;
+        // between frames: the next task is created with whatever variant is active now
+        UpdateQualityOfService();
     }
 
-    if (frameCount++ % frameMod == 0) { // capture every frameMod frame
+    if (AutoTuneState == EAutoTuneState::Recorded && CurrentInferenceTask == nullptr) {
+        RunAutoTune();
+    }
+    if (AutoTuneState == EAutoTuneState::Recorded || AutoTuneState == EAutoTuneState::Running) {
+        return; // pipeline paused so the sweep has the network and the cores to itself
+    }
+
+    if (CurrentInferenceTask == nullptr) {
+        SyncDeviceType();
+    }
+    UpdateRelevance();
+    UpdateCaptureSource();
+    FDetectionClassFilter::Get().Update();
+    if (!InferenceTaskQueue.IsEmpty() && CurrentInferenceTask == nullptr) { // Check if there is a task in queue and start it
+        FAsyncTask<AsyncInferenceTask>* task = nullptr;
+        InferenceTaskQueue.Dequeue(task);
+        task->StartBackgroundTask(FInferenceThreadPool::Get().GetPool().Get());
+        CurrentInferenceTask = task;
+    }
+
+    frameMod = FMath::Max(1, CVarNNFrameMod.GetValueOnGameThread());
+    if (Relevance == EDetectionRelevance::Throttled) {
+        frameMod *= FMath::Max(1, CVarNNRelevanceThrottleFactor.GetValueOnGameThread());
+    }
+    const bool bDetectRequested = PendingDetections.ContainsByPredicate([](const FPendingDetection& Pending) { return Pending.FrameId < 0; });
+    const bool bPeriodicFrame = frameCount++ % frameMod == 0;
+    if (bResumingCapture) {
+        // the sources render again this frame, the first capture after the suspension reads it on the next tick
+        bResumingCapture = false;
+        frameCount = 0;
+    } else if (Relevance != EDetectionRelevance::Suspended && ((bPeriodicCapture && bPeriodicFrame) || bDetectRequested)) { // capture every frameMod frame, or when asked to
         // Capture Color Image (adds render request to queue)
-        CaptureColorNonBlocking(ColorCaptureComponents, false);
+        const int64 CapturedFrameId = AtlasSensorTargets.Num() > 0 ? CaptureAtlasNonBlocking()
+            : CaptureColorNonBlocking(ColorCaptureComponents, bEnableSegmentation);
         frameCount = 1;
+        // the frame just captured answers every open request. nothing was captured when it failed, they wait for the next one
+        if (CapturedFrameId >= 0) {
+            for (FPendingDetection& Pending : PendingDetections) {
+                if (Pending.FrameId < 0) {
+                    Pending.FrameId = CapturedFrameId;
+                }
+            }
+        }
     }
     // If there is a render task in the queue, read pixels once RenderFence is completed
     if (!RenderRequestQueue.IsEmpty()) {
@@ -293,63 +1207,496 @@ void UCaptureManager::TickComponent(float DeltaTime, ELevelTick TickType, FActor
         RenderRequestQueue.Peek(nextRenderRequest);
         if (nextRenderRequest) { // nullptr check
             if (nextRenderRequest->RenderFence.IsFenceComplete()) { // Check if rendering is done, indicated by RenderFence
+                FFrameTrace::AddSlice(TEXT("FenceWait"), nextRenderRequest->FrameId, nextRenderRequest->CaptureCycles,
+                    FPlatformTime::Cycles64(), EFrameTraceFlow::None, EFrameTraceTrack::FenceWait);
                 // we have the image, now we draw a box around the detected object and display it on the screen
                 // render image to render target
-                UKismetRenderingLibrary::ExportRenderTarget(GEngine->GetWorld(), RenderTarget2D, "C:\\ueimages", "test.png");
+                if (CVarNNDebugSaveCaptures.GetValueOnGameThread() != 0) {
+                    UKismetRenderingLibrary::ExportRenderTarget(GetWorld(), RenderTarget2D,
+                        FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("DetectionCaptures")), TEXT("capture.png"));
+                }
                 // renderTarget2D->UpdateResource(); // if update before saving to image it will be black
+                // the tuner measures single frames
+                if (AutoTuneState == EAutoTuneState::Recording && nextRenderRequest->AtlasViews.Num() == 0) {
+                    AutoTuneFrames.Add(nextRenderRequest->Image);
+                    AutoTuneScreenImage = nextRenderRequest->ScreenImage;
+                    if (AutoTuneFrames.Num() >= AutoTuneFrameCount) {
+                        AutoTuneState = EAutoTuneState::Recorded;
+                    }
+                }
                 // create and enqueue new inference task
+                LLM_SCOPE_BYTAG(DetectionPipeline_Preprocess);
                 FAsyncTask<AsyncInferenceTask>* MyTask =
-                    new FAsyncTask<AsyncInferenceTask>(nextRenderRequest->Image, ScreenImageProperties, ModelImageProperties, myNeuralNetwork);
+                    new FAsyncTask<AsyncInferenceTask>(nextRenderRequest->Image, nextRenderRequest->ScreenImage, ModelImageProperties, myNeuralNetwork,
+                        nextRenderRequest->FrameId, nextRenderRequest->CaptureTimestampNs);
+                MyTask->GetTask().SetDepth(MoveTemp(nextRenderRequest->Depth));
+                MyTask->GetTask().SetDecodeMasks(nextRenderRequest->isPNG);
+                MyTask->GetTask().SetGate(&Gate);
+                // boxes come out in model image pixels
+                FCaptureView captureView = nextRenderRequest->CaptureView;
+                captureView.Width = ModelImageProperties.width;
+                captureView.Height = ModelImageProperties.height;
+                MyTask->GetTask().SetCaptureView(captureView);
+                if (nextRenderRequest->AtlasViews.Num() > 0) {
+                    MyTask->GetTask().SetAtlas(nextRenderRequest->AtlasColumns, nextRenderRequest->AtlasTileSize, MoveTemp(nextRenderRequest->AtlasViews));
+                }
                 InferenceTaskQueue.Enqueue(MyTask);
                 // Delete the first element from RenderQueue
                 RenderRequestQueue.Pop();
+                FPipelineMemory::Remove(EPipelineMemoryStage::Readback, nextRenderRequest->TrackedBytes);
                 delete nextRenderRequest;
             }
         }
     }
 
-    BoundingBoxRenderTarget2D->UpdateResource();
+    // the overlay is only on screen for a fully relevant manager
+    if (Relevance == EDetectionRelevance::Full) {
+        BoundingBoxRenderTarget2D->UpdateResource();
+    }
+    FPipelineMemory::CheckBudget(GetResidentMemory());
+}
+
+int64 UCaptureManager::GetResidentMemory(TArray<TPair<FString, int64>>* OutBreakdown) const
+{
+    int64 Total = 0;
+    auto AddItem = [&Total, OutBreakdown](const TCHAR* Name, int32 Index, int64 Bytes) {
+        Total += Bytes;
+        if (OutBreakdown != nullptr && Bytes > 0) {
+            OutBreakdown->Emplace(Index >= 0 ? FString::Printf(TEXT("%s %d"), Name, Index) : FString(Name), Bytes);
+        }
+    };
+
+    // render targets, gpu side
+    const UTextureRenderTarget2D* RenderTargets[] = { RenderTarget2D, BoundingBoxRenderTarget2D, DepthRenderTarget2D };
+    const TCHAR* RenderTargetNames[] = { TEXT("Capture render target"), TEXT("Overlay render target"), TEXT("Depth render target") };
+    for (int32 i = 0; i < UE_ARRAY_COUNT(RenderTargets); i++) {
+        // released while suspended
+        if (RenderTargets[i] != nullptr && RenderTargets[i]->GetResource() != nullptr) {
+            AddItem(RenderTargetNames[i], -1, RenderTargets[i]->CalcTextureMemorySizeEnum(TMC_AllMips));
+        }
+    }
+    if (AtlasRenderTarget2D != nullptr && AtlasRenderTarget2D->GetResource() != nullptr) {
+        AddItem(TEXT("Atlas render target"), -1, AtlasRenderTarget2D->CalcTextureMemorySizeEnum(TMC_AllMips));
+    }
+    int64 SensorTargetBytes = 0;
+    for (const UTextureRenderTarget2D* Target : AtlasSensorTargets) {
+        SensorTargetBytes += Target != nullptr && Target->GetResource() != nullptr ? Target->CalcTextureMemorySizeEnum(TMC_AllMips) : 0;
+    }
+    AddItem(TEXT("Sensor render targets"), -1, SensorTargetBytes);
+    if (MaskTexture != nullptr && MaskTexture->GetResource() != nullptr) {
+        AddItem(TEXT("Mask texture"), -1, MaskTexture->CalcTextureMemorySizeEnum(TMC_AllMips));
+    }
+
+    // input and output tensors of every preloaded variant and the gate
+    auto GetTensorBytes = [](const UNeuralNetwork* Network) {
+        int64 Bytes = 0;
+        if (Network != nullptr && Network->IsLoaded()) {
+            Bytes += Network->GetInputTensor().NumInBytes();
+            for (int32 i = 0; i < Network->GetOutputTensorNumber(); i++) {
+                Bytes += Network->GetOutputTensor(i).NumInBytes();
+            }
+        }
+        return Bytes;
+    };
+    for (int32 i = 0; i < ModelVariantNetworks.Num(); i++) {
+        const UMyNeuralNetwork* NeuralNetwork = ModelVariantNetworks[i];
+        int64 TensorBytes = 0;
+        if (const IInferenceBackend* Backend = NeuralNetwork->GetBackend()) {
+            TensorBytes += Backend->GetInputInfo().Bytes;
+            for (int32 Output = 0; Output < Backend->GetNumOutputs(); Output++) {
+                TensorBytes += Backend->GetOutputInfo(Output).Bytes;
+            }
+        }
+        AddItem(TEXT("Model tensors"), i, TensorBytes);
+        AddItem(TEXT("Model results"), i, GetResultsBytes(NeuralNetwork->BoundingBoxCoordinatesMap, NeuralNetwork->DetectionMasks));
+    }
+    AddItem(TEXT("Gate tensors"), -1, GetTensorBytes(GateNetwork));
+
+    AddItem(TEXT("Published results"), -1, GetResultsBytes(BoundingBoxCoordinatesMap, DetectionMasks));
+    int64 SensorResultBytes = SensorDetections.GetAllocatedSize();
+    for (const FDetectionSnapshot& Snapshot : SensorDetections) {
+        SensorResultBytes += Snapshot.Detections.GetAllocatedSize();
+    }
+    AddItem(TEXT("Sensor results"), -1, SensorResultBytes);
+    int64 AutoTuneBytes = AutoTuneFrames.GetAllocatedSize();
+    for (const TArray<FColor>& Frame : AutoTuneFrames) {
+        AutoTuneBytes += Frame.GetAllocatedSize();
+    }
+    AddItem(TEXT("Auto-tune frames"), -1, AutoTuneBytes);
+    return Total;
+}
+
+void UCaptureManager::PublishTaskResults(AsyncInferenceTask& Task)
+{
+    LLM_SCOPE_BYTAG(DetectionPipeline_Results);
+    if (!Task.HasResults()) {
+        return;
+    }
+    if (Task.IsAtlas()) {
+        PublishAtlasResults(Task);
+        return;
+    }
+    // the overlay reads the published statics on the game thread, they are only ever replaced here
+    check(IsInGameThread());
+    const int64 FrameId = Task.GetFrameId();
+    BoundingBoxCoordinatesMap = MoveTemp(Task.GetResults());
+    DetectionMasks = MoveTemp(Task.GetResultMasks());
+    PublishedFrameId = FrameId;
+    PublishedCaptureView = Task.GetCaptureView();
+
+    const bool bHasWaiters = PendingDetections.ContainsByPredicate([FrameId](const FPendingDetection& Pending) {
+        return Pending.FrameId >= 0 && Pending.FrameId <= FrameId;
+        });
+    if (!bHasWaiters && !OnDetectionsReady.IsBound()) {
+        return;
+    }
+
+    FDetectionSnapshot Snapshot;
+    Snapshot.FrameId = FrameId;
+    const FModelImageProperties ModelImage = Task.GetModelImage();
+    const float ScaleX = 1.f / FMath::Max(ModelImage.width, 1);
+    const float ScaleY = 1.f / FMath::Max(ModelImage.height, 1);
+    for (const auto& Pair : BoundingBoxCoordinatesMap) {
+        for (const UMyNeuralNetwork::FBoxCoordinates& Box : Pair.Value) {
+            Snapshot.Detections.Add(MakeDetectionHit(Pair.Key, Box, ScaleX, ScaleY));
+        }
+    }
+
+    CompleteDetections(Snapshot);
+}
+
+void UCaptureManager::PublishAtlasResults(AsyncInferenceTask& Task)
+{
+    // the overlay and the statics keep showing ColorCaptureComponents
+    const int64 FrameId = Task.GetFrameId();
+    const TArray<FCaptureView>& Views = Task.GetAtlasViews();
+    const TArray<FBoxCoordinatesMap>& TileResults = Task.GetTileResults();
+    const FModelImageProperties ModelImage = Task.GetModelImage();
+    const float ScaleX = 1.f / FMath::Max(ModelImage.width, 1);
+    const float ScaleY = 1.f / FMath::Max(ModelImage.height, 1);
+
+    FDetectionSnapshot Combined;
+    Combined.FrameId = FrameId;
+    SensorDetections.SetNum(TileResults.Num());
+    for (int32 Sensor = 0; Sensor < TileResults.Num(); Sensor++) {
+        if (!Views[Sensor].IsValid()) {
+            continue; // not captured, keeps its last detections
+        }
+        FDetectionSnapshot& Snapshot = SensorDetections[Sensor];
+        Snapshot.FrameId = FrameId;
+        Snapshot.Detections.Reset();
+        for (const auto& Pair : TileResults[Sensor]) {
+            for (const UMyNeuralNetwork::FBoxCoordinates& Box : Pair.Value) {
+                FDetectionHit& Hit = Snapshot.Detections.Add_GetRef(MakeDetectionHit(Pair.Key, Box, ScaleX, ScaleY));
+                Hit.SensorIndex = Sensor;
+            }
+        }
+        Combined.Detections.Append(Snapshot.Detections);
+        OnSensorDetectionsReady.Broadcast(Sensor, Snapshot);
+    }
+    CompleteDetections(Combined);
+}
+
+void UCaptureManager::CompleteDetections(const FDetectionSnapshot& Snapshot)
+{
+    // a request is answered by its frame or, if that frame never made it, by the next one
+    for (int32 i = PendingDetections.Num() - 1; i >= 0; i--) {
+        if (PendingDetections[i].FrameId >= 0 && PendingDetections[i].FrameId <= Snapshot.FrameId) {
+            PendingDetections[i].Promise.SetValue(Snapshot);
+            PendingDetections.RemoveAt(i);
+        }
+    }
+    OnDetectionsReady.Broadcast(Snapshot);
+}
+
+FDetectionSnapshot UCaptureManager::GetSensorDetections(int32 SensorIndex) const
+{
+    return SensorDetections.IsValidIndex(SensorIndex) ? SensorDetections[SensorIndex] : FDetectionSnapshot();
+}
+
+TFuture<FDetectionSnapshot> UCaptureManager::DetectAsync()
+{
+    check(IsInGameThread());
+    FPendingDetection& Pending = PendingDetections.AddDefaulted_GetRef();
+    return Pending.Promise.GetFuture();
+}
+
+namespace {
+    // completes a DetectOnce node once its future is ready
+    class FDetectOnceAction : public FPendingLatentAction {
+    public:
+        FDetectOnceAction(const FLatentActionInfo& LatentInfo, TFuture<FDetectionSnapshot>&& InFuture, FDetectionSnapshot& InSnapshot)
+            : Future(MoveTemp(InFuture)), Snapshot(InSnapshot), ExecutionFunction(LatentInfo.ExecutionFunction),
+            OutputLink(LatentInfo.Linkage), CallbackTarget(LatentInfo.CallbackTarget) {}
+
+        virtual void UpdateOperation(FLatentResponse& Response) override {
+            if (Future.IsReady()) {
+                Snapshot = Future.Get();
+                Response.FinishAndTriggerIf(true, ExecutionFunction, OutputLink, CallbackTarget);
+            }
+        }
+
+    private:
+        TFuture<FDetectionSnapshot> Future;
+        FDetectionSnapshot& Snapshot;
+        FName ExecutionFunction;
+        int32 OutputLink;
+        FWeakObjectPtr CallbackTarget;
+    };
+}
+
+void UCaptureManager::DetectOnce(FLatentActionInfo LatentInfo, FDetectionSnapshot& Snapshot)
+{
+    UWorld* World = GetWorld();
+    if (World == nullptr) {
+        return;
+    }
+    FLatentActionManager& LatentActionManager = World->GetLatentActionManager();
+    if (LatentActionManager.FindExistingAction<FDetectOnceAction>(LatentInfo.CallbackTarget, LatentInfo.UUID) == nullptr) {
+        LatentActionManager.AddNewAction(LatentInfo.CallbackTarget, LatentInfo.UUID, new FDetectOnceAction(LatentInfo, DetectAsync(), Snapshot));
+    }
+}
+
+void UCaptureManager::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+    if (MainViewExtension.IsValid()) {
+        MainViewExtension->SetEnabled(false);
+        MainViewExtension->SetTarget(nullptr);
+        MainViewExtension.Reset();
+    }
+
+    // nobody is going to answer these anymore
+    for (FPendingDetection& Pending : PendingDetections) {
+        Pending.Promise.SetValue(FDetectionSnapshot());
+    }
+    PendingDetections.Reset();
+
+    // release everything still in flight, so the stage counters go back to zero
+    if (CurrentInferenceTask != nullptr) {
+        CurrentInferenceTask->EnsureCompletion();
+        delete CurrentInferenceTask;
+        CurrentInferenceTask = nullptr;
+    }
+    FAsyncTask<AsyncInferenceTask>* queuedTask = nullptr;
+    while (InferenceTaskQueue.Dequeue(queuedTask)) {
+        delete queuedTask;
+    }
+    FRenderRequest* renderRequest = nullptr;
+    while (RenderRequestQueue.Dequeue(renderRequest)) {
+        // the render command may still be writing into the request
+        renderRequest->RenderFence.Wait();
+        FPipelineMemory::Remove(EPipelineMemoryStage::Readback, renderRequest->TrackedBytes);
+        delete renderRequest;
+    }
+    ReleaseDepthStaging();
+    Super::EndPlay(EndPlayReason);
 }
 
 // create function for run inference task. call this when get the frame
 void UCaptureManager::RunAsyncInferenceTask(const TArray<FColor>& RawImage, const FScreenImageProperties _ScreenImage, const FModelImageProperties _ModelImage, 
     UMyNeuralNetwork* MyNeuralNetwork) {
-    (new FAutoDeleteAsyncTask<AsyncInferenceTask>(RawImage, _ScreenImage, _ModelImage, MyNeuralNetwork))->StartBackgroundTask();
+    (new FAutoDeleteAsyncTask<AsyncInferenceTask>(RawImage, _ScreenImage, _ModelImage, MyNeuralNetwork))->StartBackgroundTask(FInferenceThreadPool::Get().GetPool().Get());
 }
 
 // initialize image
 AsyncInferenceTask::AsyncInferenceTask(const TArray<FColor>& RawImage, const FScreenImageProperties ScreenImage,
-    const FModelImageProperties ModelImage, UMyNeuralNetwork* MyNeuralNetwork) {
+    const FModelImageProperties ModelImage, UMyNeuralNetwork* MyNeuralNetwork, int64 FrameId, uint64 CaptureTimestampNs) {
     this->RawImageCopy = RawImage;
     this->ScreenImage = ScreenImage;
     this->ModelImage = ModelImage;
     this->MyNeuralNetwork = MyNeuralNetwork;
+    this->FrameId = FrameId;
+    this->CaptureTimestampNs = CaptureTimestampNs;
+    this->QueuedCycles = FPlatformTime::Cycles64();
+    FPipelineMemory::Add(TrackedStage, 0); // one more frame, its bytes follow through Track
+    Track(RawImageCopy.GetAllocatedSize());
 }
 
 AsyncInferenceTask::~AsyncInferenceTask() {
     //UE_LOG(LogTemp, Warning, TEXT("AsyncTaskDone inference"));
+    FPipelineMemory::Remove(TrackedStage, TrackedBytes);
 }
 
 // do inference
 void AsyncInferenceTask::DoWork() {
     //log do work
     //UE_LOG(LogTemp, Warning, TEXT("AsyncTaskDoWork inference"));
+    if (MyNeuralNetwork == nullptr) {
+        UE_LOG(LogTemp, Warning, TEXT("MyNeuralNetwork is null"));
+        return;
+    }
+    FInferenceThreadPool::Get().EnterPoolThread();
+    LLM_SCOPE_BYTAG(DetectionPipeline_Preprocess);
+    FPipelineMemory::Move(TrackedStage, EPipelineMemoryStage::Inference, TrackedBytes);
+    TrackedStage = EPipelineMemoryStage::Inference;
+    const double StartSeconds = FPlatformTime::Seconds();
+    ON_SCOPE_EXIT{ ElapsedSeconds = FPlatformTime::Seconds() - StartSeconds; };
+    FFrameTrace::AddSlice(TEXT("QueueWait"), FrameId, QueuedCycles, FPlatformTime::Cycles64(), EFrameTraceFlow::None, EFrameTraceTrack::QueueWait);
+    FScopedFrameTrace Trace(TEXT("Inference"), FrameId, EFrameTraceFlow::Step);
 
-    //convert image to uint8
-    TArray<uint8> InputImageCPU;
-    ArrayFColorToUint8(RawImageCopy, InputImageCPU, ScreenImage.width, ScreenImage.height);
+    if (IsAtlas()) {
+        RunAtlas();
+        return;
+    }
 
-    //declare model input image
-    TArray<float> ModelInputImage;
+    if (Gate != nullptr && !Gate->ShouldRunDetection(RawImageCopy, ScreenImage.width, ScreenImage.height, FrameId)) {
+        bRanDetection = false;
+        MyNeuralNetwork->PublishEmpty(FrameId);
+        PublishDetections();
+        return;
+    }
 
-    //resize image to match model
-    ResizeScreenImageToMatchModel(ModelInputImage, InputImageCPU, ModelImage, ScreenImage);
+    // the render target is normally created at the model size, in which case the pixels can go straight into the input tensor
+    const bool bNeedsResize = ScreenImage.width != ModelImage.width || ScreenImage.height != ModelImage.height;
 
     //declare model output image
     TArray<uint8> ModelOutputImage;
 
-    //run inference
-    RunModel(ModelInputImage, ModelOutputImage);
+    if (MyNeuralNetwork->InputFormat == EModelInputFormat::Float32NCHW) {
+        //declare model input image
+        TArray<float> ModelInputImage;
+        FScopedPipelineMemory InputMemory(EPipelineMemoryStage::Scratch, static_cast<int64>(ModelImage.width) * ModelImage.height * 3 * sizeof(float));
+        {
+            FScopedFrameTrace PreprocessTrace(TEXT("Preprocess"), FrameId);
+            if (bNeedsResize) {
+                //convert image to uint8
+                FScopedPipelineMemory ConvertMemory(EPipelineMemoryStage::Scratch, static_cast<int64>(ScreenImage.width) * ScreenImage.height * 3);
+                TArray<uint8> InputImageCPU;
+                ArrayFColorToUint8(RawImageCopy, InputImageCPU, ScreenImage.width, ScreenImage.height);
+
+                //resize image to match model
+                ResizeScreenImageToMatchModel(ModelInputImage, InputImageCPU, ModelImage, ScreenImage);
+            } else if (MyNeuralNetwork->Kernels != nullptr && MyNeuralNetwork->Kernels->FitsImage(ModelImage.width, ModelImage.height)
+                && RawImageCopy.Num() == ModelImage.width * ModelImage.height) {
+                // kernel selected for this model geometry when the network was set, only while the frame really has that size
+                ModelInputImage.SetNumUninitialized(ModelImage.width * ModelImage.height * 3);
+                MyNeuralNetwork->Kernels->PreprocessFloat(RawImageCopy.GetData(), ModelInputImage.GetData(), ModelImage.width, ModelImage.height);
+            } else {
+                ArrayFColorToPlanar<float>(RawImageCopy, ModelInputImage, 1.f / 255);
+            }
+        }
+
+        //run inference
+        if (!RunModel(ModelInputImage, ModelOutputImage)) {
+            OnModelFailed();
+        }
+        PublishDetections();
+        return;
+    }
+
+    // uint8 models: no float conversion at all, the model normalizes internally
+    const bool bPlanar = MyNeuralNetwork->InputFormat == EModelInputFormat::UInt8NCHW;
+    TArray<uint8> ModelInputImage;
+    FScopedPipelineMemory InputMemory(EPipelineMemoryStage::Scratch, static_cast<int64>(ModelImage.width) * ModelImage.height * 3);
+    {
+        FScopedFrameTrace PreprocessTrace(TEXT("Preprocess"), FrameId);
+        if (bNeedsResize) {
+            // screen size bytes plus the resized copy
+            FScopedPipelineMemory ConvertMemory(EPipelineMemoryStage::Scratch,
+                static_cast<int64>(ScreenImage.width) * ScreenImage.height * 3 + static_cast<int64>(ModelImage.width) * ModelImage.height * 3);
+            TArray<uint8> InputImageCPU;
+            ArrayFColorToUint8(RawImageCopy, InputImageCPU, ScreenImage.width, ScreenImage.height);
+            TArray<uint8> ResizedImage;
+            ResizeScreenImageToMatchModel(ResizedImage, InputImageCPU, ModelImage, ScreenImage);
+            if (bPlanar) {
+                Uint8InterleavedToPlanar(ResizedImage, ModelInputImage);
+            } else {
+                ModelInputImage = MoveTemp(ResizedImage);
+            }
+        } else if (bPlanar) {
+            ArrayFColorToPlanar<uint8>(RawImageCopy, ModelInputImage, 1);
+        } else {
+            ArrayFColorToUint8(RawImageCopy, ModelInputImage, ScreenImage.width, ScreenImage.height);
+        }
+    }
+
+    if (!RunModel(ModelInputImage, ModelOutputImage)) {
+        OnModelFailed();
+    }
+    PublishDetections();
+}
+
+void AsyncInferenceTask::OnModelFailed() {
+    bRanDetection = false;
+    if (bPublish) {
+        MyNeuralNetwork->PublishEmpty(FrameId);
+    }
+}
+
+void AsyncInferenceTask::PublishDetections() {
+    LLM_SCOPE_BYTAG(DetectionPipeline_Results);
+    Results = MyNeuralNetwork->BoundingBoxCoordinatesMap;
+    ResultMasks = MyNeuralNetwork->DetectionMasks;
+    bHasResults = true;
+    Track(GetResultsBytes(Results, ResultMasks));
+    if (!bPublish) {
+        return;
+    }
+    if (Gate != nullptr && bRanDetection) {
+        Gate->NotifyDetectionResult(MyNeuralNetwork->BoundingBoxCoordinatesMap.Num() > 0);
+    }
+    // the boxes are in model image pixels, the frame goes out at capture size
+    FDetectionStreamWriter::Get().Publish(FrameId, CaptureTimestampNs, MyNeuralNetwork->BoundingBoxCoordinatesMap,
+        RawImageCopy.Num() == ScreenImage.width * ScreenImage.height ? RawImageCopy.GetData() : nullptr, ScreenImage.width, ScreenImage.height);
+    FDetectionLogWriter::Get().Append(FrameId, CaptureTimestampNs, MyNeuralNetwork->BoundingBoxCoordinatesMap);
+}
+
+void AsyncInferenceTask::RunAtlas() {
+    const int64 ItemBytes = MyNeuralNetwork->ItemInputBytes;
+    const int64 ElementBytes = MyNeuralNetwork->InputFormat == EModelInputFormat::Float32NCHW ? sizeof(float) : 1;
+    if (AtlasTileSize.X != ModelImage.width || AtlasTileSize.Y != ModelImage.height
+        || ItemBytes != static_cast<int64>(AtlasTileSize.X) * AtlasTileSize.Y * 3 * ElementBytes) {
+        // the model variant switched after the capture, the atlas is set up again for the next one
+        UE_LOG(LogTemp, Warning, TEXT("Atlas tiles of %dx%d do not fit the model, frame skipped"), AtlasTileSize.X, AtlasTileSize.Y);
+        bRanDetection = false;
+        return;
+    }
+
+    const int32 NumTiles = AtlasViews.Num();
+    const int32 BatchSize = MyNeuralNetwork->BatchSize;
+    TileResults.SetNum(NumTiles);
+    TArray<uint8> BatchInput;
+    FScopedPipelineMemory InputMemory(EPipelineMemoryStage::Scratch, ItemBytes * FMath::Min(BatchSize, NumTiles));
+    TArray<FBoxCoordinatesMap> BatchResults;
+    for (int32 First = 0; First < NumTiles; First += BatchSize) {
+        const int32 Count = FMath::Min(BatchSize, NumTiles - First);
+        BatchInput.SetNumUninitialized(ItemBytes * Count);
+        {
+            FScopedFrameTrace PreprocessTrace(TEXT("Preprocess"), FrameId);
+            for (int32 i = 0; i < Count; i++) {
+                const int32 Tile = First + i;
+                const FColor* TileStart = RawImageCopy.GetData()
+                    + static_cast<int64>(Tile / AtlasColumns) * AtlasTileSize.Y * ScreenImage.width + (Tile % AtlasColumns) * AtlasTileSize.X;
+                PreprocessTile(TileStart, ScreenImage.width, AtlasTileSize.X, AtlasTileSize.Y, MyNeuralNetwork->InputFormat,
+                    BatchInput.GetData() + i * ItemBytes);
+            }
+        }
+        if (!MyNeuralNetwork->URunModelBatch(BatchInput.GetData(), BatchInput.Num(), Count, FrameId, BatchResults)) {
+            bRanDetection = false;
+            return;
+        }
+        for (int32 i = 0; i < Count; i++) {
+            TileResults[First + i] = MoveTemp(BatchResults[i]);
+        }
+    }
+
+    bHasResults = true;
+    int64 ResultBytes = TileResults.GetAllocatedSize();
+    for (const FBoxCoordinatesMap& Boxes : TileResults) {
+        ResultBytes += GetResultsBytes(Boxes, ResultMasks);
+    }
+    Track(ResultBytes);
+}
+
+void AsyncInferenceTask::ResizeScreenImageToMatchModel(TArray<uint8>& ModelInputImage, TArray<uint8>& InputImageCPU,
+    FModelImageProperties modelImage, FScreenImageProperties screenImage)
+{
+    cv::Mat inputImage(screenImage.height, screenImage.width, CV_8UC3, InputImageCPU.GetData());
+
+    // resize directly into the output array, interleaved rgb
+    ModelInputImage.SetNumUninitialized(modelImage.height * modelImage.width * 3);
+    cv::Mat outputImage(modelImage.height, modelImage.width, CV_8UC3, ModelInputImage.GetData());
+    cv::resize(inputImage, outputImage, cv::Size(modelImage.width, modelImage.height));
 }
 
 void AsyncInferenceTask::ResizeScreenImageToMatchModel(TArray<float>& ModelInputImage, TArray<uint8>& InputImageCPU,
@@ -359,6 +1706,10 @@ void AsyncInferenceTask::ResizeScreenImageToMatchModel(TArray<float>& ModelInput
     cv::Mat inputImage(screenImage.height, screenImage.width, CV_8UC3, InputImageCPU.GetData());
 
 
+    // resized mat plus its float copy
+    const int64 modelPixels = static_cast<int64>(modelImage.width) * modelImage.height;
+    FScopedPipelineMemory ResizeMemory(EPipelineMemoryStage::Scratch, modelPixels * 3 + modelPixels * 3 * sizeof(float));
+
     // Create image to resize for inferencing
     cv::Mat outputImage(modelImage.height, modelImage.width, CV_8UC3);
 
@@ -382,28 +1733,91 @@ void AsyncInferenceTask::ResizeScreenImageToMatchModel(TArray<float>& ModelInput
 
     //ModelInputImage stores in 3 chunks, one for each channel (RGB), each chunk is blockSize
     for (size_t ch = 0; ch < 3; ++ch) {
-        //this runs blockSize times, each run at the same time
-        ParallelFor(blockSize, [&](int32 Idx) {
-            //vec stores values in blockSize chunks, each chunk is a pixel (RGB). This gets the ch value for the current pixel
-            const int i = (Idx * 3) + ch;
+        //this runs blockSize times, split in ranges that run at the same time
+        PipelineParallelFor(blockSize, [&](int32 Begin, int32 End) {
+            for (int32 Idx = Begin; Idx < End; Idx++) {
+                //vec stores values in blockSize chunks, each chunk is a pixel (RGB). This gets the ch value for the current pixel
+                const int i = (Idx * 3) + ch;
 
-            //this is so we can fill the right channel (each size blockSize). eg fill the first blockSize elements with R values, then next channel 
-            //starts at element with index of blockSize and fills the G values. Then the next channel starts at element with index of blockSize * 2 and 
-            //fills the B values
-            const int stride = ch * blockSize;
+                //this is so we can fill the right channel (each size blockSize). eg fill the first blockSize elements with R values, then next channel 
+                //starts at element with index of blockSize and fills the G values. Then the next channel starts at element with index of blockSize * 2 and 
+                //fills the B values
+                const int stride = ch * blockSize;
 
-            ModelInputImage[Idx + stride] = vec[i];
+                ModelInputImage[Idx + stride] = vec[i];
+            }
             });
     }
 }
 
-void AsyncInferenceTask::RunModel(TArray<float>& ModelInputImage, TArray<uint8>& ModelOutputImage) {
+bool AsyncInferenceTask::RunModel(TArray<float>& ModelInputImage, TArray<uint8>& ModelOutputImage) {
+    LLM_SCOPE_BYTAG(DetectionPipeline_Inference);
     // check(MyNeuralNetwork);
     if(MyNeuralNetwork == nullptr)
     {
         UE_LOG(LogTemp, Warning, TEXT("MyNeuralNetwork is null"));
-        return;
+        return false;
     }
     ModelOutputImage.Reset();
-    MyNeuralNetwork->URunModel(ModelInputImage, ModelOutputImage);
-}
\ No newline at end of file
+    return MyNeuralNetwork->URunModel(ModelInputImage, ModelOutputImage, FrameId, Depth.IsValid() ? &Depth : nullptr, bDecodeMasks, bPublish);
+}
+
+bool AsyncInferenceTask::RunModel(TArray<uint8>& ModelInputImage, TArray<uint8>& ModelOutputImage) {
+    LLM_SCOPE_BYTAG(DetectionPipeline_Inference);
+    if(MyNeuralNetwork == nullptr)
+    {
+        UE_LOG(LogTemp, Warning, TEXT("MyNeuralNetwork is null"));
+        return false;
+    }
+    ModelOutputImage.Reset();
+    return MyNeuralNetwork->URunModel(ModelInputImage, ModelOutputImage, FrameId, Depth.IsValid() ? &Depth : nullptr, bDecodeMasks, bPublish);
+}
+
+static FAutoConsoleCommandWithWorldAndArgs GateStatsCommand(
+    TEXT("nn.Gate.Stats"),
+    TEXT("Print the cascade gate statistics of every capture manager. Argument reset clears them."),
+    FConsoleCommandWithWorldArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World) {
+        for (TObjectIterator<UCaptureManager> It; It; ++It) {
+            if (It->GetWorld() != World) {
+                continue;
+            }
+            const FCascadeGateStats Stats = It->GetGateStats();
+            const int32 Frames = Stats.Evaluated + Stats.Bypassed;
+            UE_LOG(LogTemp, Log, TEXT("Cascade gate %s: %d frames, %d bypassed, %d evaluated (%d fired, %d skipped, %.0f%% of frames skipped), %.2f ms per gate"),
+                *It->GetName(), Frames, Stats.Bypassed, Stats.Evaluated, Stats.Fired, Stats.Skipped,
+                Frames > 0 ? 100.f * Stats.Skipped / Frames : 0.f, Stats.AverageGateMs);
+            if (Args.Num() > 0 && Args[0] == TEXT("reset")) {
+                It->ResetGateStats();
+            }
+        }
+    }));
+
+static FAutoConsoleCommandWithWorld AutoTuneCommand(
+    TEXT("nn.AutoTune"),
+    TEXT("Re-run the detection pipeline auto-tuner on recorded frames and save the result for this machine."),
+    FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* World) {
+        for (TObjectIterator<UCaptureManager> It; It; ++It) {
+            if (It->GetWorld() == World) {
+                It->StartAutoTune();
+            }
+        }
+        }));
+
+static FAutoConsoleCommandWithWorld MemoryDumpCommand(
+    TEXT("nn.Memory.Dump"),
+    TEXT("Print the memory held by the detection pipeline: frames and bytes per stage, then the resident buffers of every capture manager."),
+    FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* World) {
+        UE_LOG(LogTemp, Log, TEXT("Detection pipeline in flight: %.2f MB"), FPipelineMemory::GetTotalBytes() / (1024.0 * 1024.0));
+        FPipelineMemory::LogStages();
+        for (TObjectIterator<UCaptureManager> It; It; ++It) {
+            if (It->GetWorld() != World) {
+                continue;
+            }
+            TArray<TPair<FString, int64>> Breakdown;
+            const int64 ResidentBytes = It->GetResidentMemory(&Breakdown);
+            UE_LOG(LogTemp, Log, TEXT("%s resident: %.2f MB"), *It->GetName(), ResidentBytes / (1024.0 * 1024.0));
+            for (const TPair<FString, int64>& Item : Breakdown) {
+                UE_LOG(LogTemp, Log, TEXT("  %-24s %8.2f MB"), *Item.Key, Item.Value / (1024.0 * 1024.0));
+            }
+        }
+        }));
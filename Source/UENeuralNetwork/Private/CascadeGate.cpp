@@ -0,0 +1,142 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "CascadeGate.h"
+
+#include "HAL/IConsoleManager.h"
+#include "FrameTrace.h"
+
+static TAutoConsoleVariable<int32> CVarNNGateEnable(
+    TEXT("nn.Gate.Enable"), 1,
+    TEXT("Ask the cascade gate classifier (UCaptureManager::GateModel) before running detection."),
+    ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarNNGateThreshold(
+    TEXT("nn.Gate.Threshold"), 0.25f,
+    TEXT("Gate score at or above which a frame goes through detection."),
+    ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarNNGateRefreshFrames(
+    TEXT("nn.Gate.RefreshFrames"), 10,
+    TEXT("Run detection at least every this many captured frames, whatever the gate says."),
+    ECVF_Default);
+
+void FCascadeGate::SetNetwork(UNeuralNetwork* InNetwork) {
+    Network = InNetwork;
+    InputWidth = 0;
+    InputHeight = 0;
+    if (Network == nullptr || !Network->IsLoaded()) {
+        Network = nullptr;
+        return;
+    }
+    // same input conventions as the detector (see UMyNeuralNetwork::ConfigureFromModel)
+    const FNeuralTensor& InputTensor = Network->GetInputTensor();
+    const TArray<int64>& Sizes = InputTensor.GetSizes();
+    if (Sizes.Num() != 4) {
+        UE_LOG(LogTemp, Error, TEXT("Cascade gate: expected a {1, 3, h, w} input"));
+        Network = nullptr;
+        return;
+    }
+    bUInt8Input = InputTensor.NumInBytes() == InputTensor.Num();
+    bInterleavedInput = Sizes[3] == 3 && Sizes[1] != 3;
+    InputHeight = static_cast<int32>(bInterleavedInput ? Sizes[1] : Sizes[2]);
+    InputWidth = static_cast<int32>(bInterleavedInput ? Sizes[2] : Sizes[3]);
+    ResetStats();
+    UE_LOG(LogTemp, Log, TEXT("Cascade gate: %dx%d %s input"), InputWidth, InputHeight, bUInt8Input ? TEXT("uint8") : TEXT("float"));
+}
+
+bool FCascadeGate::IsActive() const {
+    return Network != nullptr && CVarNNGateEnable.GetValueOnAnyThread() != 0;
+}
+
+bool FCascadeGate::ShouldRunDetection(const TArray<FColor>& Frame, int32 Width, int32 Height, int64 FrameId) {
+    if (!IsActive() || Frame.Num() != Width * Height) {
+        return true;
+    }
+    // keep detecting while something is in view, and refresh now and then in case the gate missed it
+    if (bLastDetectionFoundObjects || ++FramesSinceDetection >= FMath::Max(CVarNNGateRefreshFrames.GetValueOnAnyThread(), 1)) {
+        Bypassed++;
+        FramesSinceDetection = 0;
+        return true;
+    }
+
+    FScopedFrameTrace Trace(TEXT("Gate"), FrameId);
+    const uint64 StartCycles = FPlatformTime::Cycles64();
+    const float Score = RunClassifier(Frame, Width, Height);
+    GateCycles += FPlatformTime::Cycles64() - StartCycles;
+    Evaluated++;
+
+    if (Score >= CVarNNGateThreshold.GetValueOnAnyThread()) {
+        Fired++;
+        FramesSinceDetection = 0;
+        return true;
+    }
+    Skipped++;
+    return false;
+}
+
+void FCascadeGate::NotifyDetectionResult(bool bFoundObjects) {
+    bLastDetectionFoundObjects = bFoundObjects;
+}
+
+float FCascadeGate::RunClassifier(const TArray<FColor>& Frame, int32 Width, int32 Height) {
+    // nearest sampling, the gate input is tiny and only has to tell empty from not empty
+    const int32 PlaneSize = InputWidth * InputHeight;
+    if (bUInt8Input) {
+        InputBytes.SetNumUninitialized(PlaneSize * 3);
+    } else {
+        InputFloat.SetNumUninitialized(PlaneSize * 3);
+    }
+    for (int32 Y = 0; Y < InputHeight; Y++) {
+        const FColor* SrcRow = Frame.GetData() + ((Y * Height) / InputHeight) * Width;
+        for (int32 X = 0; X < InputWidth; X++) {
+            const FColor& Pixel = SrcRow[(X * Width) / InputWidth];
+            const int32 Index = Y * InputWidth + X;
+            if (bUInt8Input && bInterleavedInput) {
+                InputBytes[Index * 3] = Pixel.R;
+                InputBytes[Index * 3 + 1] = Pixel.G;
+                InputBytes[Index * 3 + 2] = Pixel.B;
+            } else if (bUInt8Input) {
+                InputBytes[Index] = Pixel.R;
+                InputBytes[PlaneSize + Index] = Pixel.G;
+                InputBytes[PlaneSize * 2 + Index] = Pixel.B;
+            } else {
+                InputFloat[Index] = Pixel.R * (1.f / 255);
+                InputFloat[PlaneSize + Index] = Pixel.G * (1.f / 255);
+                InputFloat[PlaneSize * 2 + Index] = Pixel.B * (1.f / 255);
+            }
+        }
+    }
+
+    if (bUInt8Input) {
+        Network->SetInputFromVoidPointerCopy(InputBytes.GetData());
+    } else {
+        Network->SetInputFromArrayCopy(InputFloat);
+    }
+    Network->Run();
+
+    // single "objects of interest" score or per class scores, either way the max decides
+    const TArray<float> Output = Network->GetOutputTensor().GetArrayCopy<float>();
+    float Score = 0.f;
+    for (const float Value : Output) {
+        Score = FMath::Max(Score, Value);
+    }
+    return Score;
+}
+
+FCascadeGateStats FCascadeGate::GetStats() const {
+    FCascadeGateStats Stats;
+    Stats.Evaluated = Evaluated;
+    Stats.Fired = Fired;
+    Stats.Skipped = Skipped;
+    Stats.Bypassed = Bypassed;
+    Stats.AverageGateMs = Stats.Evaluated > 0 ? static_cast<float>(FPlatformTime::ToMilliseconds64(GateCycles) / Stats.Evaluated) : 0.f;
+    return Stats;
+}
+
+void FCascadeGate::ResetStats() {
+    Evaluated = 0;
+    Fired = 0;
+    Skipped = 0;
+    Bypassed = 0;
+    GateCycles = 0;
+}
@@ -0,0 +1,94 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DetectionClassFilter.h"
+
+#include "HAL/IConsoleManager.h"
+#include "Misc/ScopeLock.h"
+#include "DetectionLabels.h"
+
+static TAutoConsoleVariable<FString> CVarNNClasses(
+    TEXT("nn.Classes"), TEXT(""),
+    TEXT("Classes to detect, \"label_or_index[:threshold], ...\" (e.g. \"person:0.5, car, 7\"). Only these rows of the model output are read.\n")
+    TEXT("Without a threshold nn.ConfidenceThreshold applies. Empty detects every class."),
+    ECVF_Default);
+
+FDetectionClassFilter& FDetectionClassFilter::Get() {
+    static FDetectionClassFilter Instance;
+    return Instance;
+}
+
+FDetectionClassFilter::FSelection FDetectionClassFilter::GetSelection() const {
+    FScopeLock ScopeLock(&Lock);
+    return Selection;
+}
+
+void FDetectionClassFilter::Update() {
+    const FString Spec = CVarNNClasses.GetValueOnGameThread();
+    const uint32 LabelGeneration = FDetectionLabels::Get().GetGeneration();
+    if (Spec == ParsedSpec && LabelGeneration == ParsedLabelGeneration) {
+        return;
+    }
+    ParsedSpec = Spec;
+    ParsedLabelGeneration = LabelGeneration;
+
+    TArray<FDetectionClassThreshold> Classes;
+    FString Error;
+    if (!Parse(Spec, Classes, Error)) {
+        // keep decoding what was selected before rather than everything
+        UE_LOG(LogTemp, Error, TEXT("nn.Classes: %s"), *Error);
+        return;
+    }
+    FSelection NewSelection;
+    if (Classes.Num() > 0) {
+        NewSelection = MakeShared<const TArray<FDetectionClassThreshold>, ESPMode::ThreadSafe>(MoveTemp(Classes));
+        UE_LOG(LogTemp, Log, TEXT("nn.Classes: decoding %d classes"), NewSelection->Num());
+    }
+    FScopeLock ScopeLock(&Lock);
+    Selection = MoveTemp(NewSelection);
+}
+
+bool FDetectionClassFilter::Parse(const FString& Spec, TArray<FDetectionClassThreshold>& OutClasses, FString& OutError) {
+    OutClasses.Reset();
+    TArray<FString> Entries;
+    Spec.ParseIntoArray(Entries, TEXT(","), true);
+    const FDetectionLabels& Labels = FDetectionLabels::Get();
+    for (const FString& RawEntry : Entries) {
+        FString Name = RawEntry.TrimStartAndEnd();
+        if (Name.IsEmpty()) {
+            continue;
+        }
+
+        FDetectionClassThreshold Entry;
+        int32 Colon = INDEX_NONE;
+        if (Name.FindLastChar(TEXT(':'), Colon)) {
+            const FString Threshold = Name.Mid(Colon + 1).TrimStartAndEnd();
+            Entry.Threshold = FCString::Atof(*Threshold);
+            if (!Threshold.IsNumeric() || Entry.Threshold <= 0.f || Entry.Threshold > 1.f) {
+                OutError = FString::Printf(TEXT("threshold of \"%s\" is not in (0, 1]"), *Name);
+                return false;
+            }
+            Name = Name.Left(Colon).TrimStartAndEnd();
+        }
+
+        Entry.ClassIndex = INDEX_NONE;
+        for (int32 ClassIndex = 0; ClassIndex < Labels.Num(); ClassIndex++) {
+            if (Labels.GetLabel(ClassIndex).ToString().Equals(Name, ESearchCase::IgnoreCase)) {
+                Entry.ClassIndex = ClassIndex;
+                break;
+            }
+        }
+        if (Entry.ClassIndex == INDEX_NONE && Name.IsNumeric()) {
+            Entry.ClassIndex = FCString::Atoi(*Name);
+        }
+        if (Entry.ClassIndex < 0) {
+            OutError = FString::Printf(TEXT("\"%s\" is neither a label nor a class index"), *Name);
+            return false;
+        }
+
+        // a class named twice keeps the last threshold
+        OutClasses.RemoveAll([&Entry](const FDetectionClassThreshold& Other) { return Other.ClassIndex == Entry.ClassIndex; });
+        OutClasses.Add(Entry);
+    }
+    OutClasses.Sort([](const FDetectionClassThreshold& A, const FDetectionClassThreshold& B) { return A.ClassIndex < B.ClassIndex; });
+    return true;
+}
@@ -0,0 +1,208 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DetectionDeprojection.h"
+
+#include "Math/VectorRegister.h"
+
+namespace {
+    // median of five samples inside the box (center and the quarter points), so a pixel of background or a thin
+    // occluder does not decide the depth of the whole box
+    float SampleBoxDepth(const FCaptureDepth& Depth, float X1, float Y1, float Width, float Height) {
+        const float U[5] = { 0.5f, 0.25f, 0.75f, 0.25f, 0.75f };
+        const float V[5] = { 0.5f, 0.25f, 0.25f, 0.75f, 0.75f };
+        float Samples[5];
+        for (int32 i = 0; i < 5; i++) {
+            const int32 X = FMath::Clamp(FMath::FloorToInt(X1 + Width * U[i]), 0, Depth.Width - 1);
+            const int32 Y = FMath::Clamp(FMath::FloorToInt(Y1 + Height * V[i]), 0, Depth.Height - 1);
+            Samples[i] = Depth.Pixels[Y * Depth.Width + X];
+        }
+        for (int32 i = 1; i < 5; i++) {
+            for (int32 j = i; j > 0 && Samples[j - 1] > Samples[j]; j--) {
+                Swap(Samples[j - 1], Samples[j]);
+            }
+        }
+        return Samples[2];
+    }
+}
+
+FMatrix MakeDepthPixelToWorld(const FTransform& CaptureTransform, float FOVDegrees, int32 Width, int32 Height) {
+    // camera space is x forward, y right, z up. pixel (u, v) at depth d is
+    // d * (1, (2u / W - 1) tanX, (1 - 2v / H) tanY) = d * A + d * u * B + d * v * C
+    const float TanX = FMath::Tan(FMath::DegreesToRadians(FOVDegrees * 0.5f));
+    const float TanY = TanX * Height / FMath::Max(Width, 1);
+    const FVector A(1.f, -TanX, TanY);
+    const FVector B(0.f, 2.f * TanX / FMath::Max(Width, 1), 0.f);
+    const FVector C(0.f, 0.f, -2.f * TanY / FMath::Max(Height, 1));
+
+    return FMatrix(
+        FPlane(CaptureTransform.TransformVectorNoScale(A), 0.f),
+        FPlane(CaptureTransform.TransformVectorNoScale(B), 0.f),
+        FPlane(CaptureTransform.TransformVectorNoScale(C), 0.f),
+        FPlane(CaptureTransform.GetLocation(), 1.f));
+}
+
+void DeprojectBoxes(const FCaptureDepth& Depth, int32 ModelWidth, int32 ModelHeight, FBoxCoordinatesMap& Boxes) {
+    if (!Depth.IsValid()) {
+        return;
+    }
+
+    TArray<UMyNeuralNetwork::FBoxCoordinates*, TInlineAllocator<64>> Refs;
+    for (auto& Pair : Boxes) {
+        for (UMyNeuralNetwork::FBoxCoordinates& Box : Pair.Value) {
+            Refs.Add(&Box);
+        }
+    }
+    if (Refs.Num() == 0) {
+        return;
+    }
+
+    // structure of arrays, padded to the vector width: inputs d, d*u, d*v, d*w, d*h and outputs x, y, z, half extents
+    const int32 Num = Refs.Num();
+    const int32 Padded = Align(Num, 4);
+    enum EColumn { D, DU, DV, DW, DH, OutX, OutY, OutZ, OutW, OutH, NumColumns };
+    TArray<float, TInlineAllocator<64 * NumColumns>> Buffer;
+    Buffer.SetNumZeroed(Padded * NumColumns);
+    auto Col = [&](EColumn Column) { return Buffer.GetData() + Column * Padded; };
+
+    // boxes are in model pixels, the depth capture has the size of the color capture
+    const float ScaleX = static_cast<float>(Depth.Width) / ModelWidth;
+    const float ScaleY = static_cast<float>(Depth.Height) / ModelHeight;
+    for (int32 i = 0; i < Num; i++) {
+        const UMyNeuralNetwork::FBoxCoordinates& Box = *Refs[i];
+        const float X1 = Box.x1 * ScaleX;
+        const float Y1 = Box.y1 * ScaleY;
+        const float W = Box.width * ScaleX;
+        const float H = Box.height * ScaleY;
+        const float Z = SampleBoxDepth(Depth, X1, Y1, W, H);
+        Col(D)[i] = Z;
+        Col(DU)[i] = Z * (X1 + W * 0.5f);
+        Col(DV)[i] = Z * (Y1 + H * 0.5f);
+        Col(DW)[i] = Z * W;
+        Col(DH)[i] = Z * H;
+    }
+
+    // offset from the capture = d * M[0] + du * M[1] + dv * M[2], four boxes per iteration. the translation M[3] is added
+    // in double precision afterwards so large world coordinates do not lose precision
+    const FMatrix& M = Depth.PixelToWorld;
+    VectorRegister4Float Row[3][3];
+    for (int32 r = 0; r < 3; r++) {
+        for (int32 c = 0; c < 3; c++) {
+            Row[r][c] = VectorSetFloat1(static_cast<float>(M.M[r][c]));
+        }
+    }
+    // world length of one pixel step along u and v at depth 1, halved for the extent
+    const VectorRegister4Float HalfPixelU = VectorSetFloat1(0.5f * static_cast<float>(FVector(M.M[1][0], M.M[1][1], M.M[1][2]).Size()));
+    const VectorRegister4Float HalfPixelV = VectorSetFloat1(0.5f * static_cast<float>(FVector(M.M[2][0], M.M[2][1], M.M[2][2]).Size()));
+
+    for (int32 i = 0; i < Padded; i += 4) {
+        const VectorRegister4Float VD = VectorLoad(Col(D) + i);
+        const VectorRegister4Float VDU = VectorLoad(Col(DU) + i);
+        const VectorRegister4Float VDV = VectorLoad(Col(DV) + i);
+        for (int32 c = 0; c < 3; c++) {
+            VectorRegister4Float Offset = VectorMultiply(VD, Row[0][c]);
+            Offset = VectorMultiplyAdd(VDU, Row[1][c], Offset);
+            Offset = VectorMultiplyAdd(VDV, Row[2][c], Offset);
+            VectorStore(Offset, Col(static_cast<EColumn>(OutX + c)) + i);
+        }
+        VectorStore(VectorMultiply(VectorLoad(Col(DW) + i), HalfPixelU), Col(OutW) + i);
+        VectorStore(VectorMultiply(VectorLoad(Col(DH) + i), HalfPixelV), Col(OutH) + i);
+    }
+
+    for (int32 i = 0; i < Num; i++) {
+        UMyNeuralNetwork::FBoxCoordinates& Box = *Refs[i];
+        if (Col(D)[i] <= 0.f) {
+            continue;
+        }
+        Box.depth = Col(D)[i];
+        Box.worldLocation = FVector(M.M[3][0] + Col(OutX)[i], M.M[3][1] + Col(OutY)[i], M.M[3][2] + Col(OutZ)[i]);
+        Box.worldExtent = FVector2D(Col(OutW)[i], Col(OutH)[i]);
+    }
+}
+
+void ReprojectBoxes(const FCaptureView& From, const FCaptureView& To, float DefaultDepth,
+    TArrayView<UMyNeuralNetwork::FBoxCoordinates* const> Boxes) {
+    const int32 Num = Boxes.Num();
+    if (Num == 0 || !From.IsValid() || !To.IsValid()) {
+        return;
+    }
+
+    // camera space of From straight into camera space of To. the offset between the origins is taken in double precision
+    // before it drops to float, so large world coordinates do not lose precision
+    const FQuat ToRotationInverse = To.Transform.GetRotation().Inverse();
+    const FQuat Relative = ToRotationInverse * From.Transform.GetRotation();
+    const FVector Offset = ToRotationInverse.RotateVector(From.Transform.GetLocation() - To.Transform.GetLocation());
+
+    // pixel (u, v) at depth d seen from From is d * A + d * u * B + d * v * C (as in MakeDepthPixelToWorld)
+    const float FromTanX = FMath::Tan(FMath::DegreesToRadians(From.FOVDegrees * 0.5f));
+    const float FromTanY = FromTanX * From.Height / From.Width;
+    const FVector A = Relative.RotateVector(FVector(1.f, -FromTanX, FromTanY));
+    const FVector B = Relative.RotateVector(FVector(0.f, 2.f * FromTanX / From.Width, 0.f));
+    const FVector C = Relative.RotateVector(FVector(0.f, 0.f, -2.f * FromTanY / From.Height));
+
+    // and seen from To at (x, y, z) it is u = Cx + F * y / x, v = Cy - F * z / x, with F the focal length in pixels
+    const float ToFocal = To.Width * 0.5f / FMath::Tan(FMath::DegreesToRadians(To.FOVDegrees * 0.5f));
+    const float FromFocal = From.Width * 0.5f / FromTanX;
+
+    const int32 Padded = Align(Num, 4);
+    enum EColumn { D, DU, DV, OutX, OutU, OutV, OutScale, NumColumns };
+    TArray<float, TInlineAllocator<64 * NumColumns>> Buffer;
+    Buffer.SetNumZeroed(Padded * NumColumns);
+    auto Col = [&](EColumn Column) { return Buffer.GetData() + Column * Padded; };
+
+    for (int32 i = 0; i < Num; i++) {
+        const UMyNeuralNetwork::FBoxCoordinates& Box = *Boxes[i];
+        const float Z = Box.depth > 0.f ? Box.depth : DefaultDepth;
+        Col(D)[i] = Z;
+        Col(DU)[i] = Z * (Box.x1 + Box.width * 0.5f);
+        Col(DV)[i] = Z * (Box.y1 + Box.height * 0.5f);
+    }
+
+    VectorRegister4Float Row[3][3];
+    for (int32 c = 0; c < 3; c++) {
+        Row[0][c] = VectorSetFloat1(static_cast<float>(A[c]));
+        Row[1][c] = VectorSetFloat1(static_cast<float>(B[c]));
+        Row[2][c] = VectorSetFloat1(static_cast<float>(C[c]));
+    }
+    const VectorRegister4Float OffsetX = VectorSetFloat1(static_cast<float>(Offset.X));
+    const VectorRegister4Float OffsetY = VectorSetFloat1(static_cast<float>(Offset.Y));
+    const VectorRegister4Float OffsetZ = VectorSetFloat1(static_cast<float>(Offset.Z));
+    const VectorRegister4Float Focal = VectorSetFloat1(ToFocal);
+    const VectorRegister4Float CenterU = VectorSetFloat1(To.Width * 0.5f);
+    const VectorRegister4Float CenterV = VectorSetFloat1(To.Height * 0.5f);
+    // a box at depth d that ends up at depth x is scaled by d / x, plus the change in focal length
+    const VectorRegister4Float FocalRatio = VectorSetFloat1(ToFocal / FromFocal);
+
+    for (int32 i = 0; i < Padded; i += 4) {
+        const VectorRegister4Float VD = VectorLoad(Col(D) + i);
+        const VectorRegister4Float VDU = VectorLoad(Col(DU) + i);
+        const VectorRegister4Float VDV = VectorLoad(Col(DV) + i);
+        VectorRegister4Float Local[3];
+        for (int32 c = 0; c < 3; c++) {
+            Local[c] = VectorMultiply(VD, Row[0][c]);
+            Local[c] = VectorMultiplyAdd(VDU, Row[1][c], Local[c]);
+            Local[c] = VectorMultiplyAdd(VDV, Row[2][c], Local[c]);
+        }
+        const VectorRegister4Float X = VectorAdd(Local[0], OffsetX);
+        // boxes behind the camera divide by zero or a negative depth, they are dropped below
+        const VectorRegister4Float InvX = VectorDivide(GlobalVectorConstants::FloatOne, X);
+        VectorStore(X, Col(OutX) + i);
+        VectorStore(VectorMultiplyAdd(VectorMultiply(VectorAdd(Local[1], OffsetY), InvX), Focal, CenterU), Col(OutU) + i);
+        VectorStore(VectorSubtract(CenterV, VectorMultiply(VectorMultiply(VectorAdd(Local[2], OffsetZ), InvX), Focal)), Col(OutV) + i);
+        VectorStore(VectorMultiply(VectorMultiply(VD, InvX), FocalRatio), Col(OutScale) + i);
+    }
+
+    for (int32 i = 0; i < Num; i++) {
+        UMyNeuralNetwork::FBoxCoordinates& Box = *Boxes[i];
+        if (Col(OutX)[i] < 1.f) {
+            Box.width = 0.f;
+            Box.height = 0.f;
+            continue;
+        }
+        Box.width *= Col(OutScale)[i];
+        Box.height *= Col(OutScale)[i];
+        Box.cx = Col(OutU)[i];
+        Box.cy = Col(OutV)[i];
+        Box.x1 = Box.cx - Box.width * 0.5f;
+        Box.y1 = Box.cy - Box.height * 0.5f;
+    }
+}
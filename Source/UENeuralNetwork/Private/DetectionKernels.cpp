@@ -0,0 +1,131 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DetectionKernels.h"
+
+#include "PipelineSettings.h"
+
+namespace {
+    // template arguments of 0 fall back to the runtime value, so the generic kernel is the same code
+    template<int32 WidthT, int32 HeightT, int32 ChannelsT>
+    void PreprocessFloat(const FColor* Src, float* Dst, int32 InWidth, int32 InHeight) {
+        static_assert(ChannelsT == 3, "FColor input only provides rgb");
+        // the constant trip counts are only valid for the size they were built for, anything else takes the generic path
+        if ((WidthT > 0 && InWidth != WidthT) || (HeightT > 0 && InHeight != HeightT)) {
+            PreprocessFloat<0, 0, ChannelsT>(Src, Dst, InWidth, InHeight);
+            return;
+        }
+        const int32 Width = WidthT > 0 ? WidthT : InWidth;
+        const int32 Height = HeightT > 0 ? HeightT : InHeight;
+        const int32 PixelCount = Width * Height;
+
+        // split by rows; the inner loop has a constant trip count for the specialized geometries and vectorizes
+        PipelineParallelFor(Height, [=](int32 BeginY, int32 EndY) {
+            for (int32 Y = BeginY; Y < EndY; ++Y) {
+                const FColor* RESTRICT Row = Src + Y * Width;
+                float* RESTRICT R = Dst + Y * Width;
+                float* RESTRICT G = R + PixelCount;
+                float* RESTRICT B = G + PixelCount;
+                for (int32 X = 0; X < Width; ++X) {
+                    R[X] = Row[X].R * (1.f / 255);
+                    G[X] = Row[X].G * (1.f / 255);
+                    B[X] = Row[X].B * (1.f / 255);
+                }
+            }
+            }, Width);
+    }
+
+    template<int32 NumClassesT, int32 NumAnchorsT>
+    void Decode(const float* Output, int32 InNumClasses, int32 InNumAnchors, float GlobalThreshold, TArrayView<const FDetectionClassThreshold> Classes,
+        FBoxCoordinatesMap& OutBoxes) {
+        if ((NumClassesT > 0 && InNumClasses != NumClassesT) || (NumAnchorsT > 0 && InNumAnchors != NumAnchorsT)) {
+            Decode<0, 0>(Output, InNumClasses, InNumAnchors, GlobalThreshold, Classes, OutBoxes);
+            return;
+        }
+        const int32 NumClasses = NumClassesT > 0 ? NumClassesT : InNumClasses;
+        const int32 NumAnchors = NumAnchorsT > 0 ? NumAnchorsT : InNumAnchors;
+
+        // rows 0-3 are cx, cy, w, h for every anchor, then one row of scores per class
+        const float* RESTRICT Cx = Output;
+        const float* RESTRICT Cy = Output + NumAnchors;
+        const float* RESTRICT W = Output + NumAnchors * 2;
+        const float* RESTRICT H = Output + NumAnchors * 3;
+
+        // an allowlist touches only its rows of the output, the other classes are never read
+        const bool bAllClasses = Classes.Num() == 0;
+        const int32 NumRows = bAllClasses ? NumClasses : Classes.Num();
+        for (int32 Row = 0; Row < NumRows; ++Row) {
+            const int32 ClassIndex = bAllClasses ? Row : Classes[Row].ClassIndex;
+            if (ClassIndex < 0 || ClassIndex >= NumClasses) {
+                continue; // allowlist written for a model with more classes
+            }
+            const float Threshold = !bAllClasses && Classes[Row].Threshold > 0.f ? Classes[Row].Threshold : GlobalThreshold;
+            const float* RESTRICT Scores = Output + (4 + ClassIndex) * NumAnchors;
+
+            // branch free max over the row first, most classes have no anchor above the threshold
+            float RowMax = 0.f;
+            for (int32 Anchor = 0; Anchor < NumAnchors; ++Anchor) {
+                RowMax = FMath::Max(RowMax, Scores[Anchor]);
+            }
+            if (RowMax <= Threshold) {
+                continue;
+            }
+
+            TArray<UMyNeuralNetwork::FBoxCoordinates>& Boxes = OutBoxes.FindOrAdd(ClassIndex);
+            for (int32 Anchor = 0; Anchor < NumAnchors; ++Anchor) {
+                if (Scores[Anchor] > Threshold) {
+                    UMyNeuralNetwork::FBoxCoordinates coords;
+                    coords.confidence = Scores[Anchor];
+                    coords.cx = Cx[Anchor];
+                    coords.cy = Cy[Anchor];
+                    coords.anchor = Anchor;
+                    coords.width = W[Anchor];
+                    coords.height = H[Anchor];
+                    coords.x1 = coords.cx - (coords.width / 2);
+                    coords.y1 = coords.cy - (coords.height / 2);
+                    Boxes.Add(coords);
+                }
+            }
+        }
+    }
+
+    template<int32 WidthT, int32 HeightT, int32 ChannelsT, int32 NumClassesT, int32 NumAnchorsT>
+    constexpr FDetectionKernels MakeKernels(const TCHAR* Name) {
+        return FDetectionKernels{ Name, WidthT, HeightT, ChannelsT, NumClassesT, NumAnchorsT,
+            &PreprocessFloat<WidthT, HeightT, ChannelsT>, &Decode<NumClassesT, NumAnchorsT> };
+    }
+
+    // model geometries we ship: width, height, channels, classes, anchors (anchors = sum over strides 8/16/32 of cells)
+    const FDetectionKernels SpecializedKernels[] = {
+        MakeKernels<640, 480, 3, 80, 6300>(TEXT("yolov8 640x480")),
+        MakeKernels<640, 640, 3, 80, 8400>(TEXT("yolov8 640x640")),
+        MakeKernels<320, 320, 3, 80, 2100>(TEXT("yolov8 320x320")),
+    };
+
+    const FDetectionKernels GenericKernels = MakeKernels<0, 0, 3, 0, 0>(TEXT("generic"));
+}
+
+const FDetectionKernels* FindDetectionKernels(int32 Width, int32 Height, int32 Channels, int32 NumClasses, int32 NumAnchors) {
+    for (const FDetectionKernels& Kernels : SpecializedKernels) {
+        if (Kernels.Width == Width && Kernels.Height == Height && Kernels.Channels == Channels
+            && Kernels.NumClasses == NumClasses && Kernels.NumAnchors == NumAnchors) {
+            return &Kernels;
+        }
+    }
+    return &GenericKernels;
+}
+
+void SuppressOverlappingBoxes(const FBoxCoordinatesMap& Boxes, TArray<TPair<int, UMyNeuralNetwork::FBoxCoordinates>>& OutKept) {
+    OutKept.Reset();
+    for (const auto& Pair : Boxes) {
+        for (const UMyNeuralNetwork::FBoxCoordinates& Candidate : Pair.Value) {
+            const FBox2D CandidateBox(FVector2D(Candidate.x1, Candidate.y1), FVector2D(Candidate.x1 + Candidate.width, Candidate.y1 + Candidate.height));
+            const bool bOverlaps = OutKept.ContainsByPredicate([&CandidateBox](const TPair<int, UMyNeuralNetwork::FBoxCoordinates>& Kept) {
+                const UMyNeuralNetwork::FBoxCoordinates& Box = Kept.Value;
+                return CandidateBox.Intersect(FBox2D(FVector2D(Box.x1, Box.y1), FVector2D(Box.x1 + Box.width, Box.y1 + Box.height)));
+                });
+            if (!bOverlaps) {
+                OutKept.Emplace(Pair.Key, Candidate);
+            }
+        }
+    }
+}
@@ -0,0 +1,79 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DetectionLabels.h"
+
+#include "HAL/IConsoleManager.h"
+#include "Internationalization/Internationalization.h"
+#include "MyNeuralNetwork.h"
+
+namespace {
+    // coco, the classes of the yolov8 models we ship
+    const TCHAR* const BuiltInLabels[] = {
+        TEXT("person"), TEXT("bicycle"), TEXT("car"), TEXT("motorcycle"), TEXT("airplane"), TEXT("bus"), TEXT("train"),
+        TEXT("truck"), TEXT("boat"), TEXT("traffic light"), TEXT("fire hydrant"), TEXT("stop sign"), TEXT("parking meter"),
+        TEXT("bench"), TEXT("bird"), TEXT("cat"), TEXT("dog"), TEXT("horse"), TEXT("sheep"), TEXT("cow"), TEXT("elephant"),
+        TEXT("bear"), TEXT("zebra"), TEXT("giraffe"), TEXT("backpack"), TEXT("umbrella"), TEXT("handbag"), TEXT("tie"),
+        TEXT("suitcase"), TEXT("frisbee"), TEXT("skis"), TEXT("snowboard"), TEXT("sports ball"), TEXT("kite"),
+        TEXT("baseball bat"), TEXT("baseball glove"), TEXT("skateboard"), TEXT("surfboard"), TEXT("tennis racket"),
+        TEXT("bottle"), TEXT("wine glass"), TEXT("cup"), TEXT("fork"), TEXT("knife"), TEXT("spoon"), TEXT("bowl"),
+        TEXT("banana"), TEXT("apple"), TEXT("sandwich"), TEXT("orange"), TEXT("broccoli"), TEXT("carrot"), TEXT("hot dog"),
+        TEXT("pizza"), TEXT("donut"), TEXT("cake"), TEXT("chair"), TEXT("couch"), TEXT("potted plant"), TEXT("bed"),
+        TEXT("dining table"), TEXT("toilet"), TEXT("tv"), TEXT("laptop"), TEXT("mouse"), TEXT("remote"), TEXT("keyboard"),
+        TEXT("cell phone"), TEXT("microwave"), TEXT("oven"), TEXT("toaster"), TEXT("sink"), TEXT("refrigerator"), TEXT("book"),
+        TEXT("clock"), TEXT("vase"), TEXT("scissors"), TEXT("teddy bear"), TEXT("hair drier"), TEXT("toothbrush")
+    };
+}
+
+FDetectionLabels& FDetectionLabels::Get() {
+    static FDetectionLabels Instance;
+    return Instance;
+}
+
+FDetectionLabels::FDetectionLabels() {
+    ResetToBuiltIn();
+    FInternationalization::Get().OnCultureChanged().AddLambda([]() { FDetectionLabels::Get().Generation++; });
+}
+
+FText FDetectionLabels::GetLabel(int32 ClassIndex) const {
+    return Labels.IsValidIndex(ClassIndex) && !Labels[ClassIndex].IsEmpty() ? Labels[ClassIndex] : FText::AsNumber(ClassIndex);
+}
+
+void FDetectionLabels::SetLabels(TArray<FText> InLabels) {
+    Labels = MoveTemp(InLabels);
+    Generation++;
+}
+
+void FDetectionLabels::ResetToBuiltIn() {
+    TArray<FText> BuiltIn;
+    BuiltIn.Reserve(UE_ARRAY_COUNT(BuiltInLabels));
+    for (const TCHAR* Label : BuiltInLabels) {
+        BuiltIn.Add(FText::FromString(Label));
+    }
+    SetLabels(MoveTemp(BuiltIn));
+}
+
+static FAutoConsoleCommand LabelsLoadCommand(
+    TEXT("nn.Labels.Load"),
+    TEXT("Replace the detection labels with the \"index: label\" lines of a text file. Without argument the built-in labels are restored."),
+    FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args) {
+        if (Args.Num() == 0) {
+            FDetectionLabels::Get().ResetToBuiltIn();
+            return;
+        }
+        const TMap<int, FString> Map = UMyNeuralNetwork::ReadFileToMap(Args[0]);
+        if (Map.Num() == 0) {
+            UE_LOG(LogTemp, Error, TEXT("Labels: nothing read from %s"), *Args[0]);
+            return;
+        }
+        TArray<FText> Labels;
+        for (const auto& Pair : Map) {
+            if (Pair.Key >= 0) {
+                if (Labels.Num() <= Pair.Key) {
+                    Labels.SetNum(Pair.Key + 1);
+                }
+                Labels[Pair.Key] = FText::FromString(Pair.Value);
+            }
+        }
+        FDetectionLabels::Get().SetLabels(MoveTemp(Labels));
+        UE_LOG(LogTemp, Log, TEXT("Labels: %d classes from %s"), FDetectionLabels::Get().Num(), *Args[0]);
+    }));
@@ -0,0 +1,469 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DetectionLog.h"
+
+#include "Algo/BinarySearch.h"
+#include "Async/MappedFileHandle.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformFileManager.h"
+#include "HAL/RunnableThread.h"
+#include "Misc/CoreDelegates.h"
+#include "Misc/DateTime.h"
+#include "Misc/Paths.h"
+
+using namespace DetectionLog;
+
+static TAutoConsoleVariable<int32> CVarNNLogEnable(
+    TEXT("nn.Log.Enable"), 0,
+    TEXT("Append every published detection set to a binary log file."),
+    ECVF_Default);
+
+static TAutoConsoleVariable<FString> CVarNNLogDirectory(
+    TEXT("nn.Log.Directory"), TEXT(""),
+    TEXT("Directory for detection logs, empty for Saved/DetectionLogs."),
+    ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarNNLogChunkRecords(
+    TEXT("nn.Log.ChunkRecords"), 4096,
+    TEXT("Detections per chunk of the log (one index entry per chunk)."),
+    ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarNNLogFlushSeconds(
+    TEXT("nn.Log.FlushSeconds"), 5.f,
+    TEXT("Write a partial chunk once it is this old, bounds what is lost on a crash."),
+    ECVF_Default);
+
+namespace {
+    static_assert(sizeof(FFileHeader) == 16 && sizeof(FChunkHeader) == 64 && sizeof(FIndexEntry) == 40 && sizeof(FTrailer) == 16,
+        "detection log structs are written as is");
+
+    // column offsets inside a chunk, relative to the chunk header
+    struct FChunkColumns {
+        uint64 FrameIds, Timestamps, Scores, X1, Y1, Widths, Heights, Classes, Bytes;
+
+        explicit FChunkColumns(uint32 Count) {
+            FrameIds = sizeof(FChunkHeader);
+            Timestamps = FrameIds + Count * sizeof(uint64);
+            Scores = Timestamps + Count * sizeof(uint64);
+            X1 = Scores + Count * sizeof(float);
+            Y1 = X1 + Count * sizeof(float);
+            Widths = Y1 + Count * sizeof(float);
+            Heights = Widths + Count * sizeof(float);
+            Classes = Heights + Count * sizeof(float);
+            Bytes = Align(Classes + Count * sizeof(uint16), 8);
+        }
+    };
+
+    template <typename T>
+    const T* Column(const FChunkHeader& Chunk, uint64 Offset) {
+        return reinterpret_cast<const T*>(reinterpret_cast<const uint8*>(&Chunk) + Offset);
+    }
+}
+
+FDetectionLogWriter& FDetectionLogWriter::Get() {
+    static FDetectionLogWriter Instance;
+    return Instance;
+}
+
+void FDetectionLogWriter::FChunkRows::Reset() {
+    // keeps the allocations
+    FrameIds.Reset();
+    Timestamps.Reset();
+    Scores.Reset();
+    X1.Reset();
+    Y1.Reset();
+    Widths.Reset();
+    Heights.Reset();
+    Classes.Reset();
+}
+
+void FDetectionLogWriter::StartWriter() {
+    FString Directory = CVarNNLogDirectory.GetValueOnAnyThread();
+    if (Directory.IsEmpty()) {
+        Directory = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("DetectionLogs"));
+    }
+    Filename = FPaths::Combine(Directory, FString::Printf(TEXT("Detections-%s.dnnlog"), *FDateTime::Now().ToString()));
+    bStopping = false;
+    bFinished = false;
+    Thread.Reset(FRunnableThread::Create(this, TEXT("DetectionLogWriter"), 0, TPri_BelowNormal));
+
+    static bool bRegisteredExit = false;
+    if (!bRegisteredExit) {
+        bRegisteredExit = true;
+        FCoreDelegates::OnPreExit.AddLambda([]() { FDetectionLogWriter::Get().Close(); });
+    }
+}
+
+void FDetectionLogWriter::SealChunk() {
+    if (Filling.Num() == 0) {
+        return;
+    }
+    Pending.Add(MoveTemp(Filling));
+    Filling = Spare.Num() > 0 ? Spare.Pop(false) : FChunkRows();
+}
+
+void FDetectionLogWriter::Append(uint64 FrameId, uint64 TimestampNs, const FBoxCoordinatesMap& Boxes) {
+    FScopeLock ScopeLock(&Lock);
+    if (CVarNNLogEnable.GetValueOnAnyThread() == 0) {
+        // the writer finishes the file on its own thread
+        if (Thread && !bStopping) {
+            SealChunk();
+            bStopping = true;
+        }
+        bOpenFailed = false;
+        return;
+    }
+    if (bOpenFailed) {
+        return;
+    }
+    if (Thread && bFinished) {
+        // the previous file is complete
+        Thread->WaitForCompletion();
+        Thread.Reset();
+    }
+    if (!Thread) {
+        StartWriter();
+    }
+
+    if (Filling.Num() == 0) {
+        ChunkStartSeconds = FPlatformTime::Seconds();
+    }
+    for (const auto& Pair : Boxes) {
+        for (const UMyNeuralNetwork::FBoxCoordinates& Box : Pair.Value) {
+            Filling.FrameIds.Add(FrameId);
+            Filling.Timestamps.Add(TimestampNs);
+            Filling.Scores.Add(Box.confidence);
+            Filling.X1.Add(Box.x1);
+            Filling.Y1.Add(Box.y1);
+            Filling.Widths.Add(Box.width);
+            Filling.Heights.Add(Box.height);
+            Filling.Classes.Add(static_cast<uint16>(Pair.Key));
+        }
+    }
+
+    if (Filling.Num() >= FMath::Max(CVarNNLogChunkRecords.GetValueOnAnyThread(), 1)
+        || (Filling.Num() > 0 && FPlatformTime::Seconds() - ChunkStartSeconds >= CVarNNLogFlushSeconds.GetValueOnAnyThread())) {
+        SealChunk();
+    }
+}
+
+void FDetectionLogWriter::Close() {
+    {
+        FScopeLock ScopeLock(&Lock);
+        if (!Thread) {
+            return;
+        }
+        SealChunk();
+        bStopping = true;
+    }
+    // the writer takes the lock to pick up chunks, wait outside it
+    Thread->WaitForCompletion();
+    FScopeLock ScopeLock(&Lock);
+    Thread.Reset();
+}
+
+uint32 FDetectionLogWriter::Run() {
+    if (!OpenFile()) {
+        FScopeLock ScopeLock(&Lock);
+        bOpenFailed = true;
+        bFinished = true;
+        return 0;
+    }
+    for (;;) {
+        // read before taking the chunks: everything sealed before the stop is written to this file
+        const bool bStop = bStopping;
+        TArray<FChunkRows> Chunks;
+        {
+            FScopeLock ScopeLock(&Lock);
+            Chunks = MoveTemp(Pending);
+        }
+        for (FChunkRows& Rows : Chunks) {
+            WriteChunk(Rows);
+            Rows.Reset();
+        }
+        if (Chunks.Num() > 0) {
+            FScopeLock ScopeLock(&Lock);
+            Spare.Append(MoveTemp(Chunks));
+        }
+        if (bStop) {
+            break;
+        }
+        FPlatformProcess::Sleep(0.05f);
+    }
+    CloseFile();
+    bFinished = true;
+    return 0;
+}
+
+bool FDetectionLogWriter::OpenFile() {
+    Archive.Reset(IFileManager::Get().CreateFileWriter(*Filename));
+    if (!Archive) {
+        UE_LOG(LogTemp, Error, TEXT("Detection log: could not open %s"), *Filename);
+        return false;
+    }
+    FFileHeader Header = { FileMagic, Version, 0 };
+    Archive->Serialize(&Header, sizeof(Header));
+    Index.Reset();
+    UE_LOG(LogTemp, Log, TEXT("Detection log: writing %s"), *Filename);
+    return true;
+}
+
+void FDetectionLogWriter::WriteChunk(const FChunkRows& Rows) {
+    const uint32 Count = Rows.Num();
+    const FChunkColumns Columns(Count);
+    FChunkHeader Chunk = {};
+    Chunk.Magic = ChunkMagic;
+    Chunk.Count = Count;
+    Chunk.MinFrameId = MAX_uint64;
+    Chunk.MinTimestampNs = MAX_uint64;
+    for (uint32 Row = 0; Row < Count; Row++) {
+        Chunk.MinFrameId = FMath::Min(Chunk.MinFrameId, Rows.FrameIds[Row]);
+        Chunk.MaxFrameId = FMath::Max(Chunk.MaxFrameId, Rows.FrameIds[Row]);
+        Chunk.MinTimestampNs = FMath::Min(Chunk.MinTimestampNs, Rows.Timestamps[Row]);
+        Chunk.MaxTimestampNs = FMath::Max(Chunk.MaxTimestampNs, Rows.Timestamps[Row]);
+        const int32 Bit = FMath::Min<int32>(Rows.Classes[Row], MaskBits - 1);
+        Chunk.ClassMask[Bit / 64] |= 1ull << (Bit % 64);
+    }
+    Chunk.ChunkBytes = Columns.Bytes;
+
+    Index.Add(FIndexEntry{ static_cast<uint64>(Archive->Tell()), Chunk.MinFrameId, Chunk.MaxFrameId, Chunk.MinTimestampNs, Chunk.MaxTimestampNs });
+
+    Archive->Serialize(&Chunk, sizeof(Chunk));
+    Archive->Serialize(const_cast<uint64*>(Rows.FrameIds.GetData()), Count * sizeof(uint64));
+    Archive->Serialize(const_cast<uint64*>(Rows.Timestamps.GetData()), Count * sizeof(uint64));
+    Archive->Serialize(const_cast<float*>(Rows.Scores.GetData()), Count * sizeof(float));
+    Archive->Serialize(const_cast<float*>(Rows.X1.GetData()), Count * sizeof(float));
+    Archive->Serialize(const_cast<float*>(Rows.Y1.GetData()), Count * sizeof(float));
+    Archive->Serialize(const_cast<float*>(Rows.Widths.GetData()), Count * sizeof(float));
+    Archive->Serialize(const_cast<float*>(Rows.Heights.GetData()), Count * sizeof(float));
+    Archive->Serialize(const_cast<uint16*>(Rows.Classes.GetData()), Count * sizeof(uint16));
+    uint8 Padding[8] = {};
+    Archive->Serialize(Padding, Columns.Bytes - (Columns.Classes + Count * sizeof(uint16)));
+    Archive->Flush();
+}
+
+void FDetectionLogWriter::CloseFile() {
+    FTrailer Trailer = { static_cast<uint64>(Archive->Tell()), static_cast<uint32>(Index.Num()), IndexMagic };
+    Archive->Serialize(Index.GetData(), Index.Num() * sizeof(FIndexEntry));
+    Archive->Serialize(&Trailer, sizeof(Trailer));
+    Archive->Close();
+    Archive.Reset();
+    UE_LOG(LogTemp, Log, TEXT("Detection log: closed %s (%d chunks)"), *Filename, Index.Num());
+}
+
+FDetectionLogReader::FDetectionLogReader() = default;
+
+FDetectionLogReader::~FDetectionLogReader() {
+    Close();
+}
+
+bool FDetectionLogReader::Open(const FString& Filename) {
+    Close();
+    MappedFile.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenMapped(*Filename));
+    if (!MappedFile || MappedFile->GetFileSize() < static_cast<int64>(sizeof(FFileHeader))) {
+        Close();
+        return false;
+    }
+    MappedRegion.Reset(MappedFile->MapRegion(0, MappedFile->GetFileSize()));
+    if (!MappedRegion) {
+        Close();
+        return false;
+    }
+    Data = MappedRegion->GetMappedPtr();
+    Size = MappedRegion->GetMappedSize();
+
+    const FFileHeader* Header = reinterpret_cast<const FFileHeader*>(Data);
+    if (Header->Magic != FileMagic || Header->Version != Version) {
+        Close();
+        return false;
+    }
+
+    const FTrailer* Trailer = Size >= sizeof(FFileHeader) + sizeof(FTrailer)
+        ? reinterpret_cast<const FTrailer*>(Data + Size - sizeof(FTrailer)) : nullptr;
+    if (Trailer != nullptr && Trailer->Magic == IndexMagic && Trailer->IndexOffset >= sizeof(FFileHeader)
+        && Trailer->IndexOffset % 8 == 0 && Trailer->IndexOffset <= Size - sizeof(FTrailer)
+        && Trailer->IndexOffset + Trailer->NumChunks * sizeof(FIndexEntry) + sizeof(FTrailer) == Size) {
+        const FIndexEntry* Entries = reinterpret_cast<const FIndexEntry*>(Data + Trailer->IndexOffset);
+        bool bIndexValid = true;
+        for (uint64 EntryIndex = 0; EntryIndex < Trailer->NumChunks && bIndexValid; EntryIndex++) {
+            bIndexValid = Entries[EntryIndex].Offset < Trailer->IndexOffset && IsValidChunk(Entries[EntryIndex].Offset);
+        }
+        if (bIndexValid) {
+            Index.Append(Entries, Trailer->NumChunks);
+            for (int32 ChunkIndex = 0; ChunkIndex < Index.Num(); ChunkIndex++) {
+                NumRecords += GetChunk(ChunkIndex)->Count;
+            }
+            OnIndexLoaded();
+            return true;
+        }
+        UE_LOG(LogTemp, Warning, TEXT("Detection log: the index of %s does not match its chunks"), *Filename);
+    }
+
+    // not closed cleanly or a corrupt index, walk the chunk headers
+    if (!RebuildIndex()) {
+        Close();
+        return false;
+    }
+    OnIndexLoaded();
+    UE_LOG(LogTemp, Warning, TEXT("Detection log: %s has no index, rebuilt it from %d chunks"), *Filename, Index.Num());
+    return true;
+}
+
+bool FDetectionLogReader::IsValidChunk(uint64 Offset) const {
+    // chunks are 8 byte aligned, the columns are read in place
+    if (Offset < sizeof(FFileHeader) || Offset % 8 != 0 || Offset > Size || Size - Offset < sizeof(FChunkHeader)) {
+        return false;
+    }
+    const FChunkHeader* Chunk = reinterpret_cast<const FChunkHeader*>(Data + Offset);
+    return Chunk->Magic == ChunkMagic && Chunk->ChunkBytes == FChunkColumns(Chunk->Count).Bytes && Chunk->ChunkBytes <= Size - Offset;
+}
+
+bool FDetectionLogReader::RebuildIndex() {
+    uint64 Offset = sizeof(FFileHeader);
+    while (Offset + sizeof(FChunkHeader) <= Size) {
+        if (!IsValidChunk(Offset)) {
+            // a torn last chunk
+            break;
+        }
+        const FChunkHeader* Chunk = reinterpret_cast<const FChunkHeader*>(Data + Offset);
+        Index.Add(FIndexEntry{ Offset, Chunk->MinFrameId, Chunk->MaxFrameId, Chunk->MinTimestampNs, Chunk->MaxTimestampNs });
+        NumRecords += Chunk->Count;
+        Offset += Chunk->ChunkBytes;
+    }
+    return true;
+}
+
+void FDetectionLogReader::OnIndexLoaded() {
+    StartTimestampNs = Index.Num() > 0 ? MAX_uint64 : 0;
+    bTimeOrdered = true;
+    bFramesOrdered = true;
+    for (int32 ChunkIndex = 0; ChunkIndex < Index.Num(); ChunkIndex++) {
+        const FIndexEntry& Entry = Index[ChunkIndex];
+        StartTimestampNs = FMath::Min(StartTimestampNs, Entry.MinTimestampNs);
+        if (ChunkIndex > 0) {
+            // equal is fine, a frame's detections can straddle two chunks
+            bTimeOrdered &= Entry.MinTimestampNs >= Index[ChunkIndex - 1].MaxTimestampNs;
+            bFramesOrdered &= Entry.MinFrameId >= Index[ChunkIndex - 1].MaxFrameId;
+        }
+    }
+}
+
+void FDetectionLogReader::Close() {
+    MappedRegion.Reset();
+    MappedFile.Reset();
+    Data = nullptr;
+    Size = 0;
+    Index.Reset();
+    NumRecords = 0;
+    StartTimestampNs = 0;
+    bTimeOrdered = false;
+    bFramesOrdered = false;
+}
+
+const FChunkHeader* FDetectionLogReader::GetChunk(int32 ChunkIndex) const {
+    return reinterpret_cast<const FChunkHeader*>(Data + Index[ChunkIndex].Offset);
+}
+
+bool FDetectionLogReader::ChunkHasClass(const FChunkHeader& Chunk, int32 ClassIndex) {
+    if (ClassIndex < 0) {
+        return true;
+    }
+    const int32 Bit = FMath::Min(ClassIndex, MaskBits - 1);
+    return (Chunk.ClassMask[Bit / 64] & (1ull << (Bit % 64))) != 0;
+}
+
+void FDetectionLogReader::ReadEntry(const FChunkHeader& Chunk, uint32 Row, FDetectionLogEntry& Out) {
+    const FChunkColumns Columns(Chunk.Count);
+    Out.FrameId = Column<uint64>(Chunk, Columns.FrameIds)[Row];
+    Out.TimestampNs = Column<uint64>(Chunk, Columns.Timestamps)[Row];
+    Out.ClassIndex = Column<uint16>(Chunk, Columns.Classes)[Row];
+    Out.Score = Column<float>(Chunk, Columns.Scores)[Row];
+    Out.X1 = Column<float>(Chunk, Columns.X1)[Row];
+    Out.Y1 = Column<float>(Chunk, Columns.Y1)[Row];
+    Out.Width = Column<float>(Chunk, Columns.Widths)[Row];
+    Out.Height = Column<float>(Chunk, Columns.Heights)[Row];
+}
+
+void FDetectionLogReader::QueryClassInTimeRange(int32 ClassIndex, uint64 T0Ns, uint64 T1Ns, TArray<FDetectionLogEntry>& Out) const {
+    // ordered chunks: start at the first one ending at or after t0 and stop at the first one starting after t1.
+    // otherwise every index entry is checked, still without touching the chunks outside the range
+    int32 ChunkIndex = bTimeOrdered ? Algo::LowerBoundBy(Index, T0Ns, &FIndexEntry::MaxTimestampNs) : 0;
+    for (; ChunkIndex < Index.Num(); ChunkIndex++) {
+        const FIndexEntry& Entry = Index[ChunkIndex];
+        if (Entry.MinTimestampNs > T1Ns) {
+            if (bTimeOrdered) {
+                break;
+            }
+            continue;
+        }
+        if (Entry.MaxTimestampNs < T0Ns) {
+            continue;
+        }
+        const FChunkHeader& Chunk = *GetChunk(ChunkIndex);
+        if (!ChunkHasClass(Chunk, ClassIndex)) {
+            continue;
+        }
+        // scan the two narrow columns, only matching rows touch the rest
+        const FChunkColumns Columns(Chunk.Count);
+        const uint64* Timestamps = Column<uint64>(Chunk, Columns.Timestamps);
+        const uint16* Classes = Column<uint16>(Chunk, Columns.Classes);
+        for (uint32 Row = 0; Row < Chunk.Count; Row++) {
+            if (Timestamps[Row] >= T0Ns && Timestamps[Row] <= T1Ns && (ClassIndex < 0 || Classes[Row] == ClassIndex)) {
+                ReadEntry(Chunk, Row, Out.AddDefaulted_GetRef());
+            }
+        }
+    }
+}
+
+bool FDetectionLogReader::QueryFrame(uint64 FrameId, TArray<FDetectionLogEntry>& Out) const {
+    // same as the time query: a frame can straddle two chunks, and with several managers or frames without an id
+    // (logged as -1) it can be anywhere
+    int32 ChunkIndex = bFramesOrdered ? Algo::LowerBoundBy(Index, FrameId, &FIndexEntry::MaxFrameId) : 0;
+    const int32 NumBefore = Out.Num();
+    for (; ChunkIndex < Index.Num(); ChunkIndex++) {
+        const FIndexEntry& Entry = Index[ChunkIndex];
+        if (Entry.MinFrameId > FrameId) {
+            if (bFramesOrdered) {
+                break;
+            }
+            continue;
+        }
+        if (Entry.MaxFrameId < FrameId) {
+            continue;
+        }
+        const FChunkHeader& Chunk = *GetChunk(ChunkIndex);
+        const uint64* FrameIds = Column<uint64>(Chunk, FChunkColumns(Chunk.Count).FrameIds);
+        for (uint32 Row = 0; Row < Chunk.Count; Row++) {
+            if (FrameIds[Row] == FrameId) {
+                ReadEntry(Chunk, Row, Out.AddDefaulted_GetRef());
+            }
+        }
+    }
+    return Out.Num() > NumBefore;
+}
+
+static FAutoConsoleCommand LogQueryCommand(
+    TEXT("nn.Log.Query"),
+    TEXT("Print detections from a detection log. Arguments: file class(-1 for any) [t0 seconds] [t1 seconds], times relative to the first record."),
+    FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args) {
+        if (Args.Num() < 2) {
+            UE_LOG(LogTemp, Warning, TEXT("usage: nn.Log.Query <file> <class> [t0] [t1]"));
+            return;
+        }
+        FDetectionLogReader Reader;
+        if (!Reader.Open(Args[0])) {
+            UE_LOG(LogTemp, Error, TEXT("Detection log: could not read %s"), *Args[0]);
+            return;
+        }
+        const uint64 Origin = Reader.GetStartTimestampNs();
+        const uint64 T0 = Origin + static_cast<uint64>((Args.Num() > 2 ? FCString::Atod(*Args[2]) : 0.0) * 1e9);
+        const uint64 T1 = Args.Num() > 3 ? Origin + static_cast<uint64>(FCString::Atod(*Args[3]) * 1e9) : MAX_uint64;
+        TArray<FDetectionLogEntry> Entries;
+        Reader.QueryClassInTimeRange(FCString::Atoi(*Args[1]), T0, T1, Entries);
+        for (const FDetectionLogEntry& Entry : Entries) {
+            UE_LOG(LogTemp, Log, TEXT("frame %llu t=%.3f class %d score %.2f box %.0f %.0f %.0f %.0f"), Entry.FrameId,
+                (Entry.TimestampNs - Origin) * 1e-9, Entry.ClassIndex, Entry.Score, Entry.X1, Entry.Y1, Entry.Width, Entry.Height);
+        }
+        UE_LOG(LogTemp, Log, TEXT("Detection log: %d of %llu detections in %d chunks matched"), Entries.Num(), Reader.GetNumRecords(), Reader.GetNumChunks());
+    }));
@@ -0,0 +1,161 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DetectionPipelineBenchCommandlet.h"
+
+#include "DetectionPipelineBenchData.h"
+
+#include "NeuralNetwork.h"
+#include "UObject/StrongObjectPtr.h"
+
+using namespace DetectionPipelineBench;
+
+namespace {
+    struct FStageResult {
+        FString Name;
+        double MedianMs = 0.0;
+        // -1 when the allocator does not count calls
+        double AllocationsPerFrame = -1.0;
+        bool bCorrect = true;
+    };
+
+    // times Body Iterations times and reads the allocator's call counters around it. the counters are global, so
+    // whatever other threads allocate meanwhile is counted too: budgets leave room for that
+    FStageResult MeasureStage(const TCHAR* Name, int32 Iterations, TFunctionRef<void()> Body) {
+        Body(); // warm caches and lazily created pools outside the measurement
+
+        TArray<double> Times;
+        Times.Reserve(Iterations);
+        const int64 CallsBefore = GetAllocatorCalls();
+        for (int32 i = 0; i < Iterations; i++) {
+            const double Start = FPlatformTime::Seconds();
+            Body();
+            Times.Add((FPlatformTime::Seconds() - Start) * 1000.0);
+        }
+        const int64 CallsAfter = GetAllocatorCalls();
+
+        Times.Sort();
+        FStageResult Result;
+        Result.Name = Name;
+        Result.MedianMs = Times[Times.Num() / 2];
+        if (CallsBefore >= 0 && CallsAfter >= 0) {
+            Result.AllocationsPerFrame = static_cast<double>(CallsAfter - CallsBefore) / Iterations;
+        }
+        return Result;
+    }
+
+    // the frame in the layout of the network's input tensor
+    void MakeModelInput(const UMyNeuralNetwork& Network, TArray<float>& OutFloat, TArray<uint8>& OutBytes) {
+        const int32 PixelCount = Network.ModelWidth * Network.ModelHeight;
+        const TArray<FColor> Frame = MakeFrame(Network.ModelWidth, Network.ModelHeight);
+        if (Network.InputFormat == EModelInputFormat::Float32NCHW) {
+            OutFloat.SetNumUninitialized(PixelCount * 3);
+            Network.Kernels->PreprocessFloat(Frame.GetData(), OutFloat.GetData(), Network.ModelWidth, Network.ModelHeight);
+            return;
+        }
+        const bool bPlanar = Network.InputFormat == EModelInputFormat::UInt8NCHW;
+        OutBytes.SetNumUninitialized(PixelCount * 3);
+        for (int32 i = 0; i < PixelCount; i++) {
+            const uint8 Rgb[3] = { Frame[i].R, Frame[i].G, Frame[i].B };
+            for (int32 Channel = 0; Channel < 3; Channel++) {
+                OutBytes[bPlanar ? Channel * PixelCount + i : i * 3 + Channel] = Rgb[Channel];
+            }
+        }
+    }
+}
+
+UDetectionPipelineBenchCommandlet::UDetectionPipelineBenchCommandlet()
+{
+    IsClient = false;
+    IsEditor = false;
+    IsServer = false;
+    LogToConsole = true;
+}
+
+int32 UDetectionPipelineBenchCommandlet::Main(const FString& Params)
+{
+    FParse::Value(*Params, TEXT("iterations="), Iterations);
+    Iterations = FMath::Max(Iterations, 1);
+
+    const FDetectionKernels* Kernels = FindDetectionKernels(Width, Height, 3, NumClasses, NumAnchors);
+
+    TArray<FStageResult> Results;
+
+    const TArray<FColor> Frame = MakeFrame(Width, Height);
+    TArray<float> Tensor;
+    Tensor.SetNumUninitialized(Width * Height * 3);
+    FStageResult& Preprocess = Results.Add_GetRef(MeasureStage(TEXT("Preprocess"), Iterations, [&]() {
+        Kernels->PreprocessFloat(Frame.GetData(), Tensor.GetData(), Width, Height);
+        }));
+    Preprocess.bCorrect = CheckPreprocess(Frame, Tensor);
+
+    const TArray<float> Output = MakeOutputTensor();
+    FBoxCoordinatesMap Decoded;
+    FStageResult& Decode = Results.Add_GetRef(MeasureStage(TEXT("Decode"), Iterations, [&]() {
+        Decoded.Reset();
+        Kernels->Decode(Output.GetData(), NumClasses, NumAnchors, GoldenThreshold, {}, Decoded);
+        }));
+    Decode.bCorrect = CheckDecode(Decoded);
+
+    TArray<TPair<int, UMyNeuralNetwork::FBoxCoordinates>> Kept;
+    FStageResult& Suppress = Results.Add_GetRef(MeasureStage(TEXT("Suppress"), Iterations, [&]() {
+        SuppressOverlappingBoxes(Decoded, Kept);
+        }));
+    Suppress.bCorrect = CheckSuppress(Kept);
+
+    // the whole URunModel (backend run + decode) when a model is given, on the cpu and without publishing
+    FString ModelPath;
+    if (FParse::Value(*Params, TEXT("model="), ModelPath)) {
+        UNeuralNetwork* Model = LoadObject<UNeuralNetwork>(nullptr, *ModelPath);
+        if (Model == nullptr) {
+            UE_LOG(LogTemp, Error, TEXT("Could not load model %s"), *ModelPath);
+            return 1;
+        }
+        Model->SetSynchronousMode(ENeuralSynchronousMode::Synchronous);
+        Model->SetDeviceType(ENeuralDeviceType::CPU);
+        TStrongObjectPtr<UNeuralNetwork> ModelRef(Model);
+        TStrongObjectPtr<UMyNeuralNetwork> Network(NewObject<UMyNeuralNetwork>());
+        Network->Network = Model;
+        Network->ConfigureFromModel();
+        Network->PrepareRequestedBackend();
+        Network->ApplyPendingBackend();
+        if (Network->GetBackend() == nullptr) {
+            UE_LOG(LogTemp, Error, TEXT("No inference backend for %s"), *ModelPath);
+            return 1;
+        }
+
+        TArray<float> FloatInput;
+        TArray<uint8> ByteInput;
+        MakeModelInput(*Network, FloatInput, ByteInput);
+        TArray<uint8> Unused;
+        Results.Add(MeasureStage(TEXT("RunModel"), Iterations, [&]() {
+            if (Network->InputFormat == EModelInputFormat::Float32NCHW) {
+                Network->URunModel(FloatInput, Unused, -1, nullptr, false, false);
+            } else {
+                Network->URunModel(ByteInput, Unused, -1, nullptr, false, false);
+            }
+            }));
+    }
+
+    const TMap<FString, TPair<float, int32>> Budgets = {
+        { TEXT("Preprocess"), { PreprocessBudgetMs, PreprocessAllocationBudget } },
+        { TEXT("Decode"), { DecodeBudgetMs, DecodeAllocationBudget } },
+        { TEXT("Suppress"), { SuppressBudgetMs, SuppressAllocationBudget } },
+        { TEXT("RunModel"), { RunModelBudgetMs, RunModelAllocationBudget } },
+    };
+
+    bool bPassed = true;
+    UE_LOG(LogTemp, Display, TEXT("Detection pipeline bench (%s kernels, %d iterations)"), Kernels->Name, Iterations);
+    for (const FStageResult& Result : Results) {
+        const TPair<float, int32>& Budget = Budgets[Result.Name];
+        const bool bTimeOk = Result.MedianMs <= Budget.Key;
+        const bool bCounted = Result.AllocationsPerFrame >= 0.0;
+        const bool bAllocationsOk = !bCounted || Result.AllocationsPerFrame <= Budget.Value;
+        const bool bStagePassed = Result.bCorrect && bTimeOk && bAllocationsOk;
+        bPassed &= bStagePassed;
+        UE_LOG(LogTemp, Display, TEXT("  %-10s %s  median %.3f ms (budget %.3f)  allocations %s (budget %d)%s"),
+            *Result.Name, bStagePassed ? TEXT("PASS") : TEXT("FAIL"), Result.MedianMs, Budget.Key,
+            bCounted ? *FString::Printf(TEXT("%.1f"), Result.AllocationsPerFrame) : TEXT("n/a"), Budget.Value,
+            Result.bCorrect ? TEXT("") : TEXT("  wrong results"));
+    }
+    return bPassed ? 0 : 1;
+}
@@ -0,0 +1,132 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DetectionKernels.h"
+
+// fixed inputs and golden values shared by the benchmark commandlet (DetectionPipelineBenchCommandlet.h) and the automation
+// tests (Tests/DetectionPipelineTests.cpp)
+namespace DetectionPipelineBench {
+	// geometry of the model we ship
+	constexpr int32 Width = 640;
+	constexpr int32 Height = 480;
+	constexpr int32 NumClasses = 80;
+	constexpr int32 NumAnchors = 6300;
+
+	// deterministic frame: r = x, g = y, b = x + y (mod 256)
+	inline TArray<FColor> MakeFrame(int32 FrameWidth, int32 FrameHeight) {
+		TArray<FColor> Frame;
+		Frame.SetNumUninitialized(FrameWidth * FrameHeight);
+		for (int32 Y = 0; Y < FrameHeight; Y++) {
+			for (int32 X = 0; X < FrameWidth; X++) {
+				Frame[Y * FrameWidth + X] = FColor(X % 256, Y % 256, (X + Y) % 256, 255);
+			}
+		}
+		return Frame;
+	}
+
+	struct FGoldenBox {
+		int32 ClassIndex;
+		int32 Anchor;
+		float Score;
+		float Cx, Cy, W, H;
+	};
+
+	// two overlapping people, one car, one car below the threshold and a toothbrush in the last anchor
+	inline const FGoldenBox GoldenBoxes[] = {
+		{ 0, 100, 0.9f, 100.f, 120.f, 50.f, 100.f },
+		{ 0, 101, 0.8f, 110.f, 130.f, 50.f, 100.f },
+		{ 2, 2000, 0.7f, 400.f, 300.f, 80.f, 40.f },
+		{ 2, 5000, 0.5f, 500.f, 100.f, 30.f, 30.f },
+		{ 79, 6299, 0.99f, 600.f, 450.f, 20.f, 20.f },
+	};
+	constexpr float GoldenThreshold = 0.65f;
+
+	inline TArray<float> MakeOutputTensor() {
+		TArray<float> Output;
+		Output.SetNumZeroed((4 + NumClasses) * NumAnchors);
+		for (const FGoldenBox& Box : GoldenBoxes) {
+			Output[Box.Anchor] = Box.Cx;
+			Output[NumAnchors + Box.Anchor] = Box.Cy;
+			Output[NumAnchors * 2 + Box.Anchor] = Box.W;
+			Output[NumAnchors * 3 + Box.Anchor] = Box.H;
+			Output[(4 + Box.ClassIndex) * NumAnchors + Box.Anchor] = Box.Score;
+		}
+		return Output;
+	}
+
+	// each check logs the first mismatch and returns false
+	inline bool CheckPreprocess(const TArray<FColor>& Frame, const TArray<float>& Tensor) {
+		const int32 PixelCount = Frame.Num();
+		for (int32 i = 0; i < PixelCount; i++) {
+			if (!FMath::IsNearlyEqual(Tensor[i], Frame[i].R / 255.f)
+				|| !FMath::IsNearlyEqual(Tensor[i + PixelCount], Frame[i].G / 255.f)
+				|| !FMath::IsNearlyEqual(Tensor[i + PixelCount * 2], Frame[i].B / 255.f)) {
+				UE_LOG(LogTemp, Error, TEXT("Preprocess mismatch at pixel %d"), i);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	inline bool CheckDecode(const FBoxCoordinatesMap& Decoded) {
+		int32 Expected = 0;
+		for (const FGoldenBox& Golden : GoldenBoxes) {
+			if (Golden.Score <= GoldenThreshold) {
+				continue;
+			}
+			Expected++;
+			const TArray<UMyNeuralNetwork::FBoxCoordinates>* Boxes = Decoded.Find(Golden.ClassIndex);
+			const bool bFound = Boxes != nullptr && Boxes->ContainsByPredicate([&Golden](const UMyNeuralNetwork::FBoxCoordinates& Box) {
+				return Box.confidence == Golden.Score && Box.cx == Golden.Cx && Box.cy == Golden.Cy
+					&& Box.width == Golden.W && Box.height == Golden.H && Box.x1 == Golden.Cx - Golden.W / 2 && Box.y1 == Golden.Cy - Golden.H / 2;
+				});
+			if (!bFound) {
+				UE_LOG(LogTemp, Error, TEXT("Decode: missing class %d anchor %d"), Golden.ClassIndex, Golden.Anchor);
+				return false;
+			}
+		}
+		int32 Total = 0;
+		for (const auto& Pair : Decoded) {
+			Total += Pair.Value.Num();
+		}
+		if (Total != Expected) {
+			UE_LOG(LogTemp, Error, TEXT("Decode: %d boxes, expected %d"), Total, Expected);
+			return false;
+		}
+		return true;
+	}
+
+	inline bool CheckSuppress(const TArray<TPair<int, UMyNeuralNetwork::FBoxCoordinates>>& Kept) {
+		// the second person overlaps the first and is dropped
+		const TArray<TPair<int32, float>> Expected = { { 0, 0.9f }, { 2, 0.7f }, { 79, 0.99f } };
+		if (Kept.Num() != Expected.Num()) {
+			UE_LOG(LogTemp, Error, TEXT("Suppress: %d boxes kept, expected %d"), Kept.Num(), Expected.Num());
+			return false;
+		}
+		for (int32 i = 0; i < Expected.Num(); i++) {
+			if (Kept[i].Key != Expected[i].Key || Kept[i].Value.confidence != Expected[i].Value) {
+				UE_LOG(LogTemp, Error, TEXT("Suppress: box %d is class %d (%f), expected class %d (%f)"), i, Kept[i].Key,
+					Kept[i].Value.confidence, Expected[i].Key, Expected[i].Value);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// malloc and realloc calls GMalloc has served so far, from all threads, read from the allocator stats. -1 when the
+	// allocator does not count them (builds without stats), allocation budgets are not checked then
+	inline int64 GetAllocatorCalls() {
+#if STATS
+		FGenericMemoryStats Stats;
+		GMalloc->GetAllocatorStats(Stats);
+		const SIZE_T* Mallocs = Stats.Data.Find(TEXT("Malloc calls"));
+		const SIZE_T* Reallocs = Stats.Data.Find(TEXT("Realloc calls"));
+		if (Mallocs != nullptr && Reallocs != nullptr) {
+			return static_cast<int64>(*Mallocs + *Reallocs);
+		}
+#endif
+		return -1;
+	}
+}
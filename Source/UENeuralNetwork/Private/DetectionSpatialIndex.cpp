@@ -0,0 +1,269 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DetectionSpatialIndex.h"
+
+#include "Algo/Sort.h"
+#include "Misc/ScopeLock.h"
+
+namespace {
+    FCriticalSection SnapshotLock;
+    TSharedPtr<FDetectionSpatialIndex, ESPMode::ThreadSafe> LatestSnapshot;
+    // the snapshot before the latest one, rebuilt in place once nobody holds it anymore so its arrays are reused
+    TSharedPtr<FDetectionSpatialIndex, ESPMode::ThreadSafe> SpareSnapshot;
+    // serializes builders (one per capture manager)
+    FCriticalSection BuildLock;
+
+    constexpr float CellSize = 1.f / FDetectionSpatialIndex::GridSize;
+}
+
+FDetectionHit MakeDetectionHit(int32 ClassIndex, const UMyNeuralNetwork::FBoxCoordinates& Box, float ScaleX, float ScaleY) {
+    FDetectionHit Hit;
+    Hit.ClassIndex = ClassIndex;
+    Hit.Score = Box.confidence;
+    Hit.Box = FBox2D(FVector2D(Box.x1 * ScaleX, Box.y1 * ScaleY), FVector2D((Box.x1 + Box.width) * ScaleX, (Box.y1 + Box.height) * ScaleY));
+    Hit.WorldLocation = Box.worldLocation;
+    Hit.WorldExtent = Box.worldExtent;
+    Hit.Depth = Box.depth;
+    return Hit;
+}
+
+FDetectionSpatialIndex::FSnapshot FDetectionSpatialIndex::GetLatest() {
+    FScopeLock Lock(&SnapshotLock);
+    return LatestSnapshot;
+}
+
+void FDetectionSpatialIndex::Publish(const FBoxCoordinatesMap& Boxes, int32 ModelWidth, int32 ModelHeight, int64 FrameId) {
+    FScopeLock Build(&BuildLock);
+    TSharedPtr<FDetectionSpatialIndex, ESPMode::ThreadSafe> Snapshot = SpareSnapshot.IsUnique()
+        ? MoveTemp(SpareSnapshot) : MakeShared<FDetectionSpatialIndex, ESPMode::ThreadSafe>();
+    SpareSnapshot.Reset();
+    Snapshot->Build(Boxes, 1.f / FMath::Max(ModelWidth, 1), 1.f / FMath::Max(ModelHeight, 1), FrameId);
+
+    FScopeLock Lock(&SnapshotLock);
+    SpareSnapshot = MoveTemp(LatestSnapshot);
+    LatestSnapshot = MoveTemp(Snapshot);
+}
+
+void FDetectionSpatialIndex::Build(const FBoxCoordinatesMap& Boxes, float ScaleX, float ScaleY, int64 InFrameId) {
+    FrameId = InFrameId;
+    NumHits = 0;
+    NumGrids = 0;
+    for (const auto& Pair : Boxes) {
+        if (Pair.Value.Num() == 0) {
+            continue;
+        }
+        FClassGrid& Grid = NumGrids < Grids.Num() ? Grids[NumGrids] : Grids.AddDefaulted_GetRef();
+        NumGrids++;
+        Grid.ClassIndex = Pair.Key;
+        Grid.Hits.Reset();
+        for (const UMyNeuralNetwork::FBoxCoordinates& Box : Pair.Value) {
+            Grid.Hits.Add(MakeDetectionHit(Pair.Key, Box, ScaleX, ScaleY));
+        }
+        NumHits += Grid.Hits.Num();
+
+        // counting sort of (cell, item) pairs: count, prefix sum, scatter
+        constexpr int32 NumCells = GridSize * GridSize;
+        Grid.CellStart.Reset();
+        Grid.CellStart.SetNumZeroed(NumCells + 1);
+        for (const FDetectionHit& Hit : Grid.Hits) {
+            for (int32 Y = ToCell(Hit.Box.Min.Y); Y <= ToCell(Hit.Box.Max.Y); Y++) {
+                for (int32 X = ToCell(Hit.Box.Min.X); X <= ToCell(Hit.Box.Max.X); X++) {
+                    Grid.CellStart[Y * GridSize + X]++;
+                }
+            }
+        }
+        int32 Total = 0;
+        for (int32 Cell = 0; Cell < NumCells; Cell++) {
+            const int32 Count = Grid.CellStart[Cell];
+            Grid.CellStart[Cell] = Total;
+            Total += Count;
+        }
+        Grid.CellStart[NumCells] = Total;
+        Grid.CellItems.SetNumUninitialized(Total, false);
+        for (int32 Item = 0; Item < Grid.Hits.Num(); Item++) {
+            const FBox2D& Box = Grid.Hits[Item].Box;
+            for (int32 Y = ToCell(Box.Min.Y); Y <= ToCell(Box.Max.Y); Y++) {
+                for (int32 X = ToCell(Box.Min.X); X <= ToCell(Box.Max.X); X++) {
+                    Grid.CellItems[Grid.CellStart[Y * GridSize + X]++] = Item;
+                }
+            }
+        }
+        // the scatter advanced every start to the next cell's start, shift back
+        for (int32 Cell = NumCells; Cell > 0; Cell--) {
+            Grid.CellStart[Cell] = Grid.CellStart[Cell - 1];
+        }
+        Grid.CellStart[0] = 0;
+    }
+}
+
+const FDetectionSpatialIndex::FClassGrid* FDetectionSpatialIndex::FindGrid(int32 ClassIndex) const {
+    for (int32 Index = 0; Index < NumGrids; Index++) {
+        if (Grids[Index].ClassIndex == ClassIndex) {
+            return &Grids[Index];
+        }
+    }
+    return nullptr;
+}
+
+template <typename FunctorType>
+void FDetectionSpatialIndex::ForEachGrid(int32 ClassIndex, FunctorType&& Functor) const {
+    if (ClassIndex >= 0) {
+        if (const FClassGrid* Grid = FindGrid(ClassIndex)) {
+            Functor(*Grid);
+        }
+        return;
+    }
+    for (int32 Index = 0; Index < NumGrids; Index++) {
+        Functor(Grids[Index]);
+    }
+}
+
+void FDetectionSpatialIndex::QueryRegion(const FClassGrid& Grid, const FBox2D& Region, TArray<FDetectionHit>& Out) const {
+    const int32 MinX = ToCell(Region.Min.X);
+    const int32 MinY = ToCell(Region.Min.Y);
+    const int32 MaxX = ToCell(Region.Max.X);
+    const int32 MaxY = ToCell(Region.Max.Y);
+    for (int32 Y = MinY; Y <= MaxY; Y++) {
+        for (int32 X = MinX; X <= MaxX; X++) {
+            const int32 Cell = Y * GridSize + X;
+            for (int32 Slot = Grid.CellStart[Cell]; Slot < Grid.CellStart[Cell + 1]; Slot++) {
+                const FDetectionHit& Hit = Grid.Hits[Grid.CellItems[Slot]];
+                if (!Hit.Box.Intersect(Region)) {
+                    continue;
+                }
+                // a box overlapping several visited cells is reported only from the cell holding the min corner of the
+                // overlap, so no dedup set is needed
+                if (ToCell(FMath::Max(Region.Min.X, Hit.Box.Min.X)) == X && ToCell(FMath::Max(Region.Min.Y, Hit.Box.Min.Y)) == Y) {
+                    Out.Add(Hit);
+                }
+            }
+        }
+    }
+}
+
+void FDetectionSpatialIndex::QueryRegion(const FBox2D& Region, int32 ClassIndex, TArray<FDetectionHit>& Out) const {
+    ForEachGrid(ClassIndex, [&](const FClassGrid& Grid) { QueryRegion(Grid, Region, Out); });
+}
+
+void FDetectionSpatialIndex::QueryPoint(const FVector2D& Point, int32 ClassIndex, TArray<FDetectionHit>& Out) const {
+    if (Point.X < 0.f || Point.Y < 0.f || Point.X > 1.f || Point.Y > 1.f) {
+        return;
+    }
+    const int32 Cell = ToCell(Point.Y) * GridSize + ToCell(Point.X);
+    ForEachGrid(ClassIndex, [&](const FClassGrid& Grid) {
+        for (int32 Slot = Grid.CellStart[Cell]; Slot < Grid.CellStart[Cell + 1]; Slot++) {
+            const FDetectionHit& Hit = Grid.Hits[Grid.CellItems[Slot]];
+            if (Hit.Box.IsInside(Point)) {
+                Out.Add(Hit);
+            }
+        }
+    });
+}
+
+void FDetectionSpatialIndex::QueryClass(int32 ClassIndex, TArray<FDetectionHit>& Out) const {
+    ForEachGrid(ClassIndex, [&](const FClassGrid& Grid) { Out.Append(Grid.Hits); });
+}
+
+void FDetectionSpatialIndex::QueryNearest(const FClassGrid& Grid, const FVector2D& Point, int32 K, TArray<FDetectionHit>& Best) const {
+    // (distance, item), sorted, at most K
+    TArray<TPair<float, int32>, TInlineAllocator<16>> Nearest;
+    auto Consider = [&](int32 Item) {
+        for (const TPair<float, int32>& Entry : Nearest) {
+            if (Entry.Value == Item) {
+                return;
+            }
+        }
+        const float Distance = FMath::Sqrt(Grid.Hits[Item].Box.ComputeSquaredDistanceToPoint(Point));
+        if (Nearest.Num() == K && Distance >= Nearest.Last().Key) {
+            return;
+        }
+        int32 Insert = Nearest.Num();
+        while (Insert > 0 && Nearest[Insert - 1].Key > Distance) {
+            Insert--;
+        }
+        Nearest.Insert(TPair<float, int32>(Distance, Item), Insert);
+        if (Nearest.Num() > K) {
+            Nearest.Pop(false);
+        }
+    };
+
+    // rings of cells around the point's cell. a box not seen yet lies outside the rings visited so far, so once the K-th
+    // distance is within the inner radius of the next ring nothing closer can follow (only holds for points on the view)
+    const bool bOnView = Point.X >= 0.f && Point.Y >= 0.f && Point.X <= 1.f && Point.Y <= 1.f;
+    const int32 PX = ToCell(Point.X);
+    const int32 PY = ToCell(Point.Y);
+    for (int32 Ring = 0; Ring < GridSize; Ring++) {
+        if (bOnView && Nearest.Num() == K && Nearest.Last().Key <= (Ring - 1) * CellSize) {
+            break;
+        }
+        for (int32 Y = FMath::Max(PY - Ring, 0); Y <= FMath::Min(PY + Ring, GridSize - 1); Y++) {
+            const bool bEdgeRow = Y == PY - Ring || Y == PY + Ring;
+            for (int32 X = FMath::Max(PX - Ring, 0); X <= FMath::Min(PX + Ring, GridSize - 1); X++) {
+                if (!bEdgeRow && X != PX - Ring && X != PX + Ring) {
+                    // interior of the ring, visited by an earlier ring
+                    X = PX + Ring - 1;
+                    continue;
+                }
+                const int32 Cell = Y * GridSize + X;
+                for (int32 Slot = Grid.CellStart[Cell]; Slot < Grid.CellStart[Cell + 1]; Slot++) {
+                    Consider(Grid.CellItems[Slot]);
+                }
+            }
+        }
+    }
+
+    for (const TPair<float, int32>& Entry : Nearest) {
+        FDetectionHit& Hit = Best.Add_GetRef(Grid.Hits[Entry.Value]);
+        Hit.Distance = Entry.Key;
+    }
+}
+
+void FDetectionSpatialIndex::QueryNearest(const FVector2D& Point, int32 K, int32 ClassIndex, TArray<FDetectionHit>& Out) const {
+    if (K <= 0) {
+        return;
+    }
+    const int32 First = Out.Num();
+    ForEachGrid(ClassIndex, [&](const FClassGrid& Grid) { QueryNearest(Grid, Point, K, Out); });
+    // K per class, keep the K closest overall
+    if (Out.Num() - First > K) {
+        Algo::SortBy(MakeArrayView(Out.GetData() + First, Out.Num() - First), &FDetectionHit::Distance);
+        Out.SetNum(First + K, false);
+    }
+}
+
+bool UDetectionQueryLibrary::FindDetectionsInRegion(FBox2D Region, int32 ClassIndex, TArray<FDetectionHit>& OutHits) {
+    OutHits.Reset();
+    if (const FDetectionSpatialIndex::FSnapshot Snapshot = FDetectionSpatialIndex::GetLatest()) {
+        Snapshot->QueryRegion(Region, ClassIndex, OutHits);
+    }
+    return OutHits.Num() > 0;
+}
+
+bool UDetectionQueryLibrary::FindDetectionsAtPoint(FVector2D Point, int32 ClassIndex, TArray<FDetectionHit>& OutHits) {
+    OutHits.Reset();
+    if (const FDetectionSpatialIndex::FSnapshot Snapshot = FDetectionSpatialIndex::GetLatest()) {
+        Snapshot->QueryPoint(Point, ClassIndex, OutHits);
+    }
+    return OutHits.Num() > 0;
+}
+
+bool UDetectionQueryLibrary::FindNearestDetections(FVector2D Point, int32 Count, int32 ClassIndex, TArray<FDetectionHit>& OutHits) {
+    OutHits.Reset();
+    if (const FDetectionSpatialIndex::FSnapshot Snapshot = FDetectionSpatialIndex::GetLatest()) {
+        Snapshot->QueryNearest(Point, Count, ClassIndex, OutHits);
+    }
+    return OutHits.Num() > 0;
+}
+
+bool UDetectionQueryLibrary::FindDetectionsOfClass(int32 ClassIndex, TArray<FDetectionHit>& OutHits) {
+    OutHits.Reset();
+    if (const FDetectionSpatialIndex::FSnapshot Snapshot = FDetectionSpatialIndex::GetLatest()) {
+        Snapshot->QueryClass(ClassIndex, OutHits);
+    }
+    return OutHits.Num() > 0;
+}
+
+int64 UDetectionQueryLibrary::GetDetectionFrameId() {
+    const FDetectionSpatialIndex::FSnapshot Snapshot = FDetectionSpatialIndex::GetLatest();
+    return Snapshot ? Snapshot->GetFrameId() : -1;
+}
@@ -0,0 +1,155 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DetectionStream.h"
+
+#include "HAL/IConsoleManager.h"
+#include "Misc/CoreDelegates.h"
+
+static TAutoConsoleVariable<int32> CVarNNStreamEnable(
+    TEXT("nn.Stream.Enable"), 0,
+    TEXT("Publish detections to the shared-memory stream for out-of-process readers."),
+    ECVF_Default);
+
+static TAutoConsoleVariable<FString> CVarNNStreamName(
+    TEXT("nn.Stream.Name"), ANSI_TO_TCHAR(DetectionStream::kDefaultName),
+    TEXT("Name of the shared-memory region."),
+    ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarNNStreamCapacity(
+    TEXT("nn.Stream.Capacity"), 4096,
+    TEXT("Detection records kept in the ring (rounded up to a power of two)."),
+    ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarNNStreamPublishFrames(
+    TEXT("nn.Stream.PublishFrames"), 0,
+    TEXT("Also publish the latest captured frame (bgra) next to the records."),
+    ECVF_Default);
+
+namespace {
+    // largest frame the slot is sized for
+    constexpr uint32 MaxFrameBytes = 1920 * 1080 * 4;
+}
+
+FDetectionStreamWriter& FDetectionStreamWriter::Get() {
+    static FDetectionStreamWriter Instance;
+    return Instance;
+}
+
+bool FDetectionStreamWriter::Open() {
+    using namespace DetectionStream;
+
+    const uint32 Capacity = FMath::RoundUpToPowerOfTwo(static_cast<uint32>(FMath::Max(CVarNNStreamCapacity.GetValueOnAnyThread(), 64)));
+    const uint32 FrameBytes = CVarNNStreamPublishFrames.GetValueOnAnyThread() != 0 ? MaxFrameBytes : 0;
+    const FString Name = CVarNNStreamName.GetValueOnAnyThread();
+
+    Region = FPlatformMemory::MapNamedSharedMemoryRegion(Name, true,
+        static_cast<uint32>(FPlatformMemory::ESharedMemoryAccess::Read) | static_cast<uint32>(FPlatformMemory::ESharedMemoryAccess::Write),
+        RegionSize(Capacity, FrameBytes));
+    if (Region == nullptr) {
+        UE_LOG(LogTemp, Error, TEXT("Detection stream: could not create shared memory region %s"), *Name);
+        return false;
+    }
+
+    uint8* Base = static_cast<uint8*>(Region->GetAddress());
+    FMemory::Memzero(Base, RegionSize(Capacity, FrameBytes));
+    Header = reinterpret_cast<DetectionStream::Header*>(Base);
+    Slots = reinterpret_cast<RecordSlot*>(Base + RecordsOffset());
+    FrameSlot = FrameBytes > 0 ? reinterpret_cast<FrameSlotHeader*>(Base + FrameSlotOffset(Capacity)) : nullptr;
+    FramePixels = FrameSlot != nullptr ? reinterpret_cast<uint8*>(FrameSlot + 1) : nullptr;
+
+    Header->Version = kVersion;
+    Header->RecordCapacity = Capacity;
+    Header->RecordSlotSize = sizeof(RecordSlot);
+    Header->RecordsOffset = RecordsOffset();
+    Header->FrameSlotOffset = FrameSlot != nullptr ? FrameSlotOffset(Capacity) : 0;
+    Header->FrameMaxBytes = FrameBytes;
+    Header->WriteSequence.store(0, std::memory_order_relaxed);
+    // readers wait for the magic before trusting the rest of the header
+    Header->Magic.store(kMagic, std::memory_order_release);
+    NextSequence = 0;
+    NextFrameSequence = 0;
+
+    static bool bRegisteredExit = false;
+    if (!bRegisteredExit) {
+        bRegisteredExit = true;
+        FCoreDelegates::OnPreExit.AddLambda([]() { FDetectionStreamWriter::Get().Close(); });
+    }
+    UE_LOG(LogTemp, Log, TEXT("Detection stream: publishing to %s (%u records%s)"), *Name, Capacity, FrameSlot ? TEXT(", frames") : TEXT(""));
+    return true;
+}
+
+void FDetectionStreamWriter::Close() {
+    FScopeLock Lock(&ProducerLock);
+    if (Region != nullptr) {
+        FPlatformMemory::UnmapNamedSharedMemoryRegion(Region);
+        Region = nullptr;
+        Header = nullptr;
+        Slots = nullptr;
+        FrameSlot = nullptr;
+        FramePixels = nullptr;
+    }
+}
+
+void FDetectionStreamWriter::Publish(uint64 FrameId, uint64 TimestampNs, const FBoxCoordinatesMap& Boxes, const FColor* Pixels, int32 Width, int32 Height) {
+    using namespace DetectionStream;
+
+    FScopeLock Lock(&ProducerLock);
+    if (CVarNNStreamEnable.GetValueOnAnyThread() == 0) {
+        if (Region != nullptr) {
+            Close();
+        }
+        bOpenFailed = false;
+        return;
+    }
+
+    if (bOpenFailed) {
+        return;
+    }
+    if (Region == nullptr && !Open()) {
+        bOpenFailed = true;
+        return;
+    }
+
+    uint32 Count = 0;
+    for (const auto& Pair : Boxes) {
+        Count += Pair.Value.Num();
+    }
+
+    const uint32 Mask = Header->RecordCapacity - 1;
+    auto WriteRecord = [&](const Record& Data) {
+        RecordSlot& Slot = Slots[NextSequence & Mask];
+        Slot.Sequence.store(NextSequence * 2 + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        Slot.Data = Data;
+        Slot.Sequence.store(NextSequence * 2 + 2, std::memory_order_release);
+        NextSequence++;
+    };
+
+    if (Count == 0) {
+        // readers still learn that this frame was processed
+        WriteRecord(Record{ FrameId, TimestampNs, -1, 0.f, 0.f, 0.f, 0.f, 0.f, 0, 0 });
+    }
+    uint32 Index = 0;
+    for (const auto& Pair : Boxes) {
+        for (const UMyNeuralNetwork::FBoxCoordinates& Box : Pair.Value) {
+            WriteRecord(Record{ FrameId, TimestampNs, Pair.Key, Box.confidence, Box.x1, Box.y1, Box.width, Box.height, Index++, Count });
+        }
+    }
+    Header->WriteSequence.store(NextSequence, std::memory_order_release);
+
+    const uint32 FrameBytes = static_cast<uint32>(Width * Height * sizeof(FColor));
+    if (FrameSlot != nullptr && Pixels != nullptr && FrameBytes <= Header->FrameMaxBytes) {
+        // seqlock: odd while the pixels are copied
+        FrameSlot->Sequence.store(NextFrameSequence * 2 + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        FrameSlot->FrameId = FrameId;
+        FrameSlot->TimestampNs = TimestampNs;
+        FrameSlot->Width = Width;
+        FrameSlot->Height = Height;
+        FrameSlot->Format = EFrameFormat::BGRA8;
+        FrameSlot->Bytes = FrameBytes;
+        FMemory::Memcpy(FramePixels, Pixels, FrameBytes);
+        FrameSlot->Sequence.store(NextFrameSequence * 2 + 2, std::memory_order_release);
+        NextFrameSequence++;
+    }
+}
@@ -0,0 +1,93 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DetectionViewExtension.h"
+
+#include "Engine/TextureRenderTarget2D.h"
+#include "RenderGraphUtils.h"
+#include "ScreenPass.h"
+#include "SceneRendering.h"
+#include "PostProcess/PostProcessMaterial.h"
+#include "PipelineMemory.h"
+
+FDetectionViewExtension::FDetectionViewExtension(const FAutoRegister& AutoRegister, UWorld* InWorld)
+    : FSceneViewExtensionBase(AutoRegister), World(InWorld) {
+}
+
+void FDetectionViewExtension::SetTarget(UTextureRenderTarget2D* InTarget) {
+    FTextureRenderTargetResource* Resource = InTarget != nullptr ? InTarget->GameThread_GetRenderTargetResource() : nullptr;
+    if (Resource == GameThreadTarget) {
+        return;
+    }
+    GameThreadTarget = Resource;
+    // the old resource is released by render commands enqueued before this one, so it is never drawn to after that
+    TSharedRef<FDetectionViewExtension, ESPMode::ThreadSafe> This = StaticCastSharedRef<FDetectionViewExtension>(AsShared());
+    ENQUEUE_RENDER_COMMAND(SetDetectionCaptureTarget)([This, Resource](FRHICommandListImmediate& RHICmdList) {
+        This->Target = Resource;
+        This->CopiedView = FCaptureView();
+        });
+}
+
+FIntRect FDetectionViewExtension::GetCropRect(const FIntRect& ViewRect, FIntPoint TargetSize) {
+    const FIntPoint ViewSize = ViewRect.Size();
+    if (ViewSize.X <= 0 || ViewSize.Y <= 0 || TargetSize.X <= 0 || TargetSize.Y <= 0) {
+        return ViewRect;
+    }
+    // keep the full height of a wider view and the full width of a taller one
+    FIntPoint CropSize = ViewSize;
+    if (static_cast<int64>(ViewSize.X) * TargetSize.Y > static_cast<int64>(ViewSize.Y) * TargetSize.X) {
+        CropSize.X = static_cast<int32>(static_cast<int64>(ViewSize.Y) * TargetSize.X / TargetSize.Y);
+    } else {
+        CropSize.Y = static_cast<int32>(static_cast<int64>(ViewSize.X) * TargetSize.Y / TargetSize.X);
+    }
+    const FIntPoint Min = ViewRect.Min + (ViewSize - CropSize) / 2;
+    return FIntRect(Min, Min + CropSize);
+}
+
+float FDetectionViewExtension::GetCroppedFOV(float FOVDegrees, FIntPoint ViewSize, FIntPoint TargetSize) {
+    const FIntPoint CropSize = GetCropRect(FIntRect(FIntPoint::ZeroValue, ViewSize), TargetSize).Size();
+    if (ViewSize.X <= 0 || CropSize.X == ViewSize.X) {
+        return FOVDegrees;
+    }
+    const float HalfTan = FMath::Tan(FMath::DegreesToRadians(FOVDegrees * 0.5f)) * CropSize.X / ViewSize.X;
+    return FMath::RadiansToDegrees(FMath::Atan(HalfTan)) * 2.f;
+}
+
+bool FDetectionViewExtension::IsActiveThisFrame_Internal(const FSceneViewExtensionContext& Context) const {
+    // scene captures (Viewport null) and other worlds' viewports render without the copy
+    return bEnabled && Context.Viewport != nullptr && World.IsValid() && Context.GetWorld() == World.Get();
+}
+
+void FDetectionViewExtension::SubscribeToPostProcessingPass(EPostProcessingPass Pass, FAfterPassCallbackDelegateArray& InOutPassCallbacks, bool bIsPassEnabled) {
+    if (Pass == EPostProcessingPass::Tonemap && bIsPassEnabled) {
+        InOutPassCallbacks.Add(FAfterPassCallbackDelegate::CreateRaw(this, &FDetectionViewExtension::CopyAfterTonemap_RenderThread));
+    }
+}
+
+FScreenPassTexture FDetectionViewExtension::CopyAfterTonemap_RenderThread(FRDGBuilder& GraphBuilder, const FSceneView& View, const FPostProcessMaterialInputs& Inputs) {
+    LLM_SCOPE_BYTAG(DetectionPipeline_Capture);
+    const FScreenPassTexture SceneColor = Inputs.GetInput(EPostProcessMaterialInput::SceneColor);
+    check(View.bIsViewInfo);
+    const FViewInfo& ViewInfo = static_cast<const FViewInfo&>(View);
+
+    // split screen / stereo: only the first view
+    if (Target != nullptr && SceneColor.IsValid() && View.Family->Views.Num() > 0 && View.Family->Views[0] == &View) {
+        RDG_EVENT_SCOPE(GraphBuilder, "DetectionCapture");
+        const FIntPoint TargetSize = Target->GetSizeXY();
+        const FScreenPassTexture Crop(SceneColor.Texture, GetCropRect(SceneColor.ViewRect, TargetSize));
+        FRDGTextureRef TargetTexture = RegisterExternalTexture(GraphBuilder, Target->GetRenderTargetTexture(), TEXT("DetectionCaptureTarget"));
+        // bilinear downsample into the whole target
+        AddDrawTexturePass(GraphBuilder, ViewInfo, Crop, FScreenPassRenderTarget(TargetTexture, ERenderTargetLoadAction::ENoAction));
+
+        CopiedView.Transform = FTransform(View.ViewRotation, View.ViewLocation);
+        CopiedView.FOVDegrees = GetCroppedFOV(View.FOV, SceneColor.ViewRect.Size(), TargetSize);
+        CopiedView.Width = TargetSize.X;
+        CopiedView.Height = TargetSize.Y;
+    }
+
+    // the view itself is left as it is
+    if (Inputs.OverrideOutput.IsValid()) {
+        AddDrawTexturePass(GraphBuilder, ViewInfo, SceneColor, Inputs.OverrideOutput);
+        return Inputs.OverrideOutput;
+    }
+    return SceneColor;
+}
@@ -0,0 +1,222 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "FrameTrace.h"
+
+#include "Containers/CircularQueue.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "HAL/ThreadManager.h"
+#include "Misc/Paths.h"
+
+std::atomic<bool> FFrameTrace::bEnabled{ false };
+
+namespace {
+    struct FTraceEvent {
+        const TCHAR* Name;
+        int64 FrameId;
+        uint64 StartCycles;
+        uint64 EndCycles;
+        uint32 ThreadId;
+        EFrameTraceFlow Flow;
+        // recording session the event belongs to, a slice that ends after Stop is not written into the next file
+        uint32 Session;
+    };
+
+    // bumped by every Start
+    std::atomic<uint32> TraceSession{ 0 };
+
+    // single producer (the owning thread), single consumer (the writer)
+    struct FThreadBuffer {
+        TCircularQueue<FTraceEvent> Events{ 16 * 1024 };
+        uint32 ThreadId = 0;
+        FString ThreadName;
+        std::atomic<int32> Dropped{ 0 };
+    };
+
+    class FTraceWriter : public FRunnable {
+    public:
+        // buffers live until exit: thread_local pointers to them must stay valid across start/stop
+        TArray<TUniquePtr<FThreadBuffer>> Buffers;
+        FCriticalSection BuffersLock;
+
+        FThreadBuffer& GetThreadBuffer() {
+            thread_local FThreadBuffer* Buffer = nullptr;
+            if (Buffer == nullptr) {
+                TUniquePtr<FThreadBuffer> NewBuffer = MakeUnique<FThreadBuffer>();
+                NewBuffer->ThreadId = FPlatformTLS::GetCurrentThreadId();
+                NewBuffer->ThreadName = FThreadManager::GetThreadName(NewBuffer->ThreadId);
+                Buffer = NewBuffer.Get();
+                FScopeLock Lock(&BuffersLock);
+                Buffers.Add(MoveTemp(NewBuffer));
+            }
+            return *Buffer;
+        }
+
+        bool Open(const FString& Filename) {
+            Archive.Reset(IFileManager::Get().CreateFileWriter(*Filename));
+            if (!Archive) {
+                return false;
+            }
+            Session = ++TraceSession;
+            {
+                FScopeLock Lock(&BuffersLock);
+                for (const TUniquePtr<FThreadBuffer>& Buffer : Buffers) {
+                    Buffer->Dropped = 0;
+                }
+            }
+            BaseCycles = FPlatformTime::Cycles64();
+            bFirstEvent = true;
+            WriteRaw(TEXT("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"));
+            WriteMetadata(static_cast<uint32>(EFrameTraceTrack::FenceWait), TEXT("Wait: render fence"));
+            WriteMetadata(static_cast<uint32>(EFrameTraceTrack::QueueWait), TEXT("Wait: inference queue"));
+            bStopping = false;
+            Thread.Reset(FRunnableThread::Create(this, TEXT("DetectionTraceWriter"), 0, TPri_Lowest));
+            return true;
+        }
+
+        void Close() {
+            bStopping = true;
+            if (Thread) {
+                Thread->WaitForCompletion();
+                Thread.Reset();
+            }
+            Drain();
+            WriteRaw(TEXT("\n]}\n"));
+            Archive->Close();
+            Archive.Reset();
+            WrittenThreads.Reset();
+        }
+
+        virtual uint32 Run() override {
+            while (!bStopping) {
+                Drain();
+                FPlatformProcess::Sleep(0.05f);
+            }
+            return 0;
+        }
+
+    private:
+        TUniquePtr<FArchive> Archive;
+        TUniquePtr<FRunnableThread> Thread;
+        std::atomic<bool> bStopping{ false };
+        uint64 BaseCycles = 0;
+        uint32 Session = 0;
+        bool bFirstEvent = true;
+        TSet<uint32> WrittenThreads;
+
+        double ToMicroseconds(uint64 Cycles) const {
+            return (static_cast<int64>(Cycles) - static_cast<int64>(BaseCycles)) * FPlatformTime::GetSecondsPerCycle64() * 1000000.0;
+        }
+
+        void WriteRaw(const FString& Text) {
+            FTCHARToUTF8 Utf8(*Text);
+            Archive->Serialize(const_cast<ANSICHAR*>(Utf8.Get()), Utf8.Length());
+        }
+
+        void WriteEvent(const FString& Json) {
+            WriteRaw(bFirstEvent ? Json : TEXT(",\n") + Json);
+            bFirstEvent = false;
+        }
+
+        void WriteMetadata(uint32 ThreadId, const FString& Name) {
+            WriteEvent(FString::Printf(TEXT("{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}"),
+                ThreadId, *Name.ReplaceCharWithEscapedChar()));
+        }
+
+        void Drain() {
+            // buffers are never removed, so the pointers stay valid. the file is written without the lock, a thread's first
+            // slice never waits for the disk
+            TArray<FThreadBuffer*, TInlineAllocator<64>> Snapshot;
+            {
+                FScopeLock Lock(&BuffersLock);
+                for (const TUniquePtr<FThreadBuffer>& Buffer : Buffers) {
+                    Snapshot.Add(Buffer.Get());
+                }
+            }
+            for (FThreadBuffer* Buffer : Snapshot) {
+                if (!WrittenThreads.Contains(Buffer->ThreadId)) {
+                    WrittenThreads.Add(Buffer->ThreadId);
+                    WriteMetadata(Buffer->ThreadId, Buffer->ThreadName.IsEmpty() ? FString::FromInt(Buffer->ThreadId) : Buffer->ThreadName);
+                }
+                FTraceEvent Event;
+                while (Buffer->Events.Dequeue(Event)) {
+                    if (Event.Session == Session) {
+                        WriteSlice(Event);
+                    }
+                }
+                const int32 Dropped = Buffer->Dropped.exchange(0);
+                if (Dropped > 0) {
+                    UE_LOG(LogTemp, Warning, TEXT("Trace: dropped %d events on thread %s"), Dropped, *Buffer->ThreadName);
+                }
+            }
+        }
+
+        void WriteSlice(const FTraceEvent& Event) {
+            const double Ts = ToMicroseconds(Event.StartCycles);
+            const double Dur = FMath::Max(0.0, ToMicroseconds(Event.EndCycles) - Ts);
+            WriteEvent(FString::Printf(TEXT("{\"ph\":\"X\",\"name\":\"%s\",\"cat\":\"detection\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%lld}}"),
+                Event.Name, Event.ThreadId, Ts, Dur, Event.FrameId));
+
+            if (Event.FrameId < 0 || Event.Flow == EFrameTraceFlow::None) {
+                return;
+            }
+            // flow events bind to the slice that encloses their timestamp on the same thread
+            const TCHAR* Phase = Event.Flow == EFrameTraceFlow::Start ? TEXT("s") : Event.Flow == EFrameTraceFlow::End ? TEXT("f") : TEXT("t");
+            WriteEvent(FString::Printf(TEXT("{\"ph\":\"%s\",\"name\":\"frame\",\"cat\":\"detection\",\"id\":%lld,\"pid\":1,\"tid\":%u,\"ts\":%.3f%s}"),
+                Phase, Event.FrameId, Event.ThreadId, Ts, Event.Flow == EFrameTraceFlow::End ? TEXT(",\"bp\":\"e\"") : TEXT("")));
+        }
+    };
+
+    FTraceWriter& GetWriter() {
+        static FTraceWriter Writer;
+        return Writer;
+    }
+}
+
+void FFrameTrace::Start(const FString& Filename) {
+    if (IsEnabled()) {
+        return;
+    }
+    if (!GetWriter().Open(Filename)) {
+        UE_LOG(LogTemp, Error, TEXT("Trace: could not open %s"), *Filename);
+        return;
+    }
+    bEnabled = true;
+    UE_LOG(LogTemp, Log, TEXT("Trace: recording to %s"), *Filename);
+}
+
+void FFrameTrace::Stop() {
+    if (!IsEnabled()) {
+        return;
+    }
+    bEnabled = false;
+    GetWriter().Close();
+    UE_LOG(LogTemp, Log, TEXT("Trace: stopped"));
+}
+
+void FFrameTrace::AddSlice(const TCHAR* Name, int64 FrameId, uint64 StartCycles, uint64 EndCycles, EFrameTraceFlow Flow, EFrameTraceTrack Track) {
+    if (!IsEnabled()) {
+        return;
+    }
+    FThreadBuffer& Buffer = GetWriter().GetThreadBuffer();
+    const uint32 ThreadId = Track == EFrameTraceTrack::CurrentThread ? Buffer.ThreadId : static_cast<uint32>(Track);
+    if (!Buffer.Events.Enqueue(FTraceEvent{ Name, FrameId, StartCycles, EndCycles, ThreadId, Flow, TraceSession.load(std::memory_order_relaxed) })) {
+        Buffer.Dropped++;
+    }
+}
+
+static FAutoConsoleCommand TraceStartCommand(
+    TEXT("nn.Trace.Start"),
+    TEXT("Start recording the detection pipeline timeline as Chrome trace JSON. Optional argument: output file."),
+    FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args) {
+        const FString Filename = Args.Num() > 0 ? Args[0] : FPaths::Combine(FPaths::ProfilingDir(),
+            FString::Printf(TEXT("DetectionTrace_%s.json"), *FDateTime::Now().ToString()));
+        FFrameTrace::Start(Filename);
+        }));
+
+static FAutoConsoleCommand TraceStopCommand(
+    TEXT("nn.Trace.Stop"),
+    TEXT("Stop recording the detection pipeline timeline and close the file."),
+    FConsoleCommandDelegate::CreateLambda([]() { FFrameTrace::Stop(); }));
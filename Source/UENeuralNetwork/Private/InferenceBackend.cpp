@@ -0,0 +1,83 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "InferenceBackend.h"
+
+#include "HAL/IConsoleManager.h"
+#include "NeuralNetwork.h"
+
+static TAutoConsoleVariable<FString> CVarNNBackend(
+    TEXT("nn.Backend"), TEXT("NNI"),
+    TEXT("Runtime that runs the detection models: NNI (engine plugin, CPU or GPU) or ORT (ONNX Runtime, CPU).\n")
+    TEXT("Read when a model is set, so set it per machine in the [ConsoleVariables] section of an ini."),
+    ECVF_Default);
+
+namespace {
+    FInferenceTensorInfo GetTensorInfo(const FNeuralTensor& Tensor) {
+        FInferenceTensorInfo Info;
+        Info.Sizes = Tensor.GetSizes();
+        Info.Bytes = Tensor.NumInBytes();
+        // NNI does not expose a uint8 data type enum, so look at the element size instead
+        Info.ElementBytes = static_cast<int32>(Info.Bytes / FMath::Max<int64>(Tensor.Num(), 1));
+        return Info;
+    }
+
+    // the engine plugin, on the model asset itself. the device type is set on the asset (nn.UseGPU)
+    class FNNIInferenceBackend : public IInferenceBackend {
+    public:
+        explicit FNNIInferenceBackend(UNeuralNetwork* InNetwork) : Network(InNetwork) {}
+
+        virtual const TCHAR* GetName() const override {
+            return TEXT("NNI");
+        }
+
+        virtual FInferenceTensorInfo GetInputInfo() const override {
+            return GetTensorInfo(Network->GetInputTensor());
+        }
+
+        virtual int32 GetNumOutputs() const override {
+            return Network->GetOutputTensorNumber();
+        }
+
+        virtual FInferenceTensorInfo GetOutputInfo(int32 Index) const override {
+            return GetTensorInfo(Network->GetOutputTensor(Index));
+        }
+
+        virtual void SetInput(const void* Data) override {
+            Network->SetInputFromVoidPointerCopy(Data);
+        }
+
+        virtual bool Run() override {
+            Network->Run();
+            return true;
+        }
+
+        virtual const float* GetOutput(int32 Index) const override {
+            // read in place, no copy of the output tensor
+            return reinterpret_cast<const float*>(Network->GetOutputTensor(Index).GetUnderlyingUInt8ArrayRef().GetData());
+        }
+
+    private:
+        // kept alive by the owning UMyNeuralNetwork
+        UNeuralNetwork* Network;
+    };
+}
+
+FString GetRequestedInferenceBackend() {
+    return CVarNNBackend.GetValueOnGameThread();
+}
+
+TUniquePtr<IInferenceBackend> CreateInferenceBackend(UNeuralNetwork* Network, const FString& Requested) {
+    if (Network == nullptr || !Network->IsLoaded()) {
+        return nullptr;
+    }
+
+    if (Requested.Equals(TEXT("ORT"), ESearchCase::IgnoreCase)) {
+        if (TUniquePtr<IInferenceBackend> Backend = CreateOnnxRuntimeBackend(Network->GetName())) {
+            return Backend;
+        }
+        UE_LOG(LogTemp, Warning, TEXT("nn.Backend ORT is not available for %s, using NNI"), *Network->GetName());
+    } else if (!Requested.Equals(TEXT("NNI"), ESearchCase::IgnoreCase)) {
+        UE_LOG(LogTemp, Warning, TEXT("Unknown nn.Backend %s, using NNI"), *Requested);
+    }
+    return MakeUnique<FNNIInferenceBackend>(Network);
+}
@@ -0,0 +1,47 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "InferenceQoS.h"
+
+FInferenceLatencyTracker::FInferenceLatencyTracker(int32 InWindowSize)
+    : WindowSize(FMath::Max(InWindowSize, 1)) {
+    Samples.Reserve(WindowSize);
+}
+
+void FInferenceLatencyTracker::AddSample(double Seconds) {
+    if (Samples.Num() < WindowSize) {
+        Samples.Add(Seconds);
+    } else {
+        Samples[NextIndex] = Seconds;
+    }
+    NextIndex = (NextIndex + 1) % WindowSize;
+}
+
+void FInferenceLatencyTracker::Reset() {
+    Samples.Reset();
+    NextIndex = 0;
+}
+
+double FInferenceLatencyTracker::Percentile(double Fraction) const {
+    if (Samples.Num() == 0) {
+        return 0.0;
+    }
+    TArray<double> Sorted = Samples;
+    Sorted.Sort();
+    const int32 Index = FMath::Clamp(FMath::CeilToInt(Fraction * Sorted.Num()) - 1, 0, Sorted.Num() - 1);
+    return Sorted[Index];
+}
+
+int32 FModelQualityController::Evaluate(const FInferenceLatencyTracker& Tracker, int32 ActiveIndex, int32 NumVariants) const {
+    if (NumVariants <= 1 || Tracker.Num() < MinSamples) {
+        return ActiveIndex;
+    }
+
+    const double P95 = Tracker.Percentile(0.95);
+    if (P95 > BudgetSeconds && ActiveIndex > 0) {
+        return ActiveIndex - 1;
+    }
+    if (P95 < BudgetSeconds * UpgradeHeadroom && ActiveIndex < NumVariants - 1) {
+        return ActiveIndex + 1;
+    }
+    return ActiveIndex;
+}
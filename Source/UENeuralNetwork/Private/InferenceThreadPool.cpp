@@ -0,0 +1,216 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "InferenceThreadPool.h"
+
+#include "HAL/IConsoleManager.h"
+#include "Misc/CoreDelegates.h"
+
+static TAutoConsoleVariable<int32> CVarNNPoolNumThreads(
+    TEXT("nn.Pool.NumThreads"), 0,
+    TEXT("Threads in the detection pipeline pool (0 = a quarter of the logical cores, at least 1)."),
+    ECVF_Default);
+
+static TAutoConsoleVariable<FString> CVarNNPoolAffinityMask(
+    TEXT("nn.Pool.AffinityMask"), TEXT("0"),
+    TEXT("Core affinity mask for the pool threads, hex or decimal (0 = no restriction)."),
+    ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarNNPoolPriority(
+    TEXT("nn.Pool.Priority"), 1,
+    TEXT("Pool thread priority: 0 normal, 1 slightly below normal, 2 below normal, 3 lowest."),
+    ECVF_Default);
+
+static FAutoConsoleCommand PoolRestartCommand(
+    TEXT("nn.Pool.Restart"),
+    TEXT("Recreate the detection pipeline thread pool with the current nn.Pool.* settings."),
+    FConsoleCommandDelegate::CreateLambda([]() { FInferenceThreadPool::Get().Restart(); }));
+
+namespace {
+    EThreadPriority ToThreadPriority(int32 Value) {
+        switch (Value) {
+        case 0: return TPri_Normal;
+        case 2: return TPri_BelowNormal;
+        case 3: return TPri_Lowest;
+        default: return TPri_SlightlyBelowNormal;
+        }
+    }
+
+    // shared between the caller of ParallelFor and the helpers queued on the pool
+    struct FParallelForState {
+        std::atomic<int32> NextIndex{ 0 };
+        std::atomic<int32> Completed{ 0 };
+        int32 Num = 0;
+        // only dereferenced for claimed indices, which the caller waits for
+        TFunctionRef<void(int32)>* Body = nullptr;
+        FEvent* DoneEvent = FPlatformProcess::GetSynchEventFromPool(true);
+
+        ~FParallelForState() {
+            FPlatformProcess::ReturnSynchEventToPool(DoneEvent);
+        }
+
+        void Drain() {
+            for (int32 Index = NextIndex++; Index < Num; Index = NextIndex++) {
+                (*Body)(Index);
+                if (++Completed == Num) {
+                    DoneEvent->Trigger();
+                }
+            }
+        }
+    };
+
+    class FParallelForWork : public IQueuedWork {
+    public:
+        explicit FParallelForWork(TSharedRef<FParallelForState, ESPMode::ThreadSafe> InState) : State(InState) {}
+
+        virtual void DoThreadedWork() override {
+            FInferenceThreadPool::Get().EnterPoolThread();
+            State->Drain();
+            delete this;
+        }
+
+        virtual void Abandon() override {
+            delete this;
+        }
+
+    private:
+        TSharedRef<FParallelForState, ESPMode::ThreadSafe> State;
+    };
+
+    // queued behind everything else on a pool that is being restarted. the queue is first in first out per priority, so
+    // once it runs every item queued before it has been picked up by a pool thread
+    class FDrainWork : public IQueuedWork {
+    public:
+        explicit FDrainWork(FEvent* InDoneEvent) : DoneEvent(InDoneEvent) {}
+
+        virtual void DoThreadedWork() override {
+            DoneEvent->Trigger();
+            delete this;
+        }
+
+        virtual void Abandon() override {
+            DoneEvent->Trigger();
+            delete this;
+        }
+
+    private:
+        FEvent* DoneEvent;
+    };
+}
+
+FInferenceThreadPool& FInferenceThreadPool::Get() {
+    static FInferenceThreadPool Instance;
+    return Instance;
+}
+
+FInferenceThreadPool::FPoolRef FInferenceThreadPool::GetPool() {
+    {
+        FReadScopeLock ReadLock(PoolLock);
+        if (Pool.IsValid()) {
+            return Pool;
+        }
+    }
+    FWriteScopeLock WriteLock(PoolLock);
+    if (!Pool.IsValid()) {
+        CreatePool();
+    }
+    return Pool;
+}
+
+int32 FInferenceThreadPool::GetNumThreads() {
+    if (NumThreads == 0) {
+        GetPool();
+    }
+    return NumThreads;
+}
+
+void FInferenceThreadPool::CreatePool() {
+    int32 Threads = CVarNNPoolNumThreads.GetValueOnAnyThread();
+    if (Threads <= 0) {
+        Threads = FMath::Max(1, FPlatformMisc::NumberOfCoresIncludingHyperthreads() / 4);
+    }
+    const FString MaskString = CVarNNPoolAffinityMask.GetValueOnAnyThread();
+    AffinityMask = FCString::Strtoui64(*MaskString, nullptr, MaskString.StartsWith(TEXT("0x")) ? 16 : 10);
+    const EThreadPriority Priority = ToThreadPriority(CVarNNPoolPriority.GetValueOnAnyThread());
+
+    Pool = FPoolRef(FQueuedThreadPool::Allocate());
+    verify(Pool->Create(Threads, 128 * 1024, Priority, TEXT("DetectionPipelinePool")));
+    NumThreads = Threads;
+    Generation++;
+    UE_LOG(LogTemp, Log, TEXT("Detection pipeline pool: %d threads, affinity 0x%llx, priority %d"), Threads, AffinityMask.load(),
+        static_cast<int32>(Priority));
+
+    // the pool has to go before the engine tears down its threading
+    static bool bRegisteredExit = false;
+    if (!bRegisteredExit) {
+        bRegisteredExit = true;
+        FCoreDelegates::OnPreExit.AddLambda([]() { FInferenceThreadPool::Get().Restart(); });
+    }
+}
+
+void FInferenceThreadPool::Restart() {
+    check(IsInGameThread());
+    FPoolRef OldPool;
+    {
+        FWriteScopeLock WriteLock(PoolLock);
+        OldPool = MoveTemp(Pool);
+    }
+    if (!OldPool.IsValid()) {
+        return;
+    }
+    // a ParallelFor running on the old pool still adds helpers to it and waits for them. nothing here holds the pool
+    // lock, so work that needs GetPool meanwhile gets (or creates) the new pool
+    while (!OldPool.IsUnique()) {
+        FPlatformProcess::Sleep(0.001f);
+    }
+    // Destroy abandons what is still queued: AsyncPool work is dropped without running (warm-up and auto-tune would never
+    // report back) and FAsyncTask inference runs inline on this thread. nobody queues on the old pool anymore, so let the
+    // threads empty the queue first
+    FEvent* DrainedEvent = FPlatformProcess::GetSynchEventFromPool(true);
+    OldPool->AddQueuedWork(new FDrainWork(DrainedEvent), EQueuedWorkPriority::Lowest);
+    DrainedEvent->Wait();
+    FPlatformProcess::ReturnSynchEventToPool(DrainedEvent);
+    // waits for the work that is still running
+    OldPool->Destroy();
+    OldPool.Reset();
+}
+
+void FInferenceThreadPool::EnterPoolThread() {
+    // work can also be run inline on the game thread (e.g. by the benchmark), never pin that one
+    if (IsInGameThread()) {
+        return;
+    }
+    thread_local int32 AppliedGeneration = -1;
+    const int32 CurrentGeneration = Generation;
+    if (AppliedGeneration != CurrentGeneration) {
+        AppliedGeneration = CurrentGeneration;
+        if (AffinityMask != 0) {
+            FPlatformProcess::SetThreadAffinityMask(AffinityMask);
+        }
+    }
+}
+
+void FInferenceThreadPool::ParallelFor(int32 Num, TFunctionRef<void(int32)> Body) {
+    if (Num <= 0) {
+        return;
+    }
+    if (Num == 1) {
+        Body(0);
+        return;
+    }
+
+    TSharedRef<FParallelForState, ESPMode::ThreadSafe> State = MakeShared<FParallelForState, ESPMode::ThreadSafe>();
+    State->Num = Num;
+    State->Body = &Body;
+
+    // the caller takes one share, helpers that start after everything was claimed return without touching Body
+    const FPoolRef QueuedPool = GetPool();
+    const int32 NumHelpers = FMath::Min(Num, NumThreads.load()) - 1;
+    for (int32 i = 0; i < NumHelpers; i++) {
+        QueuedPool->AddQueuedWork(new FParallelForWork(State));
+    }
+
+    State->Drain();
+    if (State->Completed != Num) {
+        State->DoneEvent->Wait();
+    }
+}
@@ -3,40 +3,225 @@
 #include "MyNeuralNetwork.h"
 
 #include "CaptureManager.h"
+#include "DetectionKernels.h"
+#include "DetectionClassFilter.h"
+#include "PipelineSettings.h"
+#include "FrameTrace.h"
+#include "DetectionSpatialIndex.h"
+#include "DetectionDeprojection.h"
+#include "SegmentationMasks.h"
+#include "PipelineMemory.h"
+#include "RemoteInference.h"
 
 UMyNeuralNetwork::UMyNeuralNetwork()
 {
+	// labels live in FDetectionLabels, nothing is read from disk here (this also runs for the CDO)
 	Network = nullptr;
+}
 
-	FString RelativePath = FPaths::GameSourceDir();
-	RelativePath = FPaths::Combine(RelativePath, TEXT("UENeuralNetwork"), TEXT("Public"), TEXT("coco_classes.txt"));
-	CocoDatasetClassIntToStringMap = ReadFileToMap(RelativePath);
-	UCaptureManager::CocoDatasetClassIntToStringMap = CocoDatasetClassIntToStringMap;
+namespace {
+	TArrayView<const FDetectionClassThreshold> GetClassView(const FDetectionClassFilter::FSelection& Classes) {
+		return Classes.IsValid() ? TArrayView<const FDetectionClassThreshold>(*Classes) : TArrayView<const FDetectionClassThreshold>();
+	}
 }
 
 uint8 BBFloatToColor(float value) {
 	return static_cast<uint8>(FMath::Clamp(value, 0, 255));
 }
 
-void UMyNeuralNetwork::URunModel(TArray<float>& image, TArray<uint8>& results)
+void UMyNeuralNetwork::ConfigureFromModel()
 {
-	if (Network == nullptr || !Network->IsLoaded()) {
-		UE_LOG(LogTemp, Error, TEXT("Neural Network not loaded."));
+	LLM_SCOPE_BYTAG(DetectionPipeline_Inference);
+	InputFormat = EModelInputFormat::Float32NCHW;
+	Kernels = nullptr;
+	PendingBackend.Reset();
+	RequestedBackend = GetRequestedInferenceBackend();
+	// NNI only wraps the already loaded asset, cheap enough for the game thread
+	Backend = CreateInferenceBackend(Network, TEXT("NNI"));
+	if (Backend == nullptr) {
 		return;
 	}
+	ReadModelGeometry();
+}
 
-	// Clear the bounding box coordinates map
-	BoundingBoxCoordinatesMap.Empty();
+void UMyNeuralNetwork::PrepareRequestedBackend()
+{
+	LLM_SCOPE_BYTAG(DetectionPipeline_Inference);
+	PendingBackend.Reset();
+	if (Backend == nullptr || RequestedBackend.Equals(Backend->GetName(), ESearchCase::IgnoreCase)) {
+		return;
+	}
+	PendingBackend = CreateInferenceBackend(Network, RequestedBackend);
+	// fell back to the runtime already in use
+	if (PendingBackend != nullptr && FCString::Stricmp(PendingBackend->GetName(), Backend->GetName()) == 0) {
+		PendingBackend.Reset();
+	}
+}
+
+bool UMyNeuralNetwork::ApplyPendingBackend()
+{
+	if (PendingBackend == nullptr) {
+		return false;
+	}
+	Backend = MoveTemp(PendingBackend);
+	ReadModelGeometry();
+	return true;
+}
+
+void UMyNeuralNetwork::ReadModelGeometry()
+{
+	InputFormat = EModelInputFormat::Float32NCHW;
+	const FInferenceTensorInfo InputInfo = Backend->GetInputInfo();
+	const int64 ElementBytes = InputInfo.ElementBytes;
+	// {1, 3, h, w} is planar, {1, h, w, 3} is interleaved
+	const TArray<int64>& InputSizes = InputInfo.Sizes;
+	const bool bIsNHWC = InputSizes.Num() == 4 && InputSizes[3] == 3 && InputSizes[1] != 3;
+	if (ElementBytes == 1) {
+		InputFormat = bIsNHWC ? EModelInputFormat::UInt8NHWC : EModelInputFormat::UInt8NCHW;
+	}
+	BatchSize = InputSizes.Num() == 4 ? FMath::Max(static_cast<int32>(InputSizes[0]), 1) : 1;
+	ItemInputBytes = InputInfo.Bytes / BatchSize;
+	if (InputSizes.Num() == 4) {
+		ModelHeight = static_cast<int32>(bIsNHWC ? InputSizes[1] : InputSizes[2]);
+		ModelWidth = static_cast<int32>(bIsNHWC ? InputSizes[2] : InputSizes[3]);
+	}
+
+	// segmentation models have a second output {1, coefficients, h / 4, w / 4} with the mask prototypes
+	bSegmentation = false;
+	NumMaskCoefficients = 0;
+	if (Backend->GetNumOutputs() > 1) {
+		const TArray<int64> ProtoSizes = Backend->GetOutputInfo(1).Sizes;
+		if (ProtoSizes.Num() == 4) {
+			bSegmentation = true;
+			NumMaskCoefficients = static_cast<int32>(ProtoSizes[1]);
+			ProtoHeight = static_cast<int32>(ProtoSizes[2]);
+			ProtoWidth = static_cast<int32>(ProtoSizes[3]);
+		}
+	}
+
+	// {1, 4 + classes (+ mask coefficients), anchors}
+	const TArray<int64> OutputSizes = Backend->GetOutputInfo(0).Sizes;
+	if (OutputSizes.Num() == 3) {
+		NumClasses = static_cast<int32>(OutputSizes[1]) - 4 - NumMaskCoefficients;
+		NumAnchors = static_cast<int32>(OutputSizes[2]);
+	}
+
+	Kernels = FindDetectionKernels(ModelWidth, ModelHeight, 3, NumClasses, NumAnchors);
+	UE_LOG(LogTemp, Log, TEXT("Model input format: %d (%lld bytes per element), %d x %dx%d, %d classes, %d anchors, %d mask coefficients, kernels: %s, backend: %s"),
+		static_cast<int32>(InputFormat), ElementBytes, BatchSize, ModelWidth, ModelHeight, NumClasses, NumAnchors, NumMaskCoefficients, Kernels->Name, Backend->GetName());
+}
+
+void UMyNeuralNetwork::WarmUp(int32 Count)
+{
+	if (Backend == nullptr) {
+		return;
+	}
+
+	LLM_SCOPE_BYTAG(DetectionPipeline_Inference);
+	// zeroed bytes are a valid input for both the float and the uint8 models
+	TArray<uint8> DummyInput;
+	DummyInput.SetNumZeroed(Backend->GetInputInfo().Bytes);
 
-	// start timer to see how long this function takes
 	double startSeconds = FPlatformTime::Seconds();
+	for (int32 i = 0; i < Count; i++) {
+		Backend->SetInput(DummyInput.GetData());
+		Backend->Run();
+	}
+	// the inference server loads the model on its first request, that is paid here rather than on a live frame
+	if (FRemoteInferenceClient::IsEnabled()) {
+		TArray<TArray<float>> RemoteOutputs;
+		RunRemote(DummyInput.GetData(), DummyInput.Num(), -1, RemoteOutputs);
+	}
+	UE_LOG(LogTemp, Log, TEXT("Model warm-up: %d inferences in %f seconds."), Count, FPlatformTime::Seconds() - startSeconds);
+}
+
+bool UMyNeuralNetwork::URunModel(TArray<float>& image, TArray<uint8>& results, int64 FrameId, const FCaptureDepth* Depth, bool bDecodeMasks, bool bPublish)
+{
+	return RunAndDecode(image.GetData(), image.Num() * sizeof(float), FrameId, Depth, bDecodeMasks, bPublish);
+}
 
-	Network->SetInputFromArrayCopy(image);
+bool UMyNeuralNetwork::URunModel(TArray<uint8>& image, TArray<uint8>& results, int64 FrameId, const FCaptureDepth* Depth, bool bDecodeMasks, bool bPublish)
+{
+	// uint8 models normalize internally, so the bytes are copied as they are (4x less data than the float path)
+	return RunAndDecode(image.GetData(), image.Num(), FrameId, Depth, bDecodeMasks, bPublish);
+}
 
-	// Run UNeuralNetwork inference
-	Network->Run();
+bool UMyNeuralNetwork::RunRemote(const void* Input, int64 InputBytes, int64 FrameId, TArray<TArray<float>>& OutOutputs)
+{
+	FScopedFrameTrace Trace(TEXT("Remote.Run"), FrameId);
+	int64 OutputBytes = 0;
+	for (int32 i = 0; i < Backend->GetNumOutputs(); i++) {
+		OutputBytes += Backend->GetOutputInfo(i).Bytes;
+	}
+	// the server knows the model by the name of its asset
+	const InferenceServer::EDataType Type = InputFormat == EModelInputFormat::Float32NCHW ? InferenceServer::EDataType::Float32 : InferenceServer::EDataType::UInt8;
+	if (!FRemoteInferenceClient::Get().Run(Network->GetName(), Type, Backend->GetInputInfo().Sizes, Input, InputBytes, OutputBytes, OutOutputs)) {
+		return false;
+	}
+	// the first output is checked against the geometry when it is decoded, the prototypes are read in place
+	return !bSegmentation || (OutOutputs.Num() >= 2 && OutOutputs[1].Num() >= NumMaskCoefficients * ProtoWidth * ProtoHeight);
+}
 
-	FNeuralTensor pOutputTensor = Network->GetOutputTensor();
+bool UMyNeuralNetwork::Execute(const void* Input, int64 InputBytes, int64 FrameId, const float*& OutOutput, int64& OutOutputNum,
+	const float*& OutPrototypes, TArray<TArray<float>>& RemoteOutputs)
+{
+	const int64 ExpectedBytes = Backend->GetInputInfo().Bytes;
+	if (ExpectedBytes != InputBytes) {
+		// fewer images than the batch holds: the remaining entries are zeroed
+		if (InputBytes <= 0 || InputBytes > ExpectedBytes || ItemInputBytes <= 0 || InputBytes % ItemInputBytes != 0) {
+			UE_LOG(LogTemp, Error, TEXT("Input has %lld bytes, model expects %lld."), InputBytes, ExpectedBytes);
+			return false;
+		}
+		FScopedFrameTrace Trace(TEXT("PadBatch"), FrameId);
+		PaddedInput.SetNumUninitialized(ExpectedBytes);
+		FMemory::Memcpy(PaddedInput.GetData(), Input, InputBytes);
+		FMemory::Memzero(PaddedInput.GetData() + InputBytes, ExpectedBytes - InputBytes);
+		Input = PaddedInput.GetData();
+		InputBytes = ExpectedBytes;
+	}
+
+	// the inference server returns copies of the outputs, locally they are read in place from the backend
+	const bool bRanRemote = FRemoteInferenceClient::IsEnabled() && RunRemote(Input, InputBytes, FrameId, RemoteOutputs);
+	if (!bRanRemote) {
+		{
+			FScopedFrameTrace Trace(TEXT("SetInput"), FrameId);
+			Backend->SetInput(Input);
+		}
+		// Run inference on the backend nn.Backend picked
+		FScopedFrameTrace Trace(TEXT("Model.Run"), FrameId);
+		if (!Backend->Run()) {
+			return false;
+		}
+	}
+	OutOutput = bRanRemote ? RemoteOutputs[0].GetData() : Backend->GetOutput(0);
+	OutOutputNum = bRanRemote ? RemoteOutputs[0].Num() : Backend->GetOutputInfo(0).Bytes / sizeof(float);
+	OutPrototypes = !bSegmentation ? nullptr : bRanRemote ? RemoteOutputs[1].GetData() : Backend->GetOutput(1);
+	return true;
+}
+
+bool UMyNeuralNetwork::RunAndDecode(const void* Input, int64 InputBytes, int64 FrameId, const FCaptureDepth* Depth, bool bDecodeMasks, bool bPublish)
+{
+	LLM_SCOPE_BYTAG(DetectionPipeline_Inference);
+	// Clear the bounding box coordinates map, a failed run leaves it empty rather than with the last frame's boxes
+	BoundingBoxCoordinatesMap.Empty();
+	DetectionMasks.Reset();
+
+	if (Backend == nullptr) {
+		UE_LOG(LogTemp, Error, TEXT("Neural Network not loaded."));
+		return false;
+	}
+
+	// start timer to see how long this function takes
+	double startSeconds = FPlatformTime::Seconds();
+
+	TArray<TArray<float>> remoteOutputs;
+	const float* arr = nullptr;
+	int64 arrNum = 0;
+	const float* prototypes = nullptr;
+	if (!Execute(Input, InputBytes, FrameId, arr, arrNum, prototypes, remoteOutputs)) {
+		return false;
+	}
+	FScopedFrameTrace DecodeTrace(TEXT("Decode"), FrameId);
 
 	// {1 84 6300} -- yolov8 output image 640x480. 6300 predictions. 4 box coordinates + 80 class probabilities
 	// yolov8 has three output layers with strides 8, 16, 32; it predicts one bounding box per cell; 
@@ -46,94 +231,106 @@ void UMyNeuralNetwork::URunModel(TArray<float>& image, TArray<uint8>& results)
 	// 640/32 = 20, 480/32 = 15. 20x15 = 300.
 	// 4800 + 1200 + 300 = 6300 predictions.
 
-	// the flattened output tensor is 84 groups of 6300 values.
-	TArray<float> arr = Network->GetOutputTensor().GetArrayCopy<float>();
-
-	// get size of each dimension of tensor
-	auto sizes = pOutputTensor.GetSizes();
-	int total = arr.Num();
-	int columns = sizes[1];
-	int rows = total / columns;
+	// the flattened output tensor is 84 groups of 6300 values (per batch entry, the frame is the first one).
+	if (Kernels == nullptr || arrNum != static_cast<int64>(BatchSize) * (NumClasses + 4 + NumMaskCoefficients) * NumAnchors) {
+		UE_LOG(LogTemp, Error, TEXT("Output tensor does not match the configured model geometry."));
+		return false;
+	}
 
-	const int numClasses = 80; // number of classes the model predicts
-	
-	// store the bounding box coordinates for each class as a struct
-	TArray<FBoxCoordinates> boundingBoxCoordinates;
-	for (int i = 0; i < numClasses; i++) {
-		boundingBoxCoordinates.Add(FBoxCoordinates());
-	}
-
-	int highestClass = -1;
-	// loop through the flattened tensor and populate the boundingBoxCoordinates array
-	for (int i = 0; i < rows; i++) {
-		TArray<float> predictions;
-		TArray<float> boxCoordinates;
-		for (int j = 0; j < columns; j++) {
-			float cell = arr[i + j * rows];
-			if (j < 4) {
-				boxCoordinates.Add(cell);
-			}
-			else {
-				predictions.Add(cell);
-			}
-		}
-		// print the predictions (should be 80)
-		for (int k = 0; k < predictions.Num(); k++) {
-			float ClassConfidencePrediction = predictions[k];
-			// log conf
-			if(ClassConfidencePrediction > ConfidenceThreshold)
-			{
-				FBoxCoordinates coords = FBoxCoordinates();
-				coords.confidence = ClassConfidencePrediction;
-				coords.cx = boxCoordinates[0];
-				coords.cy = boxCoordinates[1];
-				coords.width = boxCoordinates[2];
-				coords.height = boxCoordinates[3];
-				coords.x1 = coords.cx - (coords.width / 2);
-				coords.y1 = coords.cy - (coords.height / 2);
-				BoundingBoxCoordinatesMap.FindOrAdd(k).Add(coords);
-			}
-			// auto cell = predictions[k];
-			// if (cell > boundingBoxCoordinates[k].confidence) {
-			// 	boundingBoxCoordinates[k].confidence = cell;
-			//
-			// 	// get cx, cy, w, h from the tensor output
-			// 	float cx = boxCoordinates[0];
-			// 	float cy = boxCoordinates[1];
-			// 	float w = boxCoordinates[2];
-			// 	float h = boxCoordinates[3];
-			// 	boundingBoxCoordinates[k].cx = cx;
-			// 	boundingBoxCoordinates[k].cy = cy;
-			// 	boundingBoxCoordinates[k].width = w;
-			// 	boundingBoxCoordinates[k].height = h;
-			// 	// get the top left corner of the bounding box given the center (cx,cy) and width and height
-			// 	float x1 = cx - (w / 2);
-			// 	float y1 = cy - (h / 2);
-			// 	boundingBoxCoordinates[k].x1 = x1;
-			// 	boundingBoxCoordinates[k].y1 = y1;
-			//
-			// 	if(highestClass == -1 || cell>boundingBoxCoordinates[highestClass].confidence){
-			// 		highestClass = k;
-			// 	}
-			// }
-		}
+	LLM_SCOPE_BYTAG(DetectionPipeline_Results);
+	// geometry was fixed when the model was set, the kernel loops over class rows (only the ones of nn.Classes if set) and
+	// only gathers boxes above the threshold
+	const FDetectionClassFilter::FSelection Classes = FDetectionClassFilter::Get().GetSelection();
+	Kernels->Decode(arr, NumClasses, NumAnchors, CVarNNConfidenceThreshold.GetValueOnAnyThread(), GetClassView(Classes), BoundingBoxCoordinatesMap);
+	if (Depth != nullptr) {
+		FScopedFrameTrace DeprojectTrace(TEXT("Deproject"), FrameId);
+		DeprojectBoxes(*Depth, ModelWidth, ModelHeight, BoundingBoxCoordinatesMap);
 	}
 
-	// if(highestClass > -1)
-	// {
-	// 	FBoxCoordinates coords = boundingBoxCoordinates[highestClass];
-	// 	UCaptureManager::BoundingBoxCoordinates = coords;
-	//
-	// 	// print highest class prediction and its probability
-	// 	// UE_LOG(LogTemp, Warning, TEXT("class: %d, probability: %f"), highestClass, boundingBoxCoordinates[highestClass].confidence);
-	// }
+	if (bSegmentation && bDecodeMasks) {
+		FScopedFrameTrace MaskTrace(TEXT("DecodeMasks"), FrameId);
+		// masks only for the boxes that survive suppression, the prototypes are read in place
+		TArray<TPair<int, FBoxCoordinates>> Kept;
+		SuppressOverlappingBoxes(BoundingBoxCoordinatesMap, Kept);
+		FMaskPrototypes Prototypes;
+		Prototypes.Data = prototypes;
+		Prototypes.NumCoefficients = NumMaskCoefficients;
+		Prototypes.Width = ProtoWidth;
+		Prototypes.Height = ProtoHeight;
+		DecodeMasks(arr + (4 + NumClasses) * NumAnchors, NumAnchors, Prototypes, ModelWidth, ModelHeight, Kept, DetectionMasks);
+	}
 
-	UCaptureManager::BoundingBoxCoordinatesMap = BoundingBoxCoordinatesMap;
+	if (bPublish) {
+		PublishResults(FrameId);
+	}
 	
 	// print time elapsed for this function
 	double secondsElapsed = FPlatformTime::Seconds() - startSeconds;
 
 	//UE_LOG(LogTemp, Log, TEXT("Results created successfully in %f."), secondsElapsed)
+	return true;
+}
+
+bool UMyNeuralNetwork::URunModelBatch(const void* Input, int64 InputBytes, int32 NumItems, int64 FrameId, TArray<FBoxCoordinatesMap>& OutResults)
+{
+	if (Backend == nullptr) {
+		UE_LOG(LogTemp, Error, TEXT("Neural Network not loaded."));
+		return false;
+	}
+	if (NumItems < 1 || NumItems > BatchSize || InputBytes != NumItems * ItemInputBytes) {
+		UE_LOG(LogTemp, Error, TEXT("Batch of %d images (%lld bytes) does not fit the model (%d x %lld bytes)."), NumItems, InputBytes, BatchSize, ItemInputBytes);
+		return false;
+	}
+
+	LLM_SCOPE_BYTAG(DetectionPipeline_Inference);
+	TArray<TArray<float>> remoteOutputs;
+	const float* arr = nullptr;
+	int64 arrNum = 0;
+	const float* prototypes = nullptr;
+	if (!Execute(Input, InputBytes, FrameId, arr, arrNum, prototypes, remoteOutputs)) {
+		return false;
+	}
+	FScopedFrameTrace DecodeTrace(TEXT("Decode"), FrameId);
+	const int64 ItemOutputNum = static_cast<int64>(NumClasses + 4 + NumMaskCoefficients) * NumAnchors;
+	if (Kernels == nullptr || arrNum != BatchSize * ItemOutputNum) {
+		UE_LOG(LogTemp, Error, TEXT("Output tensor does not match the configured model geometry."));
+		return false;
+	}
+
+	LLM_SCOPE_BYTAG(DetectionPipeline_Results);
+	// every entry of the batch is decoded where it lies in the output
+	const FDetectionClassFilter::FSelection Classes = FDetectionClassFilter::Get().GetSelection();
+	const float Threshold = CVarNNConfidenceThreshold.GetValueOnAnyThread();
+	OutResults.SetNum(NumItems);
+	for (int32 i = 0; i < NumItems; i++) {
+		OutResults[i].Reset();
+		Kernels->Decode(arr + i * ItemOutputNum, NumClasses, NumAnchors, Threshold, GetClassView(Classes), OutResults[i]);
+	}
+	return true;
+}
+
+void UMyNeuralNetwork::ReleaseScratchMemory()
+{
+	PaddedInput.Empty();
+	BoundingBoxCoordinatesMap.Empty();
+	DetectionMasks.Empty();
+	if (Backend != nullptr) {
+		Backend->ReleaseBuffers();
+	}
+}
+
+void UMyNeuralNetwork::PublishEmpty(int64 FrameId)
+{
+	BoundingBoxCoordinatesMap.Empty();
+	DetectionMasks.Reset();
+	PublishResults(FrameId);
+}
+
+void UMyNeuralNetwork::PublishResults(int64 FrameId)
+{
+	// the capture manager statics and OnDetectionsReady are updated on the game thread when the task is harvested,
+	// the spatial index swaps snapshots itself
+	FDetectionSpatialIndex::Publish(BoundingBoxCoordinatesMap, ModelWidth, ModelHeight, FrameId);
 }
 
 TMap<int, FString> UMyNeuralNetwork::ReadFileToMap(FString FilePath)
@@ -69,12 +69,9 @@ AMyPawn::AMyPawn()
 	check(MyCaptureManager);
 	MyCaptureManager->ColorCaptureComponents = MySceneCapture;
 
-	//get neural network asset from content browser
-	UNeuralNetwork* NeuralNetwork = Cast<UNeuralNetwork>(StaticLoadObject(UNeuralNetwork::StaticClass(), NULL,
+	// neural network asset from content browser, loaded asynchronously and warmed up by the capture manager in BeginPlay
+	MyCaptureManager->ModelAsset = TSoftObjectPtr<UNeuralNetwork>(FSoftObjectPath(
 		TEXT("/Script/NeuralNetworkInference.NeuralNetwork'/Game/Models/yolov8n_16_640_480.yolov8n_16_640_480'")));
-	NeuralNetwork->SetSynchronousMode(ENeuralSynchronousMode::Synchronous);
-	// set neural network
-	MyCaptureManager->SetNeuralNetwork(NeuralNetwork);
 
 	// Set this pawn to be controlled by the lowest-numbered player when game starts.
 	AutoPossessPlayer = EAutoReceiveInput::Player0;
@@ -0,0 +1,517 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "InferenceBackend.h"
+
+#include "Async/MappedFileHandle.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformFileManager.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeExit.h"
+#include "Misc/SecureHash.h"
+
+static TAutoConsoleVariable<FString> CVarNNOrtModelDir(
+    TEXT("nn.ORT.ModelDir"), TEXT(""),
+    TEXT("Directory with <model asset name>.onnx for nn.Backend ORT. Empty: Content/Models of the project."),
+    ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarNNOrtIntraOpThreads(
+    TEXT("nn.ORT.IntraOpThreads"), 0,
+    TEXT("Threads one operator is split over, 0 for one per physical core. Read when a model is set."),
+    ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarNNOrtInterOpThreads(
+    TEXT("nn.ORT.InterOpThreads"), 1,
+    TEXT("Threads running independent branches of the graph at once, 1 runs the graph sequentially. Read when a model is set."),
+    ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarNNOrtGraphOptimization(
+    TEXT("nn.ORT.GraphOptimization"), 3,
+    TEXT("Graph optimization level: 0 none, 1 basic (constant folding, redundant nodes), 2 extended (fusions), 3 all (layout). Read when a model is set."),
+    ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarNNOrtModelCache(
+    TEXT("nn.ORT.ModelCache"), 1,
+    TEXT("Save the optimized graph to Saved/DetectionModelCache and load it memory-mapped on later runs instead of optimizing again.\n")
+    TEXT("The cache is rebuilt when the model, the onnx runtime version, nn.ORT.GraphOptimization or the cpu change. Read when a model is set."),
+    ECVF_Default);
+
+#if WITH_ONNXRUNTIME
+
+THIRD_PARTY_INCLUDES_START
+#include "onnxruntime_c_api.h"
+THIRD_PARTY_INCLUDES_END
+
+#include <string>
+
+// the c api: every call returns a status instead of throwing, so the module builds without exceptions
+namespace {
+    const OrtApi& GetApi() {
+        static const OrtApi* Api = OrtGetApiBase()->GetApi(ORT_API_VERSION);
+        return *Api;
+    }
+
+    // empty if the call succeeded, the error message otherwise. the status is released
+    FString TakeError(OrtStatus* Status) {
+        if (Status == nullptr) {
+            return FString();
+        }
+        const FString Message = UTF8_TO_TCHAR(GetApi().GetErrorMessage(Status));
+        GetApi().ReleaseStatus(Status);
+        return Message.IsEmpty() ? TEXT("unknown error") : Message;
+    }
+
+    struct FOrtDeleter {
+        void operator()(OrtSessionOptions* Object) const { GetApi().ReleaseSessionOptions(Object); }
+        void operator()(OrtSession* Object) const { GetApi().ReleaseSession(Object); }
+        void operator()(OrtIoBinding* Object) const { GetApi().ReleaseIoBinding(Object); }
+        void operator()(OrtValue* Object) const { GetApi().ReleaseValue(Object); }
+        void operator()(OrtTypeInfo* Object) const { GetApi().ReleaseTypeInfo(Object); }
+        void operator()(OrtMemoryInfo* Object) const { GetApi().ReleaseMemoryInfo(Object); }
+    };
+
+    template <typename T>
+    using TOrtPtr = TUniquePtr<T, FOrtDeleter>;
+
+    // paths are wide on windows and utf-8 everywhere else
+    std::basic_string<ORTCHAR_T> ToOrtPath(const FString& Path) {
+#if PLATFORM_WINDOWS
+        return std::basic_string<ORTCHAR_T>(*Path);
+#else
+        return std::basic_string<ORTCHAR_T>(TCHAR_TO_UTF8(*Path));
+#endif
+    }
+
+    // null if the runtime could not be initialized
+    OrtEnv* GetEnv() {
+        static OrtEnv* Env = []() {
+            OrtEnv* NewEnv = nullptr;
+            const FString Error = TakeError(GetApi().CreateEnv(ORT_LOGGING_LEVEL_WARNING, "UENeuralNetwork", &NewEnv));
+            if (!Error.IsEmpty()) {
+                UE_LOG(LogTemp, Error, TEXT("ORT: could not create the environment: %s"), *Error);
+                return static_cast<OrtEnv*>(nullptr);
+            }
+            return NewEnv;
+        }();
+        return Env;
+    }
+
+    GraphOptimizationLevel GetGraphOptimizationLevel() {
+        switch (CVarNNOrtGraphOptimization.GetValueOnAnyThread()) {
+        case 0: return GraphOptimizationLevel::ORT_DISABLE_ALL;
+        case 1: return GraphOptimizationLevel::ORT_ENABLE_BASIC;
+        case 2: return GraphOptimizationLevel::ORT_ENABLE_EXTENDED;
+        default: return GraphOptimizationLevel::ORT_ENABLE_ALL;
+        }
+    }
+
+    TOrtPtr<OrtSessionOptions> MakeSessionOptions(GraphOptimizationLevel Level, FString& OutError) {
+        const OrtApi& Api = GetApi();
+        OrtSessionOptions* Options = nullptr;
+        OutError = TakeError(Api.CreateSessionOptions(&Options));
+        if (!OutError.IsEmpty()) {
+            return nullptr;
+        }
+        TOrtPtr<OrtSessionOptions> Result(Options);
+        const int32 InterOpThreads = FMath::Max(CVarNNOrtInterOpThreads.GetValueOnAnyThread(), 1);
+        for (OrtStatus* Status : { Api.SetIntraOpNumThreads(Options, FMath::Max(CVarNNOrtIntraOpThreads.GetValueOnAnyThread(), 0)),
+            Api.SetInterOpNumThreads(Options, InterOpThreads),
+            Api.SetSessionExecutionMode(Options, InterOpThreads > 1 ? ExecutionMode::ORT_PARALLEL : ExecutionMode::ORT_SEQUENTIAL),
+            Api.SetSessionGraphOptimizationLevel(Options, Level) }) {
+            const FString Error = TakeError(Status);
+            if (OutError.IsEmpty()) {
+                OutError = Error;
+            }
+        }
+        if (!OutError.IsEmpty()) {
+            return nullptr;
+        }
+        return Result;
+    }
+
+    FString GetModelCacheDir() {
+        return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("DetectionModelCache"));
+    }
+
+    // everything the optimized graph depends on: the model file, the runtime build, the optimization level and the cpu
+    // (the highest level picks layouts and kernels for the instruction set it runs on, vendor/brand/cpuid signature stand
+    // in for that)
+    FString GetModelCacheKey(const FString& SourcePath, GraphOptimizationLevel Level) {
+        const FString Key = FString::Printf(TEXT("%s|ORT %s|%d|%s|%s|%08x"), *LexToString(FMD5Hash::HashFile(*SourcePath)),
+            UTF8_TO_TCHAR(OrtGetApiBase()->GetVersionString()), static_cast<int32>(Level), *FPlatformMisc::GetCPUVendor(),
+            *FPlatformMisc::GetCPUBrand(), FPlatformMisc::GetCPUInfo());
+        return FMD5::HashAnsiString(*Key);
+    }
+
+    // "<model>.<key>.ort" files of ModelName other than Keep
+    void DeleteStaleCacheFiles(const FString& ModelName, const FString& Keep) {
+        TArray<FString> Files;
+        IFileManager::Get().FindFiles(Files, *FPaths::Combine(GetModelCacheDir(), ModelName + TEXT(".*.ort")), true, false);
+        for (const FString& File : Files) {
+            // md5 keys are 32 characters, anything longer belongs to another model with the same prefix
+            if (File != Keep && File.Len() == ModelName.Len() + 37) {
+                IFileManager::Get().Delete(*FPaths::Combine(GetModelCacheDir(), File));
+            }
+        }
+    }
+
+    // a model input or output with the buffer it is bound to
+    struct FOrtTensor {
+        std::string Name;
+        ONNXTensorElementDataType Type = ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT;
+        FInferenceTensorInfo Info;
+        TArray<uint8, TAlignedHeapAllocator<64>> Data;
+        TOrtPtr<OrtValue> Value;
+    };
+
+    /**
+     * onnx runtime on the cpu. every tensor is bound once to a buffer owned here (io binding), so a run allocates nothing
+     * and the outputs are read where onnx runtime wrote them.
+     */
+    class FOnnxRuntimeBackend : public IInferenceBackend {
+    public:
+        bool Load(const FString& Path, const FString& ModelName) {
+            const OrtApi& Api = GetApi();
+            OrtEnv* Env = GetEnv();
+            if (Env == nullptr) {
+                return false;
+            }
+            FString Error;
+            ON_SCOPE_EXIT{
+                if (!Error.IsEmpty()) {
+                    UE_LOG(LogTemp, Error, TEXT("ORT: could not load %s: %s"), *Path, *Error);
+                }
+            };
+
+            const GraphOptimizationLevel Level = GetGraphOptimizationLevel();
+            const bool bUseCache = CVarNNOrtModelCache.GetValueOnAnyThread() != 0 && Level != GraphOptimizationLevel::ORT_DISABLE_ALL;
+            FString CachePath;
+            if (bUseCache) {
+                const FString CacheFile = FString::Printf(TEXT("%s.%s.ort"), *ModelName, *GetModelCacheKey(Path, Level));
+                CachePath = FPaths::Combine(GetModelCacheDir(), CacheFile);
+                if (!LoadCached(CachePath)) {
+                    DeleteStaleCacheFiles(ModelName, CacheFile);
+                }
+            }
+
+            if (!Session) {
+                TOrtPtr<OrtSessionOptions> Options = MakeSessionOptions(Level, Error);
+                if (!Options) {
+                    return false;
+                }
+                // onnx runtime writes the optimized graph while creating the session, it only gets the final name once complete.
+                // unique per process and load, two games starting at once never write the same temp file
+                const FString TempPath = FString::Printf(TEXT("%s.%u.%s.tmp"), *CachePath, FPlatformProcess::GetCurrentProcessId(),
+                    *FGuid::NewGuid().ToString());
+                if (bUseCache) {
+                    IFileManager::Get().MakeDirectory(*GetModelCacheDir(), true);
+                    Error = TakeError(Api.AddSessionConfigEntry(Options.Get(), "session.save_model_format", "ORT"));
+                    if (Error.IsEmpty()) {
+                        Error = TakeError(Api.SetOptimizedModelFilePath(Options.Get(), ToOrtPath(TempPath).c_str()));
+                    }
+                    if (!Error.IsEmpty()) {
+                        return false;
+                    }
+                }
+                OrtSession* NewSession = nullptr;
+                Error = TakeError(Api.CreateSession(Env, ToOrtPath(Path).c_str(), Options.Get(), &NewSession));
+                if (!Error.IsEmpty()) {
+                    if (bUseCache) {
+                        IFileManager::Get().Delete(*TempPath);
+                    }
+                    return false;
+                }
+                Session.Reset(NewSession);
+                if (bUseCache && !IFileManager::Get().Move(*CachePath, *TempPath)) {
+                    UE_LOG(LogTemp, Warning, TEXT("ORT: could not write the model cache %s"), *CachePath);
+                    IFileManager::Get().Delete(*TempPath);
+                }
+            }
+
+            // one image in, the detections (and the mask prototypes) out
+            size_t NumInputs = 0;
+            size_t NumOutputs = 0;
+            Error = TakeError(Api.SessionGetInputCount(Session.Get(), &NumInputs));
+            if (Error.IsEmpty()) {
+                Error = TakeError(Api.SessionGetOutputCount(Session.Get(), &NumOutputs));
+            }
+            if (!Error.IsEmpty()) {
+                return false;
+            }
+            if (NumInputs != 1 || NumOutputs < 1 || NumOutputs > 2) {
+                UE_LOG(LogTemp, Error, TEXT("ORT: %s has %d inputs and %d outputs, expected 1 and 1 or 2"), *Path,
+                    static_cast<int32>(NumInputs), static_cast<int32>(NumOutputs));
+                return false;
+            }
+            if (!InitTensor(true, 0, Input, Error)) {
+                return false;
+            }
+            Outputs.SetNum(static_cast<int32>(NumOutputs));
+            for (int32 i = 0; i < Outputs.Num(); i++) {
+                if (!InitTensor(false, i, Outputs[i], Error)) {
+                    return false;
+                }
+                if (Outputs[i].Type != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT) {
+                    UE_LOG(LogTemp, Error, TEXT("ORT: output %d of %s is not a fixed size float tensor"), i, *Path);
+                    return false;
+                }
+            }
+
+            return BindBuffers(Error);
+        }
+
+        // true if the session came from the model cache
+        bool IsFromCache() const {
+            return MappedRegion.IsValid();
+        }
+
+        virtual const TCHAR* GetName() const override {
+            return TEXT("ORT");
+        }
+
+        virtual FInferenceTensorInfo GetInputInfo() const override {
+            return Input.Info;
+        }
+
+        virtual int32 GetNumOutputs() const override {
+            return Outputs.Num();
+        }
+
+        virtual FInferenceTensorInfo GetOutputInfo(int32 Index) const override {
+            return Outputs[Index].Info;
+        }
+
+        virtual void SetInput(const void* Data) override {
+            if (!Binding) {
+                // released while the pipeline was suspended
+                FString Error;
+                if (!BindBuffers(Error)) {
+                    UE_LOG(LogTemp, Error, TEXT("ORT: could not allocate the tensors: %s"), *Error);
+                    return;
+                }
+            }
+            FMemory::Memcpy(Input.Data.GetData(), Data, Input.Data.Num());
+        }
+
+        virtual bool Run() override {
+            if (!Binding) {
+                return false;
+            }
+            const FString Error = TakeError(GetApi().RunWithBinding(Session.Get(), nullptr, Binding.Get()));
+            if (!Error.IsEmpty()) {
+                UE_LOG(LogTemp, Error, TEXT("ORT: run failed: %s"), *Error);
+                return false;
+            }
+            return true;
+        }
+
+        virtual const float* GetOutput(int32 Index) const override {
+            return reinterpret_cast<const float*>(Outputs[Index].Data.GetData());
+        }
+
+        virtual void ReleaseBuffers() override {
+            Binding.Reset();
+            Input.Value.Reset();
+            Input.Data.Empty();
+            for (FOrtTensor& Output : Outputs) {
+                Output.Value.Reset();
+                Output.Data.Empty();
+            }
+        }
+
+    private:
+        // session from an optimized graph saved by an earlier run. false on a miss, the file is deleted if it could not be used
+        bool LoadCached(const FString& CachePath) {
+            IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+            if (!PlatformFile.FileExists(*CachePath)) {
+                return false;
+            }
+            MappedFile.Reset(PlatformFile.OpenMapped(*CachePath));
+            if (MappedFile) {
+                MappedRegion.Reset(MappedFile->MapRegion(0, MappedFile->GetFileSize()));
+            }
+            if (MappedRegion) {
+                // already optimized for this machine. onnx runtime reads the graph and the weights straight out of the
+                // mapping instead of copying them (use_ort_model_bytes_directly for the graph, ..._for_initializers for the
+                // weights), so it stays mapped as long as the session lives
+                const OrtApi& Api = GetApi();
+                FString Error;
+                TOrtPtr<OrtSessionOptions> Options = MakeSessionOptions(GraphOptimizationLevel::ORT_DISABLE_ALL, Error);
+                if (Options) {
+                    Error = TakeError(Api.AddSessionConfigEntry(Options.Get(), "session.load_model_format", "ORT"));
+                }
+                if (Options && Error.IsEmpty()) {
+                    Error = TakeError(Api.AddSessionConfigEntry(Options.Get(), "session.use_ort_model_bytes_directly", "1"));
+                }
+                if (Options && Error.IsEmpty()) {
+                    Error = TakeError(Api.AddSessionConfigEntry(Options.Get(), "session.use_ort_model_bytes_for_initializers", "1"));
+                }
+                OrtSession* NewSession = nullptr;
+                if (Options && Error.IsEmpty()) {
+                    Error = TakeError(Api.CreateSessionFromArray(GetEnv(), MappedRegion->GetMappedPtr(), MappedRegion->GetMappedSize(),
+                        Options.Get(), &NewSession));
+                }
+                if (Error.IsEmpty()) {
+                    Session.Reset(NewSession);
+                    return true;
+                }
+                UE_LOG(LogTemp, Warning, TEXT("ORT: model cache %s is unusable, rebuilding it: %s"), *CachePath, *Error);
+            }
+            Session.Reset();
+            MappedRegion.Reset();
+            MappedFile.Reset();
+            PlatformFile.DeleteFile(*CachePath);
+            return false;
+        }
+
+        // name, type and shape of input or output Index
+        bool InitTensor(bool bInput, size_t Index, FOrtTensor& Tensor, FString& OutError) {
+            const OrtApi& Api = GetApi();
+            OrtAllocator* Allocator = nullptr;
+            char* Name = nullptr;
+            OutError = TakeError(Api.GetAllocatorWithDefaultOptions(&Allocator));
+            if (OutError.IsEmpty()) {
+                OutError = TakeError(bInput ? Api.SessionGetInputName(Session.Get(), Index, Allocator, &Name)
+                    : Api.SessionGetOutputName(Session.Get(), Index, Allocator, &Name));
+            }
+            if (!OutError.IsEmpty()) {
+                return false;
+            }
+            Tensor.Name = Name;
+            TakeError(Api.AllocatorFree(Allocator, Name));
+
+            OrtTypeInfo* TypeInfo = nullptr;
+            OutError = TakeError(bInput ? Api.SessionGetInputTypeInfo(Session.Get(), Index, &TypeInfo)
+                : Api.SessionGetOutputTypeInfo(Session.Get(), Index, &TypeInfo));
+            if (!OutError.IsEmpty()) {
+                return false;
+            }
+            TOrtPtr<OrtTypeInfo> TypeInfoRef(TypeInfo);
+            const OrtTensorTypeAndShapeInfo* ShapeInfo = nullptr;
+            size_t NumDimensions = 0;
+            TArray<int64_t> Shape;
+            OutError = TakeError(Api.CastTypeInfoToTensorInfo(TypeInfo, &ShapeInfo));
+            if (OutError.IsEmpty() && ShapeInfo == nullptr) {
+                OutError = FString::Printf(TEXT("%s is not a tensor"), UTF8_TO_TCHAR(Tensor.Name.c_str()));
+            }
+            if (OutError.IsEmpty()) {
+                OutError = TakeError(Api.GetTensorElementType(ShapeInfo, &Tensor.Type));
+            }
+            if (OutError.IsEmpty()) {
+                OutError = TakeError(Api.GetDimensionsCount(ShapeInfo, &NumDimensions));
+            }
+            if (OutError.IsEmpty()) {
+                Shape.SetNumZeroed(static_cast<int32>(NumDimensions));
+                OutError = TakeError(Api.GetDimensions(ShapeInfo, Shape.GetData(), NumDimensions));
+            }
+            if (!OutError.IsEmpty()) {
+                return false;
+            }
+
+            if (Tensor.Type != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT && Tensor.Type != ONNX_TENSOR_ELEMENT_DATA_TYPE_UINT8) {
+                UE_LOG(LogTemp, Error, TEXT("ORT: tensor %s is neither float nor uint8"), UTF8_TO_TCHAR(Tensor.Name.c_str()));
+                return false;
+            }
+            Tensor.Info.ElementBytes = Tensor.Type == ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT ? 4 : 1;
+            Tensor.Info.Sizes.Reset();
+            int64 Count = 1;
+            for (const int64_t Size : Shape) {
+                // a dynamic batch runs with one image, every other dimension has to be fixed at export
+                const int64 Fixed = Tensor.Info.Sizes.Num() == 0 && Size < 0 ? 1 : Size;
+                if (Fixed <= 0) {
+                    UE_LOG(LogTemp, Error, TEXT("ORT: tensor %s has a dynamic dimension, export the model with a fixed image size"),
+                        UTF8_TO_TCHAR(Tensor.Name.c_str()));
+                    return false;
+                }
+                Tensor.Info.Sizes.Add(Fixed);
+                Count *= Fixed;
+            }
+            Tensor.Info.Bytes = Count * Tensor.Info.ElementBytes;
+            return true;
+        }
+
+        // a zeroed buffer for every tensor wrapped in a value, and the binding of all of them. again after ReleaseBuffers
+        bool BindBuffers(FString& OutError) {
+            const OrtApi& Api = GetApi();
+            Binding.Reset();
+            OrtMemoryInfo* MemoryInfo = nullptr;
+            OutError = TakeError(Api.CreateCpuMemoryInfo(OrtArenaAllocator, OrtMemTypeDefault, &MemoryInfo));
+            if (!OutError.IsEmpty()) {
+                return false;
+            }
+            TOrtPtr<OrtMemoryInfo> MemoryInfoRef(MemoryInfo);
+            auto CreateValue = [&](FOrtTensor& Tensor) {
+                Tensor.Value.Reset();
+                Tensor.Data.SetNumZeroed(Tensor.Info.Bytes);
+                OrtValue* Value = nullptr;
+                OutError = TakeError(Api.CreateTensorWithDataAsOrtValue(MemoryInfo, Tensor.Data.GetData(), Tensor.Data.Num(),
+                    reinterpret_cast<const int64_t*>(Tensor.Info.Sizes.GetData()), Tensor.Info.Sizes.Num(), Tensor.Type, &Value));
+                Tensor.Value.Reset(Value);
+                return OutError.IsEmpty();
+            };
+            if (!CreateValue(Input)) {
+                return false;
+            }
+            for (FOrtTensor& Output : Outputs) {
+                if (!CreateValue(Output)) {
+                    return false;
+                }
+            }
+
+            OrtIoBinding* NewBinding = nullptr;
+            OutError = TakeError(Api.CreateIoBinding(Session.Get(), &NewBinding));
+            if (!OutError.IsEmpty()) {
+                return false;
+            }
+            Binding.Reset(NewBinding);
+            OutError = TakeError(Api.BindInput(Binding.Get(), Input.Name.c_str(), Input.Value.Get()));
+            for (int32 i = 0; i < Outputs.Num() && OutError.IsEmpty(); i++) {
+                OutError = TakeError(Api.BindOutput(Binding.Get(), Outputs[i].Name.c_str(), Outputs[i].Value.Get()));
+            }
+            if (!OutError.IsEmpty()) {
+                Binding.Reset();
+                return false;
+            }
+            return true;
+        }
+
+        // the cached graph the session reads from, released after it
+        TUniquePtr<IMappedFileHandle> MappedFile;
+        TUniquePtr<IMappedFileRegion> MappedRegion;
+        TOrtPtr<OrtSession> Session;
+        // the tensors are bound by the binding, which goes before them. null while the buffers are released
+        FOrtTensor Input;
+        TArray<FOrtTensor> Outputs;
+        TOrtPtr<OrtIoBinding> Binding;
+    };
+}
+
+#endif
+
+TUniquePtr<IInferenceBackend> CreateOnnxRuntimeBackend(const FString& ModelName) {
+#if WITH_ONNXRUNTIME
+    FString ModelDir = CVarNNOrtModelDir.GetValueOnAnyThread();
+    if (ModelDir.IsEmpty()) {
+        ModelDir = FPaths::Combine(FPaths::ProjectContentDir(), TEXT("Models"));
+    }
+    // same convention as the inference server's --model-dir: the file is named after the model asset
+    const FString Path = FPaths::Combine(ModelDir, ModelName + TEXT(".onnx"));
+    if (!FPaths::FileExists(Path)) {
+        UE_LOG(LogTemp, Warning, TEXT("ORT: %s not found"), *Path);
+        return nullptr;
+    }
+
+    TUniquePtr<FOnnxRuntimeBackend> Backend = MakeUnique<FOnnxRuntimeBackend>();
+    const double StartSeconds = FPlatformTime::Seconds();
+    if (!Backend->Load(Path, ModelName)) {
+        return nullptr;
+    }
+    UE_LOG(LogTemp, Log, TEXT("ORT: loaded %s%s in %f seconds (intra-op %d, inter-op %d, optimization %d)"), *Path,
+        Backend->IsFromCache() ? TEXT(" from the model cache") : TEXT(""), FPlatformTime::Seconds() - StartSeconds, CVarNNOrtIntraOpThreads.GetValueOnAnyThread(),
+        CVarNNOrtInterOpThreads.GetValueOnAnyThread(), CVarNNOrtGraphOptimization.GetValueOnAnyThread());
+    return Backend;
+#else
+    UE_LOG(LogTemp, Warning, TEXT("ORT: onnx runtime is not compiled in, see Source/ThirdParty/OnnxRuntime"));
+    return nullptr;
+#endif
+}
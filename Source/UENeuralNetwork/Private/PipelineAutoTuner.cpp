@@ -0,0 +1,193 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "PipelineAutoTuner.h"
+
+#include "InferenceQoS.h"
+#include "InferenceThreadPool.h"
+#include "PipelineSettings.h"
+#include "RemoteInference.h"
+#include "Misc/ConfigCacheIni.h"
+#include "Misc/SecureHash.h"
+
+namespace {
+    // set from an ini, the command line or the console: the user's value is measured as it is and never overwritten
+    bool IsPinned(IConsoleVariable* Variable) {
+        const uint32 SetBy = Variable->GetFlags() & ECVF_SetByMask;
+        return SetBy != ECVF_SetByConstructor && SetBy != ECVF_SetByCode;
+    }
+
+    template <typename T>
+    void ApplyTuned(TAutoConsoleVariable<T>& Variable, T Value) {
+        if (IsPinned(Variable.AsVariable())) {
+            UE_LOG(LogTemp, Log, TEXT("AutoTune: %s is set by the user, kept"), *IConsoleManager::Get().FindConsoleObjectName(Variable.AsVariable()));
+            return;
+        }
+        Variable->Set(Value, ECVF_SetByCode);
+    }
+
+    // nn.UseGPU only moves the NNI asset. ORT and the inference server run where they run, sweeping the device would only
+    // measure noise and save it
+    bool CanSweepDevice(UMyNeuralNetwork* Network) {
+        const IInferenceBackend* Backend = Network->GetBackend();
+        return Backend != nullptr && FCString::Stricmp(Backend->GetName(), TEXT("NNI")) == 0 && !FRemoteInferenceClient::IsEnabled();
+    }
+
+    TArray<FPipelineTuningConfig> MakeSweep(const FPipelineTuningConfig& Base, bool bSweepDevice) {
+        const int32 MaxWorkers = FInferenceThreadPool::Get().GetNumThreads();
+        TArray<int32> WorkerCounts = { 1, 2, 4, 0 };
+        WorkerCounts.RemoveAll([MaxWorkers](int32 Count) { return Count >= MaxWorkers; });
+        TArray<bool> Devices = { false, true };
+        TArray<int32> MinBatches = { 1024, 4096, 16384 };
+        if (!bSweepDevice || IsPinned(CVarNNUseGPU.AsVariable())) {
+            Devices = { Base.bUseGPU };
+        }
+        if (IsPinned(CVarNNWorkerCount.AsVariable())) {
+            WorkerCounts = { Base.WorkerCount };
+        }
+        if (IsPinned(CVarNNParallelForMinBatch.AsVariable())) {
+            MinBatches = { Base.ParallelForMinBatch };
+        }
+
+        TArray<FPipelineTuningConfig> Sweep;
+        for (bool bUseGPU : Devices) {
+            for (int32 WorkerCount : WorkerCounts) {
+                for (int32 MinBatch : MinBatches) {
+                    FPipelineTuningConfig Config = Base;
+                    Config.bUseGPU = bUseGPU;
+                    Config.WorkerCount = WorkerCount;
+                    Config.ParallelForMinBatch = MinBatch;
+                    Sweep.Add(Config);
+                }
+            }
+        }
+        return Sweep;
+    }
+
+    ENeuralDeviceType ToDeviceType(bool bUseGPU) {
+        return bUseGPU ? ENeuralDeviceType::GPU : ENeuralDeviceType::CPU;
+    }
+
+    // the real preprocessing and model, but nothing is published: the frames are old and have no id
+    double MeasureFrame(const TArray<FColor>& Frame, FScreenImageProperties ScreenImage, FModelImageProperties ModelImage,
+        UMyNeuralNetwork* Network) {
+        AsyncInferenceTask Task(Frame, ScreenImage, ModelImage, Network);
+        Task.SetPublish(false);
+        Task.DoWork();
+        return Task.GetElapsedSeconds();
+    }
+}
+
+FPipelineTuningResult FPipelineAutoTuner::Run(const TArray<TArray<FColor>>& Frames, FScreenImageProperties ScreenImage,
+    FModelImageProperties ModelImage, UMyNeuralNetwork* Network, double GameFrameSeconds) {
+    const FPipelineTuningConfig Original = ReadConsoleVariables();
+    FPipelineTuningResult Best;
+    Best.Config = Original;
+    Best.P95LatencySeconds = TNumericLimits<double>::Max();
+    if (Frames.Num() == 0 || Network == nullptr || Network->Network == nullptr) {
+        return Best;
+    }
+
+    bool bDeviceIsGPU = Original.bUseGPU;
+    for (const FPipelineTuningConfig& Config : MakeSweep(Original, CanSweepDevice(Network))) {
+        if (Config.bUseGPU != bDeviceIsGPU) {
+            if (!Network->Network->SetDeviceType(ToDeviceType(Config.bUseGPU))) {
+                continue; // device not supported on this machine
+            }
+            bDeviceIsGPU = Config.bUseGPU;
+            Network->WarmUp(1);
+        }
+        SetPipelineParallelForOverride(Config.WorkerCount, Config.ParallelForMinBatch);
+
+        // one untimed pass so caches and the task graph are warm, then every recorded frame timed
+        MeasureFrame(Frames[0], ScreenImage, ModelImage, Network);
+        FInferenceLatencyTracker Tracker(Frames.Num());
+        double TotalSeconds = 0.0;
+        for (const TArray<FColor>& Frame : Frames) {
+            const double Seconds = MeasureFrame(Frame, ScreenImage, ModelImage, Network);
+            Tracker.AddSample(Seconds);
+            TotalSeconds += Seconds;
+        }
+
+        FPipelineTuningResult Result;
+        Result.Config = Config;
+        Result.MeanLatencySeconds = TotalSeconds / Frames.Num();
+        Result.P95LatencySeconds = Tracker.Percentile(0.95);
+        Result.FramesPerSecond = Frames.Num() / FMath::Max(TotalSeconds, UE_SMALL_NUMBER);
+        UE_LOG(LogTemp, Log, TEXT("AutoTune: %s workers=%d minbatch=%d -> mean %.2f ms, p95 %.2f ms, %.1f fps"),
+            Config.bUseGPU ? TEXT("gpu") : TEXT("cpu"), Config.WorkerCount, Config.ParallelForMinBatch,
+            Result.MeanLatencySeconds * 1000.0, Result.P95LatencySeconds * 1000.0, Result.FramesPerSecond);
+
+        if (Result.P95LatencySeconds < Best.P95LatencySeconds) {
+            Best = Result;
+        }
+    }
+
+    // capture no more often than one inference can finish
+    Best.Config.FrameMod = FMath::Max(1, FMath::CeilToInt(Best.MeanLatencySeconds / FMath::Max(GameFrameSeconds, UE_SMALL_NUMBER)));
+
+    ClearPipelineParallelForOverride();
+    if (bDeviceIsGPU != Best.Config.bUseGPU) {
+        Network->Network->SetDeviceType(ToDeviceType(Best.Config.bUseGPU));
+    }
+    return Best;
+}
+
+FPipelineTuningConfig FPipelineAutoTuner::ReadConsoleVariables() {
+    FPipelineTuningConfig Config;
+    Config.FrameMod = CVarNNFrameMod.GetValueOnAnyThread();
+    Config.ConfidenceThreshold = CVarNNConfidenceThreshold.GetValueOnAnyThread();
+    Config.bUseGPU = CVarNNUseGPU.GetValueOnAnyThread() != 0;
+    Config.WorkerCount = CVarNNWorkerCount.GetValueOnAnyThread();
+    Config.ParallelForMinBatch = CVarNNParallelForMinBatch.GetValueOnAnyThread();
+    return Config;
+}
+
+void FPipelineAutoTuner::ApplyToConsoleVariables(const FPipelineTuningConfig& Config) {
+    check(IsInGameThread());
+    ApplyTuned(CVarNNFrameMod, Config.FrameMod);
+    ApplyTuned(CVarNNConfidenceThreshold, Config.ConfidenceThreshold);
+    ApplyTuned(CVarNNUseGPU, Config.bUseGPU ? 1 : 0);
+    ApplyTuned(CVarNNWorkerCount, Config.WorkerCount);
+    ApplyTuned(CVarNNParallelForMinBatch, Config.ParallelForMinBatch);
+}
+
+bool FPipelineAutoTuner::LoadMachineConfig(FPipelineTuningConfig& OutConfig) {
+    const FString Filename = GetConfigFilename();
+    const FString Section = GetMachineSection();
+    FPipelineTuningConfig Config;
+    int32 UseGPU = 0;
+    if (!GConfig->GetInt(*Section, TEXT("FrameMod"), Config.FrameMod, Filename)) {
+        return false;
+    }
+    GConfig->GetFloat(*Section, TEXT("ConfidenceThreshold"), Config.ConfidenceThreshold, Filename);
+    GConfig->GetInt(*Section, TEXT("UseGPU"), UseGPU, Filename);
+    GConfig->GetInt(*Section, TEXT("WorkerCount"), Config.WorkerCount, Filename);
+    GConfig->GetInt(*Section, TEXT("ParallelForMinBatch"), Config.ParallelForMinBatch, Filename);
+    Config.bUseGPU = UseGPU != 0;
+    OutConfig = Config;
+    return true;
+}
+
+void FPipelineAutoTuner::SaveMachineConfig(const FPipelineTuningConfig& Config) {
+    const FString Filename = GetConfigFilename();
+    const FString Section = GetMachineSection();
+    GConfig->SetString(*Section, TEXT("Machine"), *FString::Printf(TEXT("%s | %s | %d cores"), *FPlatformMisc::GetCPUBrand(),
+        *FPlatformMisc::GetPrimaryGPUBrand(), FPlatformMisc::NumberOfCoresIncludingHyperthreads()), Filename);
+    GConfig->SetInt(*Section, TEXT("FrameMod"), Config.FrameMod, Filename);
+    GConfig->SetFloat(*Section, TEXT("ConfidenceThreshold"), Config.ConfidenceThreshold, Filename);
+    GConfig->SetInt(*Section, TEXT("UseGPU"), Config.bUseGPU ? 1 : 0, Filename);
+    GConfig->SetInt(*Section, TEXT("WorkerCount"), Config.WorkerCount, Filename);
+    GConfig->SetInt(*Section, TEXT("ParallelForMinBatch"), Config.ParallelForMinBatch, Filename);
+    GConfig->Flush(false, Filename);
+}
+
+FString FPipelineAutoTuner::GetConfigFilename() {
+    return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Config"), TEXT("DetectionPipelineTuning.ini"));
+}
+
+FString FPipelineAutoTuner::GetMachineSection() {
+    // the same build on the same hardware gets the same section
+    const FString Machine = FString::Printf(TEXT("%s|%s|%d"), *FPlatformMisc::GetCPUBrand(), *FPlatformMisc::GetPrimaryGPUBrand(),
+        FPlatformMisc::NumberOfCoresIncludingHyperthreads());
+    return FString::Printf(TEXT("Machine.%s"), *FMD5::HashAnsiString(*Machine));
+}
@@ -0,0 +1,112 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "PipelineMemory.h"
+
+#include "HAL/IConsoleManager.h"
+
+LLM_DEFINE_TAG(DetectionPipeline);
+LLM_DEFINE_TAG(DetectionPipeline_Capture, TEXT("Capture"), TEXT("DetectionPipeline"));
+LLM_DEFINE_TAG(DetectionPipeline_Preprocess, TEXT("Preprocess"), TEXT("DetectionPipeline"));
+LLM_DEFINE_TAG(DetectionPipeline_Inference, TEXT("Inference"), TEXT("DetectionPipeline"));
+LLM_DEFINE_TAG(DetectionPipeline_Results, TEXT("Results"), TEXT("DetectionPipeline"));
+LLM_DEFINE_TAG(DetectionPipeline_Overlay, TEXT("Overlay"), TEXT("DetectionPipeline"));
+
+static TAutoConsoleVariable<float> CVarNNMemoryBudgetMB(
+    TEXT("nn.Memory.BudgetMB"), 0.f,
+    TEXT("Warn when the detection pipeline holds more than this many MB (in-flight frames plus resident buffers). 0 = off."),
+    ECVF_Default);
+
+namespace {
+    constexpr int32 NumStages = static_cast<int32>(EPipelineMemoryStage::Num);
+
+    struct FStageCounters {
+        std::atomic<int64> Bytes{ 0 };
+        std::atomic<int64> PeakBytes{ 0 };
+        std::atomic<int32> Frames{ 0 };
+    };
+    FStageCounters Stages[NumStages];
+
+    // at most one budget warning per this many seconds
+    constexpr double BudgetWarningInterval = 10.0;
+    std::atomic<double> LastBudgetWarningSeconds{ -BudgetWarningInterval };
+
+    FStageCounters& GetStage(EPipelineMemoryStage Stage) {
+        return Stages[FMath::Clamp(static_cast<int32>(Stage), 0, NumStages - 1)];
+    }
+
+    double ToMB(int64 Bytes) {
+        return Bytes / (1024.0 * 1024.0);
+    }
+}
+
+void FPipelineMemory::Add(EPipelineMemoryStage Stage, int64 Bytes, int32 Frames) {
+    FStageCounters& Counters = GetStage(Stage);
+    const int64 NewBytes = Counters.Bytes.fetch_add(Bytes, std::memory_order_relaxed) + Bytes;
+    Counters.Frames.fetch_add(Frames, std::memory_order_relaxed);
+    int64 Peak = Counters.PeakBytes.load(std::memory_order_relaxed);
+    while (NewBytes > Peak && !Counters.PeakBytes.compare_exchange_weak(Peak, NewBytes, std::memory_order_relaxed)) {
+    }
+}
+
+void FPipelineMemory::Remove(EPipelineMemoryStage Stage, int64 Bytes, int32 Frames) {
+    FStageCounters& Counters = GetStage(Stage);
+    Counters.Bytes.fetch_sub(Bytes, std::memory_order_relaxed);
+    Counters.Frames.fetch_sub(Frames, std::memory_order_relaxed);
+}
+
+int64 FPipelineMemory::GetBytes(EPipelineMemoryStage Stage) {
+    return GetStage(Stage).Bytes.load(std::memory_order_relaxed);
+}
+
+int64 FPipelineMemory::GetPeakBytes(EPipelineMemoryStage Stage) {
+    return GetStage(Stage).PeakBytes.load(std::memory_order_relaxed);
+}
+
+int32 FPipelineMemory::GetFrames(EPipelineMemoryStage Stage) {
+    return GetStage(Stage).Frames.load(std::memory_order_relaxed);
+}
+
+int64 FPipelineMemory::GetTotalBytes() {
+    int64 Total = 0;
+    for (int32 i = 0; i < NumStages; i++) {
+        Total += Stages[i].Bytes.load(std::memory_order_relaxed);
+    }
+    return Total;
+}
+
+const TCHAR* FPipelineMemory::GetStageName(EPipelineMemoryStage Stage) {
+    switch (Stage) {
+    case EPipelineMemoryStage::Readback: return TEXT("Readback");
+    case EPipelineMemoryStage::Queued: return TEXT("Queued");
+    case EPipelineMemoryStage::Inference: return TEXT("Inference");
+    case EPipelineMemoryStage::Scratch: return TEXT("Scratch");
+    default: return TEXT("Unknown");
+    }
+}
+
+void FPipelineMemory::LogStages() {
+    for (int32 i = 0; i < NumStages; i++) {
+        const EPipelineMemoryStage Stage = static_cast<EPipelineMemoryStage>(i);
+        UE_LOG(LogTemp, Log, TEXT("  %-10s %3d frames %8.2f MB (peak %.2f MB)"), GetStageName(Stage), GetFrames(Stage),
+            ToMB(GetBytes(Stage)), ToMB(GetPeakBytes(Stage)));
+    }
+}
+
+void FPipelineMemory::CheckBudget(int64 ResidentBytes) {
+    const float BudgetMB = CVarNNMemoryBudgetMB.GetValueOnAnyThread();
+    if (BudgetMB <= 0.f) {
+        return;
+    }
+    const int64 TotalBytes = GetTotalBytes() + ResidentBytes;
+    if (ToMB(TotalBytes) <= BudgetMB) {
+        return;
+    }
+    const double Now = FPlatformTime::Seconds();
+    double Last = LastBudgetWarningSeconds.load(std::memory_order_relaxed);
+    if (Now - Last < BudgetWarningInterval || !LastBudgetWarningSeconds.compare_exchange_strong(Last, Now)) {
+        return;
+    }
+    UE_LOG(LogTemp, Warning, TEXT("Detection pipeline holds %.2f MB, over the %.2f MB budget (nn.Memory.BudgetMB). resident %.2f MB, in flight:"),
+        ToMB(TotalBytes), BudgetMB, ToMB(ResidentBytes));
+    LogStages();
+}
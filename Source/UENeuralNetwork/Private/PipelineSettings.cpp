@@ -0,0 +1,72 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "PipelineSettings.h"
+
+#include "InferenceThreadPool.h"
+#include "FrameTrace.h"
+
+#include <atomic>
+
+TAutoConsoleVariable<int32> CVarNNFrameMod(
+    TEXT("nn.FrameMod"), 5,
+    TEXT("Capture a frame for detection every N game frames."),
+    ECVF_Default);
+
+TAutoConsoleVariable<float> CVarNNConfidenceThreshold(
+    TEXT("nn.ConfidenceThreshold"), 0.65f,
+    TEXT("Minimum class score for a box to be kept."),
+    ECVF_Default);
+
+TAutoConsoleVariable<int32> CVarNNUseGPU(
+    TEXT("nn.UseGPU"), 0,
+    TEXT("Run the model on the GPU (1) or CPU (0). Applied between inferences."),
+    ECVF_Default);
+
+TAutoConsoleVariable<int32> CVarNNWorkerCount(
+    TEXT("nn.WorkerCount"), 0,
+    TEXT("Max number of parallel ranges for preprocessing (0 = one per detection pool thread)."),
+    ECVF_Default);
+
+TAutoConsoleVariable<int32> CVarNNParallelForMinBatch(
+    TEXT("nn.ParallelForMinBatch"), 4096,
+    TEXT("Min number of elements per parallel range in preprocessing."),
+    ECVF_Default);
+
+namespace {
+    // MinBatch 0 means no override
+    std::atomic<int32> OverrideWorkerCount{ 0 };
+    std::atomic<int32> OverrideMinBatch{ 0 };
+}
+
+void SetPipelineParallelForOverride(int32 WorkerCount, int32 MinBatch) {
+    OverrideWorkerCount = WorkerCount;
+    OverrideMinBatch = FMath::Max(1, MinBatch);
+}
+
+void ClearPipelineParallelForOverride() {
+    OverrideMinBatch = 0;
+}
+
+void PipelineParallelFor(int32 Num, TFunctionRef<void(int32 Begin, int32 End)> Body, int32 ElementsPerItem) {
+    if (Num <= 0) {
+        return;
+    }
+    const int32 OverrideBatch = OverrideMinBatch;
+    int32 MaxRanges = OverrideBatch > 0 ? OverrideWorkerCount.load() : CVarNNWorkerCount.GetValueOnAnyThread();
+    if (MaxRanges <= 0) {
+        MaxRanges = FInferenceThreadPool::Get().GetNumThreads();
+    }
+    const int32 MinBatch = FMath::Max(1, OverrideBatch > 0 ? OverrideBatch : CVarNNParallelForMinBatch.GetValueOnAnyThread());
+    const int32 NumRanges = FMath::Clamp(static_cast<int32>(static_cast<int64>(Num) * ElementsPerItem / MinBatch), 1, FMath::Min(MaxRanges, Num));
+    const int32 RangeSize = FMath::DivideAndRoundUp(Num, NumRanges);
+
+    // stays inside the detection pool, never fans out into the task graph
+    FInferenceThreadPool::Get().ParallelFor(NumRanges, [&](int32 RangeIndex) {
+        const int32 Begin = RangeIndex * RangeSize;
+        const int32 End = FMath::Min(Begin + RangeSize, Num);
+        if (Begin < End) {
+            FScopedFrameTrace Trace(TEXT("ParallelRange"));
+            Body(Begin, End);
+        }
+        });
+}
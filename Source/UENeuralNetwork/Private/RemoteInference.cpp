@@ -0,0 +1,387 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "RemoteInference.h"
+
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformProcess.h"
+#include "Misc/CoreDelegates.h"
+#include "Misc/ScopeExit.h"
+
+#define WITH_REMOTE_INFERENCE (PLATFORM_UNIX || PLATFORM_MAC)
+
+#if WITH_REMOTE_INFERENCE
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+static TAutoConsoleVariable<int32> CVarNNRemoteEnable(
+    TEXT("nn.Remote.Enable"), 0,
+    TEXT("Run the networks in the out-of-process inference server (Tools/InferenceServer) instead of in the game."),
+    ECVF_Default);
+
+static TAutoConsoleVariable<FString> CVarNNRemoteSocket(
+    TEXT("nn.Remote.Socket"), ANSI_TO_TCHAR(InferenceServer::kDefaultSocketPath),
+    TEXT("Unix domain socket of the inference server."),
+    ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarNNRemoteSlots(
+    TEXT("nn.Remote.Slots"), 4,
+    TEXT("Requests that can be in flight at once. Read when connecting."),
+    ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarNNRemoteTimeoutMs(
+    TEXT("nn.Remote.TimeoutMs"), 2000,
+    TEXT("A request that takes longer fails and the frame runs locally; the connection is dropped and re-established."),
+    ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarNNRemoteLoadTimeoutMs(
+    TEXT("nn.Remote.LoadTimeoutMs"), 30000,
+    TEXT("Timeout of the first request of a model on a connection, the server loads the model for it."),
+    ECVF_Default);
+
+namespace {
+    // between connection attempts while the server is not there
+    constexpr double ReconnectIntervalSeconds = 3.0;
+
+    InferenceServer::SlotHeader& GetSlot(InferenceServer::RegionHeader* Header, int32 Slot) {
+        return reinterpret_cast<InferenceServer::SlotHeader*>(reinterpret_cast<uint8*>(Header) + Header->SlotsOffset)[Slot];
+    }
+
+    uint8* GetSlotData(InferenceServer::RegionHeader* Header, int32 Slot) {
+        return reinterpret_cast<uint8*>(Header) + Header->DataOffset + Slot * Header->SlotDataBytes;
+    }
+}
+
+FRemoteInferenceClient& FRemoteInferenceClient::Get() {
+    static FRemoteInferenceClient Instance;
+    return Instance;
+}
+
+bool FRemoteInferenceClient::IsEnabled() {
+#if WITH_REMOTE_INFERENCE
+    return CVarNNRemoteEnable.GetValueOnAnyThread() != 0;
+#else
+    return false;
+#endif
+}
+
+bool FRemoteInferenceClient::Run(const FString& Model, InferenceServer::EDataType Type, const TArray<int64>& Dims, const void* Input,
+    int64 InputBytes, int64 OutputBytes, TArray<TArray<float>>& OutOutputs) {
+#if WITH_REMOTE_INFERENCE
+    using namespace InferenceServer;
+
+    if (Dims.Num() > static_cast<int32>(kMaxDims)) {
+        return false;
+    }
+    // every tensor starts aligned, so leave room for the padding of each of them
+    const uint64 RequiredBytes = AlignData(InputBytes) + AlignData(OutputBytes) + kMaxOutputs * kDataAlignment;
+
+    uint64 ConnectBytes = 0;
+    {
+        FScopeLock ScopeLock(&Lock);
+        if (bClosing || bConnecting) {
+            return false;
+        }
+        if (Socket < 0 || SlotDataBytes < RequiredBytes) {
+            // a bigger model (another variant) needs a bigger region, which can only be swapped while nothing is in flight
+            if (NumSlotsInUse > 0 || FPlatformTime::Seconds() < NextConnectSeconds) {
+                return false;
+            }
+            CloseLocked();
+            ConnectBytes = FMath::Max(RequiredBytes, SlotDataBytes);
+            bConnecting = true;
+        }
+    }
+    // connecting waits for the server's answer, the other tasks run locally instead of blocking on Lock meanwhile
+    if (ConnectBytes > 0 && !Connect(ConnectBytes)) {
+        FScopeLock ScopeLock(&Lock);
+        bConnecting = false;
+        NextConnectSeconds = FPlatformTime::Seconds() + ReconnectIntervalSeconds;
+        return false;
+    }
+
+    int32 Slot = INDEX_NONE;
+    double TimeoutSeconds = CVarNNRemoteTimeoutMs.GetValueOnAnyThread() / 1000.0;
+    {
+        FScopeLock ScopeLock(&Lock);
+        if (bBroken || bClosing || Socket < 0) {
+            return false;
+        }
+        Slot = SlotInUse.Find(false);
+        if (Slot == INDEX_NONE) {
+            return false; // all slots busy, this frame runs locally
+        }
+        SlotInUse[Slot] = true;
+        NumSlotsInUse++;
+        if (!LoadedModels.Contains(Model)) {
+            TimeoutSeconds = FMath::Max(TimeoutSeconds, CVarNNRemoteLoadTimeoutMs.GetValueOnAnyThread() / 1000.0);
+        }
+    }
+
+    SlotHeader& Request = GetSlot(Header, Slot);
+    uint8* Data = GetSlotData(Header, Slot);
+    FMemory::Memzero(Request.Model);
+    FCStringAnsi::Strncpy(Request.Model, TCHAR_TO_ANSI(*Model), kNameLength);
+    Request.RequestId = NextRequestId.fetch_add(1, std::memory_order_relaxed);
+    Request.Input.Type = Type;
+    Request.Input.NumDims = Dims.Num();
+    for (int32 i = 0; i < Dims.Num(); i++) {
+        Request.Input.Dims[i] = Dims[i];
+    }
+    Request.Input.Offset = 0;
+    Request.Input.Bytes = InputBytes;
+    Request.NumOutputs = 0;
+    Request.Error[0] = 0;
+    FMemory::Memcpy(Data, Input, InputBytes);
+    Request.State.store(static_cast<uint32>(ESlotState::Submitted), std::memory_order_release);
+
+    Message Doorbell = {};
+    Doorbell.Type = EMessageType::Run;
+    Doorbell.Slot = Slot;
+    Doorbell.RequestId = Request.RequestId;
+    if (!SendMessage(Doorbell) || !WaitForSlot(Slot, TimeoutSeconds)) {
+        // the server may still write into the slot, it is only reused after reconnecting
+        ReleaseSlot(Slot, true);
+        return false;
+    }
+
+    const bool bDone = Request.State.load(std::memory_order_acquire) == static_cast<uint32>(ESlotState::Done);
+    if (!bDone) {
+        UE_LOG(LogTemp, Warning, TEXT("Inference server failed %s: %s"), *Model, ANSI_TO_TCHAR(Request.Error));
+    } else {
+        OutOutputs.SetNum(static_cast<int32>(FMath::Min(Request.NumOutputs, kMaxOutputs)));
+        for (int32 i = 0; i < OutOutputs.Num(); i++) {
+            const TensorDesc& Output = Request.Outputs[i];
+            if (Output.Type != EDataType::Float32 || Output.Offset + Output.Bytes > Header->SlotDataBytes) {
+                OutOutputs.Reset();
+                break;
+            }
+            OutOutputs[i].SetNumUninitialized(Output.Bytes / sizeof(float));
+            FMemory::Memcpy(OutOutputs[i].GetData(), Data + Output.Offset, Output.Bytes);
+        }
+    }
+    Request.State.store(static_cast<uint32>(ESlotState::Free), std::memory_order_relaxed);
+    if (bDone) {
+        FScopeLock ScopeLock(&Lock);
+        LoadedModels.Add(Model);
+    }
+    ReleaseSlot(Slot, false);
+    return bDone && OutOutputs.Num() > 0;
+#else
+    return false;
+#endif
+}
+
+void FRemoteInferenceClient::ReleaseSlot(int32 Slot, bool bInBroken) {
+    FScopeLock ScopeLock(&Lock);
+    SlotInUse[Slot] = false;
+    NumSlotsInUse--;
+    bBroken |= bInBroken;
+    if (bBroken && NumSlotsInUse == 0) {
+        UE_LOG(LogTemp, Warning, TEXT("Inference server connection lost, running locally until it is back"));
+        CloseLocked();
+        NextConnectSeconds = FPlatformTime::Seconds() + ReconnectIntervalSeconds;
+    }
+}
+
+bool FRemoteInferenceClient::Connect(uint64 InSlotDataBytes) {
+#if WITH_REMOTE_INFERENCE
+    using namespace InferenceServer;
+
+    // built up locally, installed under Lock once the server accepted it
+    int32 NewSocket = -1;
+    FPlatformMemory::FSharedMemoryRegion* NewRegion = nullptr;
+    bool bConnected = false;
+    ON_SCOPE_EXIT{
+        if (!bConnected) {
+            if (NewSocket >= 0) {
+                close(NewSocket);
+            }
+            if (NewRegion != nullptr) {
+                FPlatformMemory::UnmapNamedSharedMemoryRegion(NewRegion);
+            }
+        }
+    };
+
+    const FString SocketPath = CVarNNRemoteSocket.GetValueOnAnyThread();
+    NewSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (NewSocket < 0) {
+        return false;
+    }
+#if PLATFORM_MAC
+    int NoSigPipe = 1;
+    setsockopt(NewSocket, SOL_SOCKET, SO_NOSIGPIPE, &NoSigPipe, sizeof(NoSigPipe));
+#endif
+    sockaddr_un Address = {};
+    Address.sun_family = AF_UNIX;
+    FCStringAnsi::Strncpy(Address.sun_path, TCHAR_TO_ANSI(*SocketPath), sizeof(Address.sun_path));
+    if (connect(NewSocket, reinterpret_cast<sockaddr*>(&Address), sizeof(Address)) != 0) {
+        return false;
+    }
+
+    // the region belongs to this process, the server only attaches to it
+    const uint32 SlotCount = FMath::Clamp(CVarNNRemoteSlots.GetValueOnAnyThread(), 1, 64);
+    const FString RegionName = FString::Printf(TEXT("UENNInfer_%u_%u"), FPlatformProcess::GetCurrentProcessId(), ++ConnectCount);
+    const uint64 Size = RegionSize(SlotCount, InSlotDataBytes);
+    NewRegion = FPlatformMemory::MapNamedSharedMemoryRegion(RegionName, true,
+        static_cast<uint32>(FPlatformMemory::ESharedMemoryAccess::Read) | static_cast<uint32>(FPlatformMemory::ESharedMemoryAccess::Write), Size);
+    if (NewRegion == nullptr) {
+        UE_LOG(LogTemp, Error, TEXT("Inference server: could not create shared memory region %s"), *RegionName);
+        return false;
+    }
+    FMemory::Memzero(NewRegion->GetAddress(), Size);
+    RegionHeader* NewHeader = static_cast<RegionHeader*>(NewRegion->GetAddress());
+    NewHeader->Version = kVersion;
+    NewHeader->SlotCount = SlotCount;
+    NewHeader->SlotHeaderSize = sizeof(SlotHeader);
+    NewHeader->SlotDataBytes = InSlotDataBytes;
+    NewHeader->SlotsOffset = SlotsOffset();
+    NewHeader->DataOffset = DataOffset(SlotCount);
+    NewHeader->Magic.store(kMagic, std::memory_order_release);
+
+    Message Hello = {};
+    Hello.Type = EMessageType::Hello;
+    FCStringAnsi::Strncpy(Hello.Region, TCHAR_TO_ANSI(*RegionName), kNameLength);
+    Message Welcome = {};
+    pollfd Poll = { NewSocket, POLLIN, 0 };
+#ifdef MSG_NOSIGNAL
+    const int Flags = MSG_NOSIGNAL;
+#else
+    const int Flags = 0;
+#endif
+    if (send(NewSocket, &Hello, sizeof(Hello), Flags) != sizeof(Hello) || poll(&Poll, 1, CVarNNRemoteTimeoutMs.GetValueOnAnyThread()) <= 0
+        || recv(NewSocket, &Welcome, sizeof(Welcome), MSG_WAITALL) != sizeof(Welcome) || Welcome.Type != EMessageType::Welcome || Welcome.Status != 0) {
+        UE_LOG(LogTemp, Warning, TEXT("Inference server at %s did not accept region %s"), *SocketPath, *RegionName);
+        return false;
+    }
+
+    {
+        FScopeLock ScopeLock(&Lock);
+        Socket = NewSocket;
+        Region = NewRegion;
+        Header = NewHeader;
+        SlotDataBytes = InSlotDataBytes;
+        SlotInUse.Init(false, SlotCount);
+        for (uint32 i = 0; i < SlotCount; i++) {
+            SlotEvents.Add(FPlatformProcess::GetSynchEventFromPool(false));
+        }
+        bBroken = false;
+        bConnecting = false;
+        bConnected = true;
+    }
+
+    static bool bRegisteredExit = false;
+    if (!bRegisteredExit) {
+        bRegisteredExit = true;
+        FCoreDelegates::OnPreExit.AddLambda([]() { FRemoteInferenceClient::Get().Close(); });
+    }
+    UE_LOG(LogTemp, Log, TEXT("Inference server: connected to %s, %u slots of %llu bytes in %s"), *SocketPath, SlotCount, InSlotDataBytes, *RegionName);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void FRemoteInferenceClient::Close() {
+    {
+        FScopeLock ScopeLock(&Lock);
+        bClosing = true;
+    }
+    // every request gives up after its timeout, so this ends. the region stays mapped while a slot still points into it
+    const double Deadline = FPlatformTime::Seconds() + CVarNNRemoteLoadTimeoutMs.GetValueOnAnyThread() / 1000.0 + 1.0;
+    for (;;) {
+        {
+            FScopeLock ScopeLock(&Lock);
+            const bool bIdle = NumSlotsInUse == 0 && !bConnecting;
+            if (bIdle || FPlatformTime::Seconds() > Deadline) {
+                if (bIdle) {
+                    CloseLocked();
+                } else {
+                    UE_LOG(LogTemp, Warning, TEXT("Inference server: %d requests still in flight, the region is left mapped"), NumSlotsInUse);
+                }
+                bClosing = false;
+                return;
+            }
+        }
+        FPlatformProcess::Sleep(0.001f);
+    }
+}
+
+void FRemoteInferenceClient::CloseLocked() {
+#if WITH_REMOTE_INFERENCE
+    if (Socket >= 0) {
+        close(Socket);
+        Socket = -1;
+    }
+#endif
+    if (Region != nullptr) {
+        FPlatformMemory::UnmapNamedSharedMemoryRegion(Region);
+        Region = nullptr;
+        Header = nullptr;
+    }
+    for (FEvent* Event : SlotEvents) {
+        FPlatformProcess::ReturnSynchEventToPool(Event);
+    }
+    SlotEvents.Reset();
+    SlotInUse.Reset();
+    SlotDataBytes = 0;
+    bBroken = false;
+    LoadedModels.Reset();
+}
+
+bool FRemoteInferenceClient::SendMessage(const InferenceServer::Message& Message) {
+#if WITH_REMOTE_INFERENCE
+    FScopeLock ScopeLock(&SendLock);
+#ifdef MSG_NOSIGNAL
+    const int Flags = MSG_NOSIGNAL;
+#else
+    const int Flags = 0;
+#endif
+    return send(Socket, &Message, sizeof(Message), Flags) == sizeof(Message);
+#else
+    return false;
+#endif
+}
+
+bool FRemoteInferenceClient::WaitForSlot(int32 Slot, double TimeoutSeconds) {
+#if WITH_REMOTE_INFERENCE
+    using namespace InferenceServer;
+
+    const SlotHeader& Request = GetSlot(Header, Slot);
+    const double Deadline = FPlatformTime::Seconds() + TimeoutSeconds;
+    for (;;) {
+        const uint32 State = Request.State.load(std::memory_order_acquire);
+        if (State == static_cast<uint32>(ESlotState::Done) || State == static_cast<uint32>(ESlotState::Failed)) {
+            return true;
+        }
+        if (FPlatformTime::Seconds() > Deadline) {
+            return false;
+        }
+        if (!ReceiveLock.TryLock()) {
+            // another waiter is reading the socket and wakes us if it sees our slot
+            SlotEvents[Slot]->Wait(5);
+            continue;
+        }
+        ON_SCOPE_EXIT{ ReceiveLock.Unlock(); };
+        pollfd Poll = { Socket, POLLIN, 0 };
+        const int Ready = poll(&Poll, 1, 5);
+        if (Ready < 0 && errno != EINTR) {
+            return false;
+        }
+        if (Ready > 0) {
+            Message Done;
+            if (recv(Socket, &Done, sizeof(Done), MSG_WAITALL) != sizeof(Done)) {
+                return false; // server went away
+            }
+            if (Done.Type == EMessageType::Done && Done.Slot < static_cast<uint32>(SlotEvents.Num())) {
+                SlotEvents[Done.Slot]->Trigger();
+            }
+        }
+    }
+#else
+    return false;
+#endif
+}
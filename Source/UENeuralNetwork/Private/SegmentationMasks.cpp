@@ -0,0 +1,116 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "SegmentationMasks.h"
+
+#include "Math/VectorRegister.h"
+#include "PipelineSettings.h"
+
+namespace {
+    // Row[0, Num) += Scale * Src[0, Num)
+    void AccumulateRow(float* RESTRICT Row, const float* RESTRICT Src, float Scale, int32 Num) {
+        const VectorRegister4Float VScale = VectorSetFloat1(Scale);
+        int32 X = 0;
+        for (; X + 4 <= Num; X += 4) {
+            VectorStore(VectorMultiplyAdd(VectorLoad(Src + X), VScale, VectorLoad(Row + X)), Row + X);
+        }
+        for (; X < Num; X++) {
+            Row[X] += Scale * Src[X];
+        }
+    }
+
+    void DecodeMask(const float* Coefficients, int32 NumAnchors, const FMaskPrototypes& Prototypes, float ModelToProtoX, float ModelToProtoY,
+        int32 ModelWidth, int32 ModelHeight, int32 ClassIndex, const UMyNeuralNetwork::FBoxCoordinates& Box, FDetectionMask& Out) {
+        Out.ClassIndex = ClassIndex;
+        Out.Score = Box.confidence;
+        Out.X = FMath::Clamp(FMath::FloorToInt(Box.x1), 0, ModelWidth);
+        Out.Y = FMath::Clamp(FMath::FloorToInt(Box.y1), 0, ModelHeight);
+        Out.Width = FMath::Clamp(FMath::CeilToInt(Box.x1 + Box.width), 0, ModelWidth) - Out.X;
+        Out.Height = FMath::Clamp(FMath::CeilToInt(Box.y1 + Box.height), 0, ModelHeight) - Out.Y;
+        Out.Runs.Reset();
+        if (Out.Width <= 0 || Out.Height <= 0 || Box.anchor < 0) {
+            return;
+        }
+
+        // prototype crop covering the box, one texel of margin for the bilinear filter
+        const int32 PX0 = FMath::Clamp(FMath::FloorToInt(Out.X * ModelToProtoX) - 1, 0, Prototypes.Width - 1);
+        const int32 PY0 = FMath::Clamp(FMath::FloorToInt(Out.Y * ModelToProtoY) - 1, 0, Prototypes.Height - 1);
+        const int32 PX1 = FMath::Clamp(FMath::CeilToInt((Out.X + Out.Width) * ModelToProtoX) + 1, PX0 + 1, Prototypes.Width);
+        const int32 PY1 = FMath::Clamp(FMath::CeilToInt((Out.Y + Out.Height) * ModelToProtoY) + 1, PY0 + 1, Prototypes.Height);
+        const int32 CropWidth = PX1 - PX0;
+        const int32 CropHeight = PY1 - PY0;
+
+        // yolov8-seg has 32, larger heads spill to the heap
+        const int32 NumCoefficients = Prototypes.NumCoefficients;
+        TArray<float, TInlineAllocator<64>> Coefficient;
+        Coefficient.SetNumUninitialized(NumCoefficients);
+        for (int32 K = 0; K < NumCoefficients; K++) {
+            Coefficient[K] = Coefficients[K * NumAnchors + Box.anchor];
+        }
+
+        // logits of the crop: row by row, the accumulator row stays in cache for all coefficients
+        TArray<float, TInlineAllocator<64 * 64>> Logits;
+        Logits.SetNumZeroed(CropWidth * CropHeight);
+        const int32 PlaneSize = Prototypes.Width * Prototypes.Height;
+        for (int32 Y = 0; Y < CropHeight; Y++) {
+            float* Row = Logits.GetData() + Y * CropWidth;
+            const float* Src = Prototypes.Data + (PY0 + Y) * Prototypes.Width + PX0;
+            for (int32 K = 0; K < NumCoefficients; K++) {
+                AccumulateRow(Row, Src + K * PlaneSize, Coefficient[K], CropWidth);
+            }
+        }
+
+        // bilinear taps per output column, computed once per box
+        TArray<int32, TInlineAllocator<256>> Column0;
+        TArray<float, TInlineAllocator<256>> ColumnWeight;
+        Column0.SetNumUninitialized(Out.Width);
+        ColumnWeight.SetNumUninitialized(Out.Width);
+        for (int32 X = 0; X < Out.Width; X++) {
+            const float Source = FMath::Clamp((Out.X + X + 0.5f) * ModelToProtoX - 0.5f - PX0, 0.f, CropWidth - 1.f);
+            Column0[X] = FMath::Min(FMath::FloorToInt(Source), FMath::Max(CropWidth - 2, 0));
+            ColumnWeight[X] = CropWidth > 1 ? Source - Column0[X] : 0.f;
+        }
+        const int32 NextColumn = CropWidth > 1 ? 1 : 0;
+
+        // upsample, threshold and run length encode in one pass
+        bool bForeground = false;
+        int32 RunLength = 0;
+        for (int32 Y = 0; Y < Out.Height; Y++) {
+            const float Source = FMath::Clamp((Out.Y + Y + 0.5f) * ModelToProtoY - 0.5f - PY0, 0.f, CropHeight - 1.f);
+            const int32 Row0 = FMath::Min(FMath::FloorToInt(Source), FMath::Max(CropHeight - 2, 0));
+            const float RowWeight = CropHeight > 1 ? Source - Row0 : 0.f;
+            const float* Top = Logits.GetData() + Row0 * CropWidth;
+            const float* Bottom = CropHeight > 1 ? Top + CropWidth : Top;
+            for (int32 X = 0; X < Out.Width; X++) {
+                const int32 C = Column0[X];
+                const float W = ColumnWeight[X];
+                const float Upper = Top[C] + (Top[C + NextColumn] - Top[C]) * W;
+                const float Lower = Bottom[C] + (Bottom[C + NextColumn] - Bottom[C]) * W;
+                const bool bInside = Upper + (Lower - Upper) * RowWeight > 0.f;
+                if (bInside != bForeground) {
+                    Out.Runs.Add(RunLength);
+                    RunLength = 0;
+                    bForeground = bInside;
+                }
+                RunLength++;
+            }
+        }
+        Out.Runs.Add(RunLength);
+    }
+}
+
+void DecodeMasks(const float* Coefficients, int32 NumAnchors, const FMaskPrototypes& Prototypes, int32 ModelWidth, int32 ModelHeight,
+    const TArray<TPair<int, UMyNeuralNetwork::FBoxCoordinates>>& Boxes, TArray<FDetectionMask>& OutMasks) {
+    OutMasks.SetNum(Boxes.Num());
+    if (Boxes.Num() == 0 || Prototypes.Data == nullptr) {
+        return;
+    }
+    const float ModelToProtoX = static_cast<float>(Prototypes.Width) / ModelWidth;
+    const float ModelToProtoY = static_cast<float>(Prototypes.Height) / ModelHeight;
+    // a box is a few thousand multiply adds per coefficient, worth spreading even for a handful of boxes
+    PipelineParallelFor(Boxes.Num(), [&](int32 Begin, int32 End) {
+        for (int32 i = Begin; i < End; i++) {
+            DecodeMask(Coefficients, NumAnchors, Prototypes, ModelToProtoX, ModelToProtoY, ModelWidth, ModelHeight,
+                Boxes[i].Key, Boxes[i].Value, OutMasks[i]);
+        }
+        }, Prototypes.Width * Prototypes.Height / 4);
+}
@@ -0,0 +1,127 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "DetectionPipelineBenchCommandlet.h"
+#include "DetectionPipelineBenchData.h"
+
+using namespace DetectionPipelineBench;
+
+namespace {
+    constexpr EAutomationTestFlags::Type DetectionTestFlags = static_cast<EAutomationTestFlags::Type>(
+        EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter);
+
+    // fewest allocator calls Body made in one of Runs runs. the counters are global, the minimum filters out what other
+    // threads allocated meanwhile. -1 without allocator stats
+    int64 MinAllocatorCalls(int32 Runs, TFunctionRef<void()> Body) {
+        Body(); // lazily created pools and caches are not per-frame allocations
+        int64 Min = -1;
+        for (int32 i = 0; i < Runs; i++) {
+            const int64 Before = GetAllocatorCalls();
+            Body();
+            const int64 After = GetAllocatorCalls();
+            if (Before < 0 || After < 0) {
+                return -1;
+            }
+            Min = Min < 0 ? After - Before : FMath::Min(Min, After - Before);
+        }
+        return Min;
+    }
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDetectionPreprocessTest, "UENeuralNetwork.DetectionPipeline.Preprocess", DetectionTestFlags)
+
+bool FDetectionPreprocessTest::RunTest(const FString& Parameters)
+{
+    // the specialized kernels of the shipped geometry and the generic ones must agree with the reference conversion
+    const FDetectionKernels* Specialized = FindDetectionKernels(Width, Height, 3, NumClasses, NumAnchors);
+    const FDetectionKernels* Generic = FindDetectionKernels(Width + 32, Height, 3, NumClasses, NumAnchors);
+    TestFalse(TEXT("shipped geometry has specialized kernels"), Specialized->IsGeneric());
+    TestTrue(TEXT("other geometries use the generic kernels"), Generic->IsGeneric());
+
+    for (const FDetectionKernels* Kernels : { Specialized, Generic }) {
+        const int32 FrameWidth = Kernels->IsGeneric() ? Width + 32 : Width;
+        const TArray<FColor> Frame = MakeFrame(FrameWidth, Height);
+        TArray<float> Tensor;
+        Tensor.SetNumUninitialized(Frame.Num() * 3);
+        Kernels->PreprocessFloat(Frame.GetData(), Tensor.GetData(), FrameWidth, Height);
+        TestTrue(FString::Printf(TEXT("%s preprocess matches"), Kernels->Name), CheckPreprocess(Frame, Tensor));
+    }
+
+    // a frame that is not the size the specialized kernels were built for still converts correctly
+    const TArray<FColor> Frame = MakeFrame(Width + 32, Height);
+    TArray<float> Tensor;
+    Tensor.SetNumUninitialized(Frame.Num() * 3);
+    Specialized->PreprocessFloat(Frame.GetData(), Tensor.GetData(), Width + 32, Height);
+    TestTrue(TEXT("specialized kernels fall back on other sizes"), CheckPreprocess(Frame, Tensor));
+    return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDetectionDecodeTest, "UENeuralNetwork.DetectionPipeline.Decode", DetectionTestFlags)
+
+bool FDetectionDecodeTest::RunTest(const FString& Parameters)
+{
+    const TArray<float> Output = MakeOutputTensor();
+    for (const FDetectionKernels* Kernels : { FindDetectionKernels(Width, Height, 3, NumClasses, NumAnchors), FindDetectionKernels(0, 0, 3, NumClasses, NumAnchors) }) {
+        FBoxCoordinatesMap Decoded;
+        Kernels->Decode(Output.GetData(), NumClasses, NumAnchors, GoldenThreshold, {}, Decoded);
+        TestTrue(FString::Printf(TEXT("%s decode matches"), Kernels->Name), CheckDecode(Decoded));
+
+        TArray<TPair<int, UMyNeuralNetwork::FBoxCoordinates>> Kept;
+        SuppressOverlappingBoxes(Decoded, Kept);
+        TestTrue(FString::Printf(TEXT("%s suppression matches"), Kernels->Name), CheckSuppress(Kept));
+    }
+
+    // a class list reads only its rows, each against its own threshold
+    const FDetectionKernels* Kernels = FindDetectionKernels(Width, Height, 3, NumClasses, NumAnchors);
+    const FDetectionClassThreshold Cars[] = { { 2, 0.4f } };
+    FBoxCoordinatesMap Decoded;
+    Kernels->Decode(Output.GetData(), NumClasses, NumAnchors, GoldenThreshold, Cars, Decoded);
+    TestEqual(TEXT("only the car row is decoded"), Decoded.Num(), 1);
+    TestEqual(TEXT("both cars are above their own threshold"), Decoded.Contains(2) ? Decoded[2].Num() : 0, 2);
+    return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDetectionAllocationTest, "UENeuralNetwork.DetectionPipeline.Allocations", DetectionTestFlags)
+
+bool FDetectionAllocationTest::RunTest(const FString& Parameters)
+{
+    if (GetAllocatorCalls() < 0) {
+        AddInfo(TEXT("The allocator does not count calls in this build, allocations not checked"));
+        return true;
+    }
+    // the per-frame budgets of the benchmark gate
+    const UDetectionPipelineBenchCommandlet* Budgets = GetDefault<UDetectionPipelineBenchCommandlet>();
+    const FDetectionKernels* Kernels = FindDetectionKernels(Width, Height, 3, NumClasses, NumAnchors);
+    constexpr int32 Runs = 8;
+
+    const TArray<FColor> Frame = MakeFrame(Width, Height);
+    TArray<float> Tensor;
+    Tensor.SetNumUninitialized(Width * Height * 3);
+    const int64 PreprocessCalls = MinAllocatorCalls(Runs, [&]() {
+        Kernels->PreprocessFloat(Frame.GetData(), Tensor.GetData(), Width, Height);
+        });
+    TestTrue(FString::Printf(TEXT("preprocess allocations (%lld) within budget (%d)"), PreprocessCalls, Budgets->PreprocessAllocationBudget),
+        PreprocessCalls <= Budgets->PreprocessAllocationBudget);
+
+    const TArray<float> Output = MakeOutputTensor();
+    FBoxCoordinatesMap Decoded;
+    const int64 DecodeCalls = MinAllocatorCalls(Runs, [&]() {
+        Decoded.Reset();
+        Kernels->Decode(Output.GetData(), NumClasses, NumAnchors, GoldenThreshold, {}, Decoded);
+        });
+    TestTrue(FString::Printf(TEXT("decode allocations (%lld) within budget (%d)"), DecodeCalls, Budgets->DecodeAllocationBudget),
+        DecodeCalls <= Budgets->DecodeAllocationBudget);
+
+    TArray<TPair<int, UMyNeuralNetwork::FBoxCoordinates>> Kept;
+    const int64 SuppressCalls = MinAllocatorCalls(Runs, [&]() {
+        SuppressOverlappingBoxes(Decoded, Kept);
+        });
+    TestTrue(FString::Printf(TEXT("suppression allocations (%lld) within budget (%d)"), SuppressCalls, Budgets->SuppressAllocationBudget),
+        SuppressCalls <= Budgets->SuppressAllocationBudget);
+    return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
@@ -9,6 +9,15 @@
 
 #include "NeuralNetwork.h"
 #include "MyNeuralNetwork.h"
+#include "InferenceQoS.h"
+#include "DetectionDeprojection.h"
+#include "SegmentationMasks.h"
+#include "CascadeGate.h"
+#include "DetectionSpatialIndex.h"
+#include "PipelineMemory.h"
+#include "DetectionViewExtension.h"
+#include "Async/Future.h"
+#include "Engine/LatentActionManager.h"
 
 #include "Components/ActorComponent.h"
 
@@ -23,35 +32,103 @@
 class AsyncInferenceTask;
 
 
+USTRUCT()
+struct FScreenImageProperties {
+	GENERATED_BODY()
+
+	int32 width;
+	int32 height;
+};
+
+USTRUCT()
+struct FModelImageProperties {
+	GENERATED_BODY()
+
+	int32 width;
+	int32 height;
+};
+
 USTRUCT()
 struct FRenderRequest {
 	GENERATED_BODY()
 
 	TArray<FColor> Image;
 	FRenderCommandFence RenderFence;
+	// decode instance masks for this frame (only has an effect with a segmentation model)
 	bool isPNG;
+	// size of the render target when this frame was captured (it changes when the model variant switches)
+	FScreenImageProperties ScreenImage = { 0 };
+	// follows the frame through readback, inference and overlay (see FrameTrace.h)
+	int64 FrameId = -1;
+	// FPlatformTime::Cycles64 when the capture was requested
+	uint64 CaptureCycles = 0;
+	// wall clock of the capture, unix epoch nanoseconds (detection stream / log timestamps)
+	uint64 CaptureTimestampNs = 0;
+	// read back in the same render command as Image when bCaptureDepth is set
+	FCaptureDepth Depth;
+	// bytes counted against the readback stage (see PipelineMemory.h)
+	int64 TrackedBytes = 0;
+	// pose and field of view of the capture component for this frame, the size is filled in when the task is created
+	FCaptureView CaptureView;
+	// atlas frames only: view of every sensor in tile order (invalid for a sensor that was not captured), and the tile
+	// grid of Image, AtlasColumns tiles of AtlasTileSize per row
+	TArray<FCaptureView> AtlasViews;
+	int32 AtlasColumns = 0;
+	FIntPoint AtlasTileSize = FIntPoint::ZeroValue;
 
 	FRenderRequest() {
 		isPNG = false;
 	}
 };
 
-USTRUCT()
-struct FScreenImageProperties {
+// one entry of the model registry. geometry (input size, classes, anchors) is read from the model itself
+USTRUCT(BlueprintType)
+struct FModelVariant {
 	GENERATED_BODY()
 
-	int32 width;
-	int32 height;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+		FName Name;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+		TSoftObjectPtr<UNeuralNetwork> Model;
 };
 
-USTRUCT()
-struct FModelImageProperties {
+// detections of one published frame
+USTRUCT(BlueprintType)
+struct FDetectionSnapshot {
 	GENERATED_BODY()
 
-	int32 width;
-	int32 height;
+	// -1 if the request was dropped (capture manager stopped before the frame was processed)
+	UPROPERTY(BlueprintReadOnly, Category = "Detection")
+		int64 FrameId = -1;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Detection")
+		TArray<FDetectionHit> Detections;
 };
 
+// where the frames for detection come from
+UENUM(BlueprintType)
+enum class EDetectionCaptureSource : uint8 {
+	// ColorCaptureComponents renders the scene a second time
+	SceneCapture,
+	// copy of what the player camera rendered (see DetectionViewExtension.h)
+	MainView,
+};
+
+// how much of the pipeline a capture manager runs right now (UCaptureManager::bEnableRelevance)
+UENUM(BlueprintType)
+enum class EDetectionRelevance : uint8 {
+	// captures every nn.FrameMod ticks
+	Full,
+	// captures nn.Relevance.ThrottleFactor times less often
+	Throttled,
+	// no capture, readback or inference, render targets and scratch buffers released
+	Suspended,
+};
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnDetectionsReady, const FDetectionSnapshot&, Snapshot);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnSensorDetectionsReady, int32, SensorIndex, const FDetectionSnapshot&, Snapshot);
+
 UCLASS(ClassGroup = (Custom), meta = (BlueprintSpawnableComponent))
 class UENEURALNETWORK_API UCaptureManager : public UActorComponent
 {
@@ -77,11 +154,165 @@ public:
 	
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Capture")
 		UTextureRenderTarget2D* RenderTarget2D;
+
+	// many small sensors (e.g. one per agent) detected together. when set, every periodic capture renders each sensor
+	// into its tile of one atlas target at the model size, reads the atlas back once and runs the tiles through the
+	// model as batches (as many per run as the model's batch dimension holds). results go to OnSensorDetectionsReady /
+	// GetSensorDetections per sensor, OnDetectionsReady gets all of them. boxes only: no depth, masks or overlay.
+	// atlas frames are not published to the spatial index, the shared-memory stream or the detection log and never
+	// go through the cascade gate, consumers of those only see single-view frames.
+	// ColorCaptureComponents is still needed for the overlay and is not captured by the pipeline. read in BeginPlay
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Capture|Atlas")
+		TArray<USceneCaptureComponent2D*> AtlasSensors;
+
+	// MainView saves the second scene render but has no depth (bCaptureDepth is ignored). nn.Capture.Source overrides it,
+	// so both can be compared at runtime
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Capture")
+		EDetectionCaptureSource CaptureSource = EDetectionCaptureSource::SceneCapture;
+
+	// decode and draw instance masks when the active model is a segmentation model (yolov8-seg)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Capture")
+		bool bEnableSegmentation = true;
+
+	// capture scene depth next to the color frame, so every detection also gets a world position and extent
+	// (FBoxCoordinates::worldLocation) computed on the inference worker. read in BeginPlay
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Capture")
+		bool bCaptureDepth = false;
 	
+	// model to load asynchronously in BeginPlay. if not set, SetNeuralNetwork must be called instead
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Model")
+		TSoftObjectPtr<UNeuralNetwork> ModelAsset;
+
+	// class labels for the overlay, loaded with the model. the built-in coco labels are used if not set
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Model")
+		TSoftObjectPtr<class UDetectionLabelTable> LabelTable;
+
+	// number of inferences on dummy input run on a background thread before capturing starts
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Model", meta = (ClampMin = "0"))
+		int32 WarmUpInferenceCount = 3;
+
+	// model registry, cheapest first. when set it replaces ModelAsset: every variant is preloaded and warmed up, and the
+	// quality-of-service controller switches between them under LatencyBudgetMs
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Model|QoS")
+		TArray<FModelVariant> ModelVariants;
+
+	// variant to start with
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Model|QoS", meta = (ClampMin = "0"))
+		int32 InitialVariantIndex = 0;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Model|QoS")
+		bool bEnableQualityOfService = true;
+
+	// p95 inference latency (preprocess + model + decode) the controller tries to stay under
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Model|QoS", meta = (ClampMin = "1.0"))
+		float LatencyBudgetMs = 50.f;
+
+	UFUNCTION(BlueprintPure, Category = "Model|QoS")
+		FName GetActiveModelName() const;
+
+	UFUNCTION(BlueprintPure, Category = "Model|QoS")
+		float GetInferenceLatencyP95Ms() const
+	{
+		return static_cast<float>(LatencyTracker.Percentile(0.95) * 1000.0);
+	}
+
+	// optional tiny classifier run before detection while nothing is in view, detection is skipped when it sees nothing
+	// of interest (see CascadeGate.h, nn.Gate.*)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Model|Cascade")
+		TSoftObjectPtr<UNeuralNetwork> GateModel;
+
+	UFUNCTION(BlueprintPure, Category = "Model|Cascade")
+		FCascadeGateStats GetGateStats() const
+	{
+		return Gate.GetStats();
+	}
+
+	UFUNCTION(BlueprintCallable, Category = "Model|Cascade")
+		void ResetGateStats()
+	{
+		Gate.ResetStats();
+	}
+
+	// fires on the game thread once per processed frame
+	UPROPERTY(BlueprintAssignable, Category = "Detection")
+		FOnDetectionsReady OnDetectionsReady;
+
+	// atlas frames: fires on the game thread for every sensor of a processed frame, hits carry SensorIndex
+	UPROPERTY(BlueprintAssignable, Category = "Detection")
+		FOnSensorDetectionsReady OnSensorDetectionsReady;
+
+	// latest detections of an entry of AtlasSensors, FrameId -1 before its first atlas frame
+	UFUNCTION(BlueprintPure, Category = "Detection")
+		FDetectionSnapshot GetSensorDetections(int32 SensorIndex) const;
+
+	// capture a frame every nn.FrameMod ticks. turn off to only capture for DetectAsync / DetectOnce
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Capture")
+		bool bPeriodicCapture = true;
+
+	// scale the periodic capture with how much anyone needs it (nn.Relevance.Enable): full rate while the owner is the
+	// local player's view target (the overlay is on screen), otherwise only with someone bound to OnDetectionsReady /
+	// OnSensorDetectionsReady or bAlwaysRelevant, throttled past ThrottleDistance from the player camera or while the owner
+	// is not rendered, suspended past SuspendDistance or without consumers. DetectAsync / DetectOnce always run
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Capture|Relevance")
+		bool bEnableRelevance = true;
+
+	// consumers the component can not see, e.g. code polling the spatial index or the detection stream
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Capture|Relevance")
+		bool bAlwaysRelevant = false;
+
+	// distances to the local player camera in cm, 0 turns the limit off
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Capture|Relevance", meta = (ClampMin = "0.0"))
+		float ThrottleDistance = 3000.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Capture|Relevance", meta = (ClampMin = "0.0"))
+		float SuspendDistance = 10000.f;
+
+	UFUNCTION(BlueprintPure, Category = "Capture|Relevance")
+		EDetectionRelevance GetRelevance() const
+	{
+		return Relevance;
+	}
+
+	// capture a frame on the next tick and complete with its detections. completes on the game thread, so never wait
+	// on it there; chain with Next() instead
+	TFuture<FDetectionSnapshot> DetectAsync();
+
+	// latent version of DetectAsync
+	UFUNCTION(BlueprintCallable, Category = "Detection", meta = (Latent, LatentInfo = "LatentInfo"))
+		void DetectOnce(FLatentActionInfo LatentInfo, FDetectionSnapshot& Snapshot);
+
+	// tune the pipeline console variables on startup if this machine has no saved tuning yet (see PipelineAutoTuner.h)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Model|AutoTune")
+		bool bAutoTuneOnStartup = false;
+
+	// number of captured frames the tuner sweeps over
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Model|AutoTune", meta = (ClampMin = "1"))
+		int32 AutoTuneFrameCount = 16;
+
+	// record AutoTuneFrameCount frames, then pause detection while every configuration is measured on them. the best
+	// one is applied to the console variables and saved for this machine
+	UFUNCTION(BlueprintCallable, Category = "Model|AutoTune")
+		void StartAutoTune();
+
+	// true once the model is loaded and warmed up; frames are only captured after this
+	UFUNCTION(BlueprintPure, Category = "Model")
+		bool IsPipelineReady() const
+	{
+		return bPipelineReady;
+	}
+
 	static UCanvasRenderTarget2D* BoundingBoxRenderTarget2D;
 	static UMyNeuralNetwork::FBoxCoordinates BoundingBoxCoordinates;
 	static TMap<int, TArray<UMyNeuralNetwork::FBoxCoordinates>> BoundingBoxCoordinatesMap;
-	static TMap<int, FString> CocoDatasetClassIntToStringMap;
+	static TArray<FDetectionMask> DetectionMasks;
+	// frame id of the detections in BoundingBoxCoordinatesMap, set by the inference worker
+	static std::atomic<int64> PublishedFrameId;
+	// view the detections in BoundingBoxCoordinatesMap were captured with, the overlay reprojects them from it
+	static FCaptureView PublishedCaptureView;
+
+	// memory held by this component no matter how many frames are in flight: render targets, network tensors, published
+	// results, recorded auto-tune frames. OutBreakdown gets one entry per item
+	int64 GetResidentMemory(TArray<TPair<FString, int64>>* OutBreakdown = nullptr) const;
 
 	UFUNCTION()
 		void OnCanvasRenderTargetUpdate2(UCanvas* Canvas, int32 Width, int32 Height);
@@ -94,30 +325,126 @@ private:
 	FAsyncTask<AsyncInferenceTask>* CurrentInferenceTask = nullptr;
 
 	FScreenImageProperties ScreenImageProperties = { 0 };
-	const FModelImageProperties ModelImageProperties = { 640, 480 };
-	UNeuralNetwork* neuralNetwork = nullptr;
-	UMyNeuralNetwork* myNeuralNetwork = nullptr;
+	// created in SetupColorCaptureComponent when bCaptureDepth is set, follows the color capture
+	UPROPERTY(Transient)
+		USceneCaptureComponent2D* DepthCaptureComponent = nullptr;
+	UPROPERTY(Transient)
+		UTextureRenderTarget2D* DepthRenderTarget2D = nullptr;
+	// atlas mode (AtlasSensors): one target per sensor at the model size, copied into the tiles of AtlasRenderTarget2D
+	UPROPERTY(Transient)
+		UTextureRenderTarget2D* AtlasRenderTarget2D = nullptr;
+	UPROPERTY(Transient)
+		TArray<UTextureRenderTarget2D*> AtlasSensorTargets;
+	int32 AtlasColumns = 1;
+	TArray<FDetectionSnapshot> SensorDetections;
+	// follows the active model variant
+	FModelImageProperties ModelImageProperties = { 640, 480 };
+	UPROPERTY(Transient)
+		UNeuralNetwork* neuralNetwork = nullptr;
+	// active entry of ModelVariantNetworks
+	UPROPERTY(Transient)
+		UMyNeuralNetwork* myNeuralNetwork = nullptr;
+	// one configured network per model variant (or just the one from SetNeuralNetwork)
+	UPROPERTY(Transient)
+		TArray<UMyNeuralNetwork*> ModelVariantNetworks;
+	int32 ActiveVariantIndex = 0;
+	UPROPERTY(Transient)
+		UNeuralNetwork* GateNetwork = nullptr;
+	FCascadeGate Gate;
+
+	FInferenceLatencyTracker LatencyTracker;
+	FModelQualityController QualityController;
+
+	// set from the warm-up task, read on the game thread
+	FThreadSafeBool bPipelineReady = false;
+	// bumped whenever a new network is set, so a stale warm-up does not mark the pipeline ready
+	int32 WarmUpGeneration = 0;
+
+	enum class EAutoTuneState : uint8 {
+		Idle,
+		Recording, // frames are copied into AutoTuneFrames as they are read back
+		Recorded, // waiting for the current inference task to finish
+		Running, // sweep running on the thread pool, capture paused
+	};
+	EAutoTuneState AutoTuneState = EAutoTuneState::Idle;
+	TArray<TArray<FColor>> AutoTuneFrames;
+	FScreenImageProperties AutoTuneScreenImage = { 0 };
+
+	// device the networks currently run on, synced to nn.UseGPU between inferences
+	bool bUsingGPU = false;
+
+	// created the first time the main view is the capture source, copies into RenderTarget2D while enabled
+	TSharedPtr<FDetectionViewExtension, ESPMode::ThreadSafe> MainViewExtension;
+	bool bCapturingMainView = false;
+	// settings of the scene capture while it is switched off (main view or suspended)
+	bool bSceneCaptureEveryFrame = true;
+	bool bSceneCaptureOnMovement = true;
+	bool bSceneCaptureActive = true;
+
+	EDetectionRelevance Relevance = EDetectionRelevance::Full;
+	// the sources render for one frame after a suspension before anything is read back, so no stale image is detected
+	bool bResumingCapture = false;
+	// render targets and network scratch buffers freed while suspended
+	bool bSuspendedMemoryReleased = false;
+	// cpu readable copy of the depth target, created and used on the render thread (ReadDepth_RenderThread)
+	TSharedPtr<FTextureRHIRef, ESPMode::ThreadSafe> DepthStagingTexture;
+	// drops DepthStagingTexture on the render thread, after the readbacks already enqueued
+	void ReleaseDepthStaging();
 
 	// todo: place below fields in a struct
 	// count of total frames captured
 	int frameCount = 1;
-	// capture every frameMod frames
+	// capture every frameMod frames (nn.FrameMod)
 	int frameMod = 5;
 	//should save images
 	bool saveImages = false;
 
 	int CanvasDrawCount=0;
 
+	// overlay label of a class, measured once per label table generation
+	struct FClassLabelLayout {
+		FText Text;
+		FVector2D Size = FVector2D::ZeroVector;
+	};
+	TArray<FClassLabelLayout> LabelLayouts;
+	uint32 LabelLayoutGeneration = MAX_uint32;
+	const FClassLabelLayout& GetLabelLayout(UCanvas* Canvas, UFont* Font, int32 ClassIndex);
+
+	// DetectionMasks rasterized at the overlay size, uploaded once per published frame and drawn as a single tile
+	UPROPERTY(Transient)
+		UTexture2D* MaskTexture = nullptr;
+	int64 MaskTextureFrameId = -1;
+	// false if there are no masks to draw
+	bool UpdateMaskTexture(int32 Width, int32 Height);
+
+	// DetectAsync requests, FrameId is -1 until the frame that answers it was captured
+	struct FPendingDetection {
+		int64 FrameId = -1;
+		TPromise<FDetectionSnapshot> Promise;
+	};
+	TArray<FPendingDetection> PendingDetections;
+
+	// frame ids are unique across all capture managers
+	static int64 NextFrameId;
+	// last frame drawn by the overlay, so the trace flow of a frame ends at its first draw
+	int64 LastDrawnFrameId = -1;
+
 protected:
 	// Called when the game starts
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 public:	
 	// Called every frame
 	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
 
+	// frame id of the queued capture, -1 if nothing was captured
 	UFUNCTION(BlueprintCallable, Category = "ImageCapture")
-		void CaptureColorNonBlocking(USceneCaptureComponent2D* CaptureComponent, bool IsSegmentation = false);
+		int64 CaptureColorNonBlocking(USceneCaptureComponent2D* CaptureComponent, bool IsSegmentation = false);
+
+	// render every sensor of AtlasSensors and read the atlas back as one request. frame id of the request, -1 if the atlas
+	// is not set up
+	int64 CaptureAtlasNonBlocking();
 
 	UFUNCTION(BlueprintCallable, Category = "ImageCapture", meta = (AllowPrivateAccess = "true"))
 		void SetNeuralNetwork(UNeuralNetwork* Model);
@@ -128,16 +455,132 @@ public:
 
 private:
 	void SetupColorCaptureComponent(USceneCaptureComponent2D* CaptureComponent);
+	// (re)create the atlas and sensor targets at the model size
+	void SetupAtlas();
+	void OnModelsLoaded();
+	UMyNeuralNetwork* CreateNeuralNetwork(UNeuralNetwork* Model);
+	// switch the network used for new frames and resize the capture to its geometry. in-flight tasks keep their network
+	void ActivateModelVariant(int32 Index);
+	void UpdateQualityOfService();
+	void SyncDeviceType();
+	// move every model variant to the gpu or cpu
+	void SetDeviceType(bool bGPU);
+	// follow CaptureSource / nn.Capture.Source, between frames
+	void UpdateCaptureSource();
+	// scene capture (and depth) render every frame only while they are the source and the manager is not suspended
+	void ApplySceneCaptureState();
+	EDetectionRelevance EvaluateRelevance() const;
+	// switch Relevance, suspending / resuming the sources and the buffers
+	void UpdateRelevance();
+	void ReleaseSuspendedMemory();
+	void RestoreSuspendedMemory();
+	// targets only the pipeline reads, released while suspended
+	TArray<UTextureRenderTarget2D*> GetCaptureRenderTargets() const;
+	// the view frames are captured from right now, Width x Height pixels
+	bool GetCurrentSourceView(int32 Width, int32 Height, FCaptureView& OutView) const;
+	void RunAutoTune();
+	// create the requested backends on the pool, swap them in, then warm every variant up (RunWarmUp) and mark the
+	// pipeline ready. Generation tells a stale warm-up from the current one
+	void StartWarmUp();
+	void RunWarmUp(int32 Generation);
+	// game thread side of a finished task: update the statics read by the overlay, fire OnDetectionsReady, complete
+	// DetectAsync requests
+	void PublishTaskResults(AsyncInferenceTask& Task);
+	// per sensor snapshots of an atlas frame, then the combined one
+	void PublishAtlasResults(AsyncInferenceTask& Task);
+	// complete the DetectAsync requests Snapshot answers and fire OnDetectionsReady
+	void CompleteDetections(const FDetectionSnapshot& Snapshot);
 	void RunAsyncInferenceTask(const TArray<FColor>& RawImage, const FScreenImageProperties ScreenImage, const FModelImageProperties ModelImage, 
 		UMyNeuralNetwork* MyNeuralNetwork);
 };
 
 class AsyncInferenceTask : public FNonAbandonableTask {
 public:
-	AsyncInferenceTask(const TArray<FColor>& RawImage, const FScreenImageProperties ScreenImage, const FModelImageProperties ModelImage, UMyNeuralNetwork* MyNeuralNetwork);
+	AsyncInferenceTask(const TArray<FColor>& RawImage, const FScreenImageProperties ScreenImage, const FModelImageProperties ModelImage, UMyNeuralNetwork* MyNeuralNetwork,
+		int64 FrameId = -1, uint64 CaptureTimestampNs = 0);
 
 	~AsyncInferenceTask();
 
+	// wall time of DoWork (preprocess + model + decode)
+	double GetElapsedSeconds() const {
+		return ElapsedSeconds;
+	}
+
+	// depth read back with the frame, boxes are deprojected with it
+	void SetDepth(FCaptureDepth&& InDepth) {
+		Depth = MoveTemp(InDepth);
+		Track(Depth.Pixels.GetAllocatedSize());
+	}
+
+	void SetDecodeMasks(bool bInDecodeMasks) {
+		bDecodeMasks = bInDecodeMasks;
+	}
+
+	void SetGate(FCascadeGate* InGate) {
+		Gate = InGate;
+	}
+
+	// measurement only (auto-tuner): the results are kept on the task but never reach the spatial index, the stream,
+	// the detection log or the gate
+	void SetPublish(bool bInPublish) {
+		bPublish = bInPublish;
+	}
+
+	// view of the frame, in model image pixels
+	void SetCaptureView(const FCaptureView& InCaptureView) {
+		CaptureView = InCaptureView;
+	}
+
+	const FCaptureView& GetCaptureView() const {
+		return CaptureView;
+	}
+
+	// the frame is an atlas of Views.Num() tiles of TileSize, Columns per row: every tile is detected on its own
+	void SetAtlas(int32 Columns, FIntPoint TileSize, TArray<FCaptureView>&& Views) {
+		AtlasColumns = Columns;
+		AtlasTileSize = TileSize;
+		AtlasViews = MoveTemp(Views);
+	}
+
+	bool IsAtlas() const {
+		return AtlasViews.Num() > 0;
+	}
+
+	const TArray<FCaptureView>& GetAtlasViews() const {
+		return AtlasViews;
+	}
+
+	// atlas frames: decoded results of every tile, in tile order
+	TArray<FBoxCoordinatesMap>& GetTileResults() {
+		return TileResults;
+	}
+
+	// false if the gate skipped detection for this frame (or the model could not run)
+	bool RanDetection() const {
+		return bRanDetection;
+	}
+
+	int64 GetFrameId() const {
+		return FrameId;
+	}
+
+	FModelImageProperties GetModelImage() const {
+		return ModelImage;
+	}
+
+	// decoded results, copied from the network when the task finished. false if it never ran the network
+	bool HasResults() const {
+		return bHasResults;
+	}
+
+	FBoxCoordinatesMap& GetResults() {
+		return Results;
+	}
+
+	TArray<FDetectionMask>& GetResultMasks() {
+		return ResultMasks;
+	}
+
 	// Required by UE4!
 	FORCEINLINE TStatId GetStatId() const {
 		RETURN_QUICK_DECLARE_CYCLE_STAT(AsyncInferenceTask, STATGROUP_ThreadPoolAsyncTasks);
@@ -148,12 +591,49 @@ private:
 	FScreenImageProperties ScreenImage;
 	FModelImageProperties ModelImage;
 	UMyNeuralNetwork* MyNeuralNetwork;
+	double ElapsedSeconds = 0.0;
+	int64 FrameId = -1;
+	uint64 CaptureTimestampNs = 0;
+	FCaptureDepth Depth;
+	FCaptureView CaptureView;
+	bool bDecodeMasks = false;
+	bool bPublish = true;
+	FCascadeGate* Gate = nullptr;
+	bool bRanDetection = true;
+	bool bHasResults = false;
+	FBoxCoordinatesMap Results;
+	TArray<FDetectionMask> ResultMasks;
+	TArray<FCaptureView> AtlasViews;
+	int32 AtlasColumns = 0;
+	FIntPoint AtlasTileSize = FIntPoint::ZeroValue;
+	TArray<FBoxCoordinatesMap> TileResults;
+	// when the task was created, for the queue wait span of the trace
+	uint64 QueuedCycles = 0;
+	// bytes this task holds (frame copy, depth, results) and the stage they are counted against
+	int64 TrackedBytes = 0;
+	EPipelineMemoryStage TrackedStage = EPipelineMemoryStage::Queued;
+
+	void Track(int64 Bytes) {
+		FPipelineMemory::Add(TrackedStage, Bytes, 0);
+		TrackedBytes += Bytes;
+	}
 
 private:
 	//	void ArrayFColorToUint8(const TArray<FColor>& RawImage, TArray<uint8>& InputImageCPU, int32 Width, int32 Height);
 	void ResizeScreenImageToMatchModel(TArray<float>& ModelInputImage, TArray<uint8>& InputImageCPU,
 		FModelImageProperties modelImage, FScreenImageProperties screenImage);
-	void RunModel(TArray<float>& ModelInputImage, TArray<uint8>& ModelOutputImage);
+	// resize interleaved rgb bytes without converting to float
+	void ResizeScreenImageToMatchModel(TArray<uint8>& ModelInputImage, TArray<uint8>& InputImageCPU,
+		FModelImageProperties modelImage, FScreenImageProperties screenImage);
+	// false if the model did not run, the network's results are empty then
+	bool RunModel(TArray<float>& ModelInputImage, TArray<uint8>& ModelOutputImage);
+	bool RunModel(TArray<uint8>& ModelInputImage, TArray<uint8>& ModelOutputImage);
+	// the frame is published without detections instead of with the boxes of an earlier frame
+	void OnModelFailed();
+	// hand the decoded frame to the shared-memory stream and the detection log (each no-op unless enabled, or without bPublish)
+	void PublishDetections();
+	// atlas frames: tiles straight from the atlas rows into batches of the input tensor, one batched run per batch
+	void RunAtlas();
 
 
 public:
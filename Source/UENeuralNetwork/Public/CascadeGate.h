@@ -0,0 +1,71 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "NeuralNetwork.h"
+#include "CascadeGate.generated.h"
+
+USTRUCT(BlueprintType)
+struct FCascadeGateStats {
+	GENERATED_BODY()
+
+	// frames the gate classifier ran on
+	UPROPERTY(BlueprintReadOnly, Category = "Cascade")
+		int32 Evaluated = 0;
+	// frames it let through to detection
+	UPROPERTY(BlueprintReadOnly, Category = "Cascade")
+		int32 Fired = 0;
+	// frames where detection was skipped
+	UPROPERTY(BlueprintReadOnly, Category = "Cascade")
+		int32 Skipped = 0;
+	// frames detected without asking the gate (refresh interval, or objects were in view last time)
+	UPROPERTY(BlueprintReadOnly, Category = "Cascade")
+		int32 Bypassed = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "Cascade")
+		float AverageGateMs = 0.f;
+};
+
+/**
+ * First stage of a two stage cascade: a tiny low resolution "anything of interest?" classifier that decides whether a
+ * frame goes through full detection. It is only asked while the last detection found nothing, and at least every
+ * nn.Gate.RefreshFrames frames detection runs anyway, so a missed object costs a bounded number of frames.
+ *
+ * The classifier takes {1, 3, h, w} (float [0, 1] or uint8) and its score is the max of its output, compared against
+ * nn.Gate.Threshold. The input is sampled straight from the captured frame, so a skipped frame pays neither the full
+ * preprocessing nor the detector. Used by one inference task at a time.
+ */
+class UENEURALNETWORK_API FCascadeGate {
+public:
+	void SetNetwork(UNeuralNetwork* InNetwork);
+	bool IsActive() const;
+
+	// true if the frame (bgra, Width x Height) should go through detection
+	bool ShouldRunDetection(const TArray<FColor>& Frame, int32 Width, int32 Height, int64 FrameId);
+
+	// result of the detection the gate let through
+	void NotifyDetectionResult(bool bFoundObjects);
+
+	FCascadeGateStats GetStats() const;
+	void ResetStats();
+
+private:
+	float RunClassifier(const TArray<FColor>& Frame, int32 Width, int32 Height);
+
+	UNeuralNetwork* Network = nullptr;
+	int32 InputWidth = 0;
+	int32 InputHeight = 0;
+	bool bUInt8Input = false;
+	bool bInterleavedInput = false;
+	TArray<float> InputFloat;
+	TArray<uint8> InputBytes;
+
+	int32 FramesSinceDetection = 0;
+	bool bLastDetectionFoundObjects = true;
+
+	std::atomic<int32> Evaluated{ 0 };
+	std::atomic<int32> Fired{ 0 };
+	std::atomic<int32> Skipped{ 0 };
+	std::atomic<int32> Bypassed{ 0 };
+	std::atomic<uint64> GateCycles{ 0 };
+};
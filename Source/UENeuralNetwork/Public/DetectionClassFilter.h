@@ -0,0 +1,40 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DetectionKernels.h"
+
+/**
+ * Classes the decoder looks at, each with its own threshold (nn.Classes). Deployments that only care about a few of the
+ * model's classes set e.g. "person:0.5, car, 7:0.3": the decoder then reads just those rows of the output tensor and
+ * nothing else is gathered, suppressed or published. Entries are a label (FDetectionLabels) or a class index, with an
+ * optional threshold; without one nn.ConfidenceThreshold applies. Empty decodes every class.
+ *
+ * Parsed on the game thread (labels are game thread only) whenever nn.Classes or the labels change, the inference worker
+ * takes the latest parsed list with GetSelection.
+ */
+class UENEURALNETWORK_API FDetectionClassFilter {
+public:
+	using FSelection = TSharedPtr<const TArray<FDetectionClassThreshold>, ESPMode::ThreadSafe>;
+
+	static FDetectionClassFilter& Get();
+
+	// null when every class is decoded. any thread
+	FSelection GetSelection() const;
+
+	// game thread: reparse nn.Classes if it or the labels changed since the last call
+	void Update();
+
+	// "label_or_index[:threshold], ..." -> one entry per class, sorted by class index so the rows are read in memory order.
+	// false (and OutError) if an entry is neither a known label nor an index
+	static bool Parse(const FString& Spec, TArray<FDetectionClassThreshold>& OutClasses, FString& OutError);
+
+private:
+	FDetectionClassFilter() = default;
+
+	mutable FCriticalSection Lock;
+	FSelection Selection;
+	FString ParsedSpec;
+	uint32 ParsedLabelGeneration = MAX_uint32;
+};
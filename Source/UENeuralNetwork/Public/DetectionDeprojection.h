@@ -0,0 +1,45 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DetectionKernels.h"
+
+/**
+ * Scene depth read back next to a color frame, plus what is needed to turn its pixels into world positions.
+ */
+struct FCaptureDepth {
+	// SCS_SceneDepth readback straight from the R32F target, depth along the view axis in cm. Width x Height pixels
+	TArray<float> Pixels;
+	int32 Width = 0;
+	int32 Height = 0;
+	// see MakeDepthPixelToWorld
+	FMatrix PixelToWorld = FMatrix::Identity;
+
+	bool IsValid() const { return Width > 0 && Height > 0 && Pixels.Num() == Width * Height; }
+};
+
+// pose and projection of a capture, boxes taken with it are in Width x Height pixels
+struct FCaptureView {
+	FTransform Transform = FTransform::Identity;
+	// horizontal field of view
+	float FOVDegrees = 90.f;
+	int32 Width = 0;
+	int32 Height = 0;
+
+	bool IsValid() const { return Width > 0 && Height > 0; }
+};
+
+// inverse view projection of a perspective capture, specialized for linear scene depth: for a pixel (u, v) with depth d,
+// world = (d, d * u, d * v, 1) * M. FOVDegrees is the horizontal field of view
+UENEURALNETWORK_API FMatrix MakeDepthPixelToWorld(const FTransform& CaptureTransform, float FOVDegrees, int32 Width, int32 Height);
+
+// fill depth, worldLocation and worldExtent of every box (model image pixels) from the depth capture. all boxes go through
+// the same 4-wide pass, boxes without valid depth keep depth 0
+UENEURALNETWORK_API void DeprojectBoxes(const FCaptureDepth& Depth, int32 ModelWidth, int32 ModelHeight, FBoxCoordinatesMap& Boxes);
+
+// move boxes seen from From to where they appear from To (same pixel space), so they follow the camera between inferences.
+// every box is placed at its depth (DefaultDepth if it has none) and scaled with it. boxes that end up behind the camera
+// get a zero size. all boxes go through the same 4-wide pass
+UENEURALNETWORK_API void ReprojectBoxes(const FCaptureView& From, const FCaptureView& To, float DefaultDepth,
+	TArrayView<UMyNeuralNetwork::FBoxCoordinates* const> Boxes);
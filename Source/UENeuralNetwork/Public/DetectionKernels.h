@@ -0,0 +1,50 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MyNeuralNetwork.h"
+
+using FBoxCoordinatesMap = TMap<int, TArray<UMyNeuralNetwork::FBoxCoordinates>>;
+
+// one class row the decoder reads, see DetectionClassFilter.h. Threshold 0 uses the global confidence threshold
+struct FDetectionClassThreshold {
+	int32 ClassIndex = 0;
+	float Threshold = 0.f;
+};
+
+/**
+ * Preprocessing and decode kernels for one model geometry. The geometries we ship are instantiated at compile time
+ * (constant trip counts, raw pointers, no TArray bounds checks), everything else uses the generic instantiation.
+ * A geometry field of 0 means the kernel accepts any value. The size arguments are always the real frame / tensor size:
+ * specialized kernels check them against their geometry and run the generic code when they differ.
+ */
+struct FDetectionKernels {
+	const TCHAR* Name;
+	int32 Width;
+	int32 Height;
+	int32 Channels;
+	int32 NumClasses;
+	int32 NumAnchors;
+
+	// FColor (bgra) -> planar rgb float [0, 1], Width * Height pixels
+	void (*PreprocessFloat)(const FColor* Src, float* Dst, int32 Width, int32 Height);
+
+	// {4 + NumClasses, NumAnchors} yolov8 output -> boxes above Threshold, per class. with Classes only those rows are read,
+	// each against its own threshold; empty reads every class
+	void (*Decode)(const float* Output, int32 NumClasses, int32 NumAnchors, float Threshold, TArrayView<const FDetectionClassThreshold> Classes,
+		FBoxCoordinatesMap& OutBoxes);
+
+	bool IsGeneric() const { return Width == 0; }
+
+	// true if the fast path runs for a frame of this size
+	bool FitsImage(int32 InWidth, int32 InHeight) const {
+		return (Width == 0 || Width == InWidth) && (Height == 0 || Height == InHeight);
+	}
+};
+
+// pick the specialized kernels for this geometry, or the generic ones. never returns null
+UENEURALNETWORK_API const FDetectionKernels* FindDetectionKernels(int32 Width, int32 Height, int32 Channels, int32 NumClasses, int32 NumAnchors);
+
+// keeps, in map order, every box that does not intersect a box kept before it. this is what the overlay draws
+UENEURALNETWORK_API void SuppressOverlappingBoxes(const FBoxCoordinatesMap& Boxes, TArray<TPair<int, UMyNeuralNetwork::FBoxCoordinates>>& OutKept);
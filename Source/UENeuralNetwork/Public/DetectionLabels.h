@@ -0,0 +1,45 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DataAsset.h"
+#include "DetectionLabels.generated.h"
+
+// class labels of a model, cooked with the game. FText so they go through localization
+UCLASS(BlueprintType)
+class UENEURALNETWORK_API UDetectionLabelTable : public UDataAsset {
+	GENERATED_BODY()
+
+public:
+	// label of class i at index i
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Labels")
+		TArray<FText> Labels;
+};
+
+/**
+ * The one label table of the process, indexed by class. Starts with the built-in coco labels and is replaced when a
+ * UDetectionLabelTable is loaded (UCaptureManager::LabelTable) or from the console (nn.Labels.Load <file>, "index: label"
+ * lines). Game thread only.
+ */
+class UENEURALNETWORK_API FDetectionLabels {
+public:
+	static FDetectionLabels& Get();
+
+	// the class index as text if the table has no label for it
+	FText GetLabel(int32 ClassIndex) const;
+	int32 Num() const { return Labels.Num(); }
+
+	void SetLabels(TArray<FText> InLabels);
+	void ResetToBuiltIn();
+
+	// changes whenever the labels (or the culture they are displayed in) change, so caches of measured text know when
+	// to rebuild
+	uint32 GetGeneration() const { return Generation; }
+
+private:
+	FDetectionLabels();
+
+	TArray<FText> Labels;
+	uint32 Generation = 0;
+};
@@ -0,0 +1,179 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DetectionKernels.h"
+#include "HAL/Runnable.h"
+
+#include <atomic>
+
+class FRunnableThread;
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+/**
+ * Append-only binary log of every published detection set, for offline analysis of long sessions.
+ *
+ * File: [FileHeader][Chunk]...[Chunk][IndexEntry x NumChunks][Trailer]
+ * A chunk holds up to nn.Log.ChunkRecords detections stored column by column (frame ids, timestamps, scores, x1, y1,
+ * width, height, classes) behind a header with its frame/time range and a bitmask of the classes in it. The index at
+ * the end has one entry per chunk (sparse) with the chunk's min/max frame id and timestamp, so a query skips chunks outside
+ * its range or without the class and only touches the columns it needs. Chunks are in append order, which is not frame or
+ * time order when several managers publish or frames have no id; the index is only binary searched when its ranges do not
+ * overlap. If the game did not shut down cleanly the reader rebuilds the index from the chunk headers.
+ */
+namespace DetectionLog {
+	constexpr uint32 FileMagic = 0x4C4E4E44; // "DNNL"
+	constexpr uint32 ChunkMagic = 0x434E4E44; // "DNNC"
+	constexpr uint32 IndexMagic = 0x494E4E44; // "DNNI"
+	constexpr uint32 Version = 2;
+	// classes >= this share the last bit of the chunk class mask
+	constexpr int32 MaskBits = 128;
+
+	struct FFileHeader {
+		uint32 Magic;
+		uint32 Version;
+		uint64 Reserved;
+	};
+
+	struct FChunkHeader {
+		uint32 Magic;
+		uint32 Count;
+		uint64 MinFrameId;
+		uint64 MaxFrameId;
+		uint64 MinTimestampNs;
+		uint64 MaxTimestampNs;
+		uint64 ClassMask[MaskBits / 64];
+		uint64 ChunkBytes; // header included
+	};
+
+	struct FIndexEntry {
+		uint64 Offset;
+		uint64 MinFrameId;
+		uint64 MaxFrameId;
+		uint64 MinTimestampNs;
+		uint64 MaxTimestampNs;
+	};
+
+	struct FTrailer {
+		uint64 IndexOffset;
+		uint32 NumChunks;
+		uint32 Magic;
+	};
+}
+
+struct FDetectionLogEntry {
+	uint64 FrameId;
+	uint64 TimestampNs;
+	int32 ClassIndex;
+	float Score;
+	float X1;
+	float Y1;
+	float Width;
+	float Height;
+};
+
+/**
+ * Writes the log. Detections are appended to an in-memory chunk, full chunks (or chunks older than nn.Log.FlushSeconds)
+ * are handed to a writer thread that writes them out in one go, the inference worker never touches the disk.
+ * nn.Log.Enable starts a new file in nn.Log.Directory (Saved/DetectionLogs by default), setting it back to 0 finishes it.
+ */
+class UENEURALNETWORK_API FDetectionLogWriter : private FRunnable {
+public:
+	static FDetectionLogWriter& Get();
+
+	// called from the inference worker once a frame is decoded
+	void Append(uint64 FrameId, uint64 TimestampNs, const FBoxCoordinatesMap& Boxes);
+
+	// hands over the pending chunk and waits for the writer to write it, the index and the trailer
+	void Close();
+
+	FString GetFilename() const { return Filename; }
+
+private:
+	// columns of one chunk
+	struct FChunkRows {
+		TArray<uint64> FrameIds;
+		TArray<uint64> Timestamps;
+		TArray<float> Scores;
+		TArray<float> X1;
+		TArray<float> Y1;
+		TArray<float> Widths;
+		TArray<float> Heights;
+		TArray<uint16> Classes;
+
+		int32 Num() const { return FrameIds.Num(); }
+		void Reset();
+	};
+
+	FDetectionLogWriter() = default;
+	void StartWriter();
+	void SealChunk();
+
+	// writer thread
+	virtual uint32 Run() override;
+	bool OpenFile();
+	void WriteChunk(const FChunkRows& Rows);
+	void CloseFile();
+
+	// guards everything below apart from the writer thread's file state
+	FCriticalSection Lock;
+	TUniquePtr<FRunnableThread> Thread;
+	std::atomic<bool> bStopping{ false };
+	std::atomic<bool> bFinished{ false };
+	// the file could not be created, nothing is logged until nn.Log.Enable is set to 0 and back
+	bool bOpenFailed = false;
+	FString Filename;
+	FChunkRows Filling;
+	double ChunkStartSeconds = 0.0;
+	TArray<FChunkRows> Pending;
+	// written chunks, their allocations are reused for the next ones
+	TArray<FChunkRows> Spare;
+
+	// only touched by the writer thread
+	TUniquePtr<FArchive> Archive;
+	TArray<DetectionLog::FIndexEntry> Index;
+};
+
+/**
+ * Reads a log through a memory mapping, nothing is loaded up front apart from the index.
+ */
+class UENEURALNETWORK_API FDetectionLogReader {
+public:
+	FDetectionLogReader();
+	~FDetectionLogReader();
+
+	bool Open(const FString& Filename);
+	void Close();
+
+	int32 GetNumChunks() const { return Index.Num(); }
+	uint64 GetNumRecords() const { return NumRecords; }
+	uint64 GetStartTimestampNs() const { return StartTimestampNs; }
+
+	// all detections of ClassIndex (-1 for any class) with t0 <= timestamp <= t1, in file order
+	void QueryClassInTimeRange(int32 ClassIndex, uint64 T0Ns, uint64 T1Ns, TArray<FDetectionLogEntry>& Out) const;
+
+	// detections of one frame, false if the frame is not in the log (or had no detections)
+	bool QueryFrame(uint64 FrameId, TArray<FDetectionLogEntry>& Out) const;
+
+private:
+	const DetectionLog::FChunkHeader* GetChunk(int32 ChunkIndex) const;
+	static bool ChunkHasClass(const DetectionLog::FChunkHeader& Chunk, int32 ClassIndex);
+	static void ReadEntry(const DetectionLog::FChunkHeader& Chunk, uint32 Row, FDetectionLogEntry& Out);
+	// a whole chunk with a valid header starts at Offset and ends inside the file
+	bool IsValidChunk(uint64 Offset) const;
+	bool RebuildIndex();
+	void OnIndexLoaded();
+
+	TUniquePtr<IMappedFileHandle> MappedFile;
+	TUniquePtr<IMappedFileRegion> MappedRegion;
+	const uint8* Data = nullptr;
+	uint64 Size = 0;
+	TArray<DetectionLog::FIndexEntry> Index;
+	uint64 NumRecords = 0;
+	uint64 StartTimestampNs = 0;
+	// chunk ranges do not overlap and grow with the chunk index, so the index can be binary searched and a scan stop early
+	bool bTimeOrdered = false;
+	bool bFramesOrdered = false;
+};
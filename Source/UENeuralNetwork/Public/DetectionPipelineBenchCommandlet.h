@@ -0,0 +1,53 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+
+#include "DetectionPipelineBenchCommandlet.generated.h"
+
+/**
+ * Performance gate for the detection pipeline. Runs preprocessing, decode and overlap suppression on fixed inputs,
+ * checks the results against golden values and fails when the median time or the allocations per frame of a stage go
+ * over the budgets checked into Config/DefaultGame.ini. With -model=<asset path> the whole UMyNeuralNetwork::URunModel is
+ * measured on the cpu as well. No GPU needed, runs headless:
+ *
+ *   UnrealEditor-Cmd UENeuralNetwork.uproject -run=DetectionPipelineBench -nullrhi -unattended [-iterations=N] [-model=/Game/...]
+ *
+ * Allocations are read from the allocator stats, so they are only checked in builds with stats. The same stages are
+ * covered for correctness by the automation tests in Private/Tests. Returns 0 when every stage is correct and within budget.
+ */
+UCLASS(config = Game)
+class UENEURALNETWORK_API UDetectionPipelineBenchCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UDetectionPipelineBenchCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+	UPROPERTY(config)
+		int32 Iterations = 50;
+
+	// median milliseconds per frame
+	UPROPERTY(config)
+		float PreprocessBudgetMs = 4.f;
+	UPROPERTY(config)
+		float DecodeBudgetMs = 3.f;
+	UPROPERTY(config)
+		float SuppressBudgetMs = 0.5f;
+	UPROPERTY(config)
+		float RunModelBudgetMs = 40.f;
+
+	// heap allocations per frame, from all threads
+	UPROPERTY(config)
+		int32 PreprocessAllocationBudget = 32;
+	UPROPERTY(config)
+		int32 DecodeAllocationBudget = 16;
+	UPROPERTY(config)
+		int32 SuppressAllocationBudget = 4;
+	UPROPERTY(config)
+		int32 RunModelAllocationBudget = 64;
+};
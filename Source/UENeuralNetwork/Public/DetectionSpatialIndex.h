@@ -0,0 +1,123 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Kismet/BlueprintFunctionLibrary.h"
+#include "DetectionKernels.h"
+#include "DetectionSpatialIndex.generated.h"
+
+USTRUCT(BlueprintType)
+struct FDetectionHit {
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, Category = "Detection")
+		int32 ClassIndex = -1;
+	UPROPERTY(BlueprintReadOnly, Category = "Detection")
+		float Score = 0.f;
+	// normalized to the captured view, (0, 0) top left, (1, 1) bottom right
+	UPROPERTY(BlueprintReadOnly, Category = "Detection")
+		FBox2D Box = FBox2D(ForceInit);
+	// world position of the box center and half its width/height in cm, only with a depth capture (Depth > 0)
+	UPROPERTY(BlueprintReadOnly, Category = "Detection")
+		FVector WorldLocation = FVector::ZeroVector;
+	UPROPERTY(BlueprintReadOnly, Category = "Detection")
+		FVector2D WorldExtent = FVector2D::ZeroVector;
+	UPROPERTY(BlueprintReadOnly, Category = "Detection")
+		float Depth = 0.f;
+	// distance from the query point to the box (0 inside), only set by nearest queries
+	UPROPERTY(BlueprintReadOnly, Category = "Detection")
+		float Distance = 0.f;
+	// entry of UCaptureManager::AtlasSensors the box was seen by, 0 for the single capture
+	UPROPERTY(BlueprintReadOnly, Category = "Detection")
+		int32 SensorIndex = 0;
+};
+
+// hit for a decoded box, Scale converts model image pixels to the normalized view
+UENEURALNETWORK_API FDetectionHit MakeDetectionHit(int32 ClassIndex, const UMyNeuralNetwork::FBoxCoordinates& Box, float ScaleX, float ScaleY);
+
+/**
+ * Uniform grid over the detections of one published frame, one grid per class present. A box is referenced from every
+ * cell it overlaps, the cell lists are packed into one array per class (counting sort), so a query only looks at the
+ * cells it touches and never allocates apart from its output.
+ *
+ * A new snapshot is built on the inference worker for every published frame and swapped in atomically; gameplay code
+ * holds on to the snapshot it got from GetLatest for as long as it likes.
+ */
+class UENEURALNETWORK_API FDetectionSpatialIndex {
+public:
+	using FSnapshot = TSharedPtr<const FDetectionSpatialIndex, ESPMode::ThreadSafe>;
+
+	// cells per axis
+	static constexpr int32 GridSize = 16;
+
+	static FSnapshot GetLatest();
+
+	// build a snapshot from decoded boxes (model image pixels) and make it the latest
+	static void Publish(const FBoxCoordinatesMap& Boxes, int32 ModelWidth, int32 ModelHeight, int64 FrameId);
+
+	int64 GetFrameId() const { return FrameId; }
+	int32 Num() const { return NumHits; }
+
+	// ClassIndex -1 queries every class. results are appended to Out
+	void QueryRegion(const FBox2D& Region, int32 ClassIndex, TArray<FDetectionHit>& Out) const;
+	void QueryPoint(const FVector2D& Point, int32 ClassIndex, TArray<FDetectionHit>& Out) const;
+	void QueryClass(int32 ClassIndex, TArray<FDetectionHit>& Out) const;
+	// up to K hits sorted by distance from Point
+	void QueryNearest(const FVector2D& Point, int32 K, int32 ClassIndex, TArray<FDetectionHit>& Out) const;
+
+private:
+	struct FClassGrid {
+		int32 ClassIndex = -1;
+		TArray<FDetectionHit> Hits;
+		// items of cell c are CellItems[CellStart[c] .. CellStart[c + 1])
+		TArray<int32> CellStart;
+		TArray<int32> CellItems;
+	};
+
+	void Build(const FBoxCoordinatesMap& Boxes, float ScaleX, float ScaleY, int64 InFrameId);
+	const FClassGrid* FindGrid(int32 ClassIndex) const;
+	template <typename FunctorType>
+	void ForEachGrid(int32 ClassIndex, FunctorType&& Functor) const;
+	void QueryRegion(const FClassGrid& Grid, const FBox2D& Region, TArray<FDetectionHit>& Out) const;
+	void QueryNearest(const FClassGrid& Grid, const FVector2D& Point, int32 K, TArray<FDetectionHit>& Best) const;
+
+	static int32 ToCell(float Coordinate) {
+		return FMath::Clamp(FMath::FloorToInt(Coordinate * GridSize), 0, GridSize - 1);
+	}
+
+	int64 FrameId = -1;
+	int32 NumHits = 0;
+	// grids are reused between builds, only the first NumGrids are valid
+	TArray<FClassGrid> Grids;
+	int32 NumGrids = 0;
+};
+
+/**
+ * Blueprint access to the latest detections. Coordinates are normalized to the captured view, ClassIndex -1 matches any
+ * class.
+ */
+UCLASS()
+class UENEURALNETWORK_API UDetectionQueryLibrary : public UBlueprintFunctionLibrary {
+	GENERATED_BODY()
+
+public:
+	// detections overlapping Region, returns true if there is at least one
+	UFUNCTION(BlueprintCallable, Category = "Detection")
+		static bool FindDetectionsInRegion(FBox2D Region, int32 ClassIndex, TArray<FDetectionHit>& OutHits);
+
+	// detections containing Point
+	UFUNCTION(BlueprintCallable, Category = "Detection")
+		static bool FindDetectionsAtPoint(FVector2D Point, int32 ClassIndex, TArray<FDetectionHit>& OutHits);
+
+	// the Count detections closest to Point, closest first
+	UFUNCTION(BlueprintCallable, Category = "Detection")
+		static bool FindNearestDetections(FVector2D Point, int32 Count, int32 ClassIndex, TArray<FDetectionHit>& OutHits);
+
+	UFUNCTION(BlueprintCallable, Category = "Detection")
+		static bool FindDetectionsOfClass(int32 ClassIndex, TArray<FDetectionHit>& OutHits);
+
+	// frame the current results came from, -1 before the first result
+	UFUNCTION(BlueprintPure, Category = "Detection")
+		static int64 GetDetectionFrameId();
+};
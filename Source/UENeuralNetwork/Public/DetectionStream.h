@@ -0,0 +1,41 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DetectionKernels.h"
+#include "DetectionStreamLayout.h"
+
+/**
+ * Publishes every decoded frame into a named shared-memory ring (layout in DetectionStreamLayout.h) for out-of-process
+ * consumers, see Tools/DetectionStream for the reader library. Publishing is a few stores per box and never waits for
+ * readers: a slow reader just loses the oldest records.
+ *
+ * nn.Stream.Enable turns it on, nn.Stream.Name / nn.Stream.Capacity / nn.Stream.PublishFrames are read when the region is
+ * created (first publish after enabling).
+ */
+class UENEURALNETWORK_API FDetectionStreamWriter {
+public:
+	static FDetectionStreamWriter& Get();
+
+	// called from the inference worker once a frame is decoded. Pixels (bgra, Width x Height) may be null
+	void Publish(uint64 FrameId, uint64 TimestampNs, const FBoxCoordinatesMap& Boxes, const FColor* Pixels, int32 Width, int32 Height);
+
+	void Close();
+
+private:
+	FDetectionStreamWriter() = default;
+	bool Open();
+
+	FPlatformMemory::FSharedMemoryRegion* Region = nullptr;
+	DetectionStream::Header* Header = nullptr;
+	DetectionStream::RecordSlot* Slots = nullptr;
+	DetectionStream::FrameSlotHeader* FrameSlot = nullptr;
+	uint8* FramePixels = nullptr;
+	uint64 NextSequence = 0;
+	uint64 NextFrameSequence = 0;
+	// the region could not be created, nothing is published until nn.Stream.Enable is set to 0 and back
+	bool bOpenFailed = false;
+	// several capture managers may publish, readers never take it
+	FCriticalSection ProducerLock;
+};
@@ -0,0 +1,85 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+// Memory layout of the shared-memory detection stream. Plain C++17 with no engine types: this header is shared by the
+// engine side writer (DetectionStream.h) and the out-of-process reader library (Tools/DetectionStream).
+//
+// Region: [Header][RecordSlot x RecordCapacity][FrameSlotHeader + pixels (optional)]
+//
+// One producer, any number of consumers, nobody ever waits:
+// - record n goes into slot n % RecordCapacity. the slot sequence is 2n+1 while it is written and 2n+2 once complete,
+//   Header::WriteSequence is n+1 after that. a reader that falls more than RecordCapacity behind loses the oldest records
+//   and notices from the sequence numbers.
+// - the frame slot holds the latest frame only, its sequence is odd while it is written (seqlock).
+
+#include <atomic>
+#include <cstdint>
+
+namespace DetectionStream {
+
+constexpr uint32_t kMagic = 0x534E4E44; // "DNNS"
+constexpr uint32_t kVersion = 1;
+constexpr const char* kDefaultName = "UENeuralNetworkDetections";
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory atomics must be lock free");
+
+struct Record {
+	uint64_t FrameId;
+	uint64_t TimestampNs; // capture time, unix epoch nanoseconds
+	int32_t ClassIndex; // -1 for the marker of a frame without detections
+	float Score;
+	float X1; // top left, model image pixels
+	float Y1;
+	float Width;
+	float Height;
+	uint32_t IndexInFrame;
+	uint32_t CountInFrame; // records published for this frame, so a reader knows when it has all of them
+};
+
+struct alignas(64) RecordSlot {
+	std::atomic<uint64_t> Sequence;
+	Record Data;
+};
+
+enum class EFrameFormat : uint32_t {
+	BGRA8 = 0,
+};
+
+struct alignas(64) FrameSlotHeader {
+	std::atomic<uint64_t> Sequence;
+	uint64_t FrameId;
+	uint64_t TimestampNs;
+	uint32_t Width;
+	uint32_t Height;
+	EFrameFormat Format;
+	uint32_t Bytes;
+	// pixels follow the header, FrameMaxBytes reserved
+};
+
+struct alignas(64) Header {
+	std::atomic<uint32_t> Magic; // written last by the producer
+	uint32_t Version;
+	uint32_t RecordCapacity; // power of two
+	uint32_t RecordSlotSize;
+	uint64_t RecordsOffset;
+	uint64_t FrameSlotOffset; // 0 if the stream has no frame slot
+	uint32_t FrameMaxBytes;
+	uint32_t Reserved;
+	alignas(64) std::atomic<uint64_t> WriteSequence;
+};
+
+inline uint64_t RecordsOffset() {
+	return sizeof(Header);
+}
+
+inline uint64_t FrameSlotOffset(uint32_t RecordCapacity) {
+	return RecordsOffset() + static_cast<uint64_t>(RecordCapacity) * sizeof(RecordSlot);
+}
+
+inline uint64_t RegionSize(uint32_t RecordCapacity, uint32_t FrameMaxBytes) {
+	const uint64_t Records = FrameSlotOffset(RecordCapacity);
+	return FrameMaxBytes > 0 ? Records + sizeof(FrameSlotHeader) + FrameMaxBytes : Records;
+}
+
+} // namespace DetectionStream
@@ -0,0 +1,69 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SceneViewExtension.h"
+#include "DetectionDeprojection.h"
+
+#include <atomic>
+
+class UTextureRenderTarget2D;
+class FTextureRenderTargetResource;
+struct FScreenPassTexture;
+
+/**
+ * Capture source that takes the detection input from the frame the player camera already rendered, instead of rendering
+ * the scene a second time with the scene capture component (UCaptureManager::CaptureSource, nn.Capture.Source).
+ *
+ * Right after tonemapping, the center of the main view (cropped to the aspect of the target, so nothing is stretched) is
+ * drawn into the capture render target, every frame while enabled: one small draw instead of a scene render. The readback
+ * queue reads that target exactly like the scene capture's. The readback is enqueued before the frame renders, so it
+ * reads the previous frame's copy; the view the copy was taken with travels with it (GetCopiedView_RenderThread).
+ *
+ * The image is what the player sees without the UI. Only the first view of the game viewport of World is copied.
+ */
+class UENEURALNETWORK_API FDetectionViewExtension : public FSceneViewExtensionBase {
+public:
+	FDetectionViewExtension(const FAutoRegister& AutoRegister, UWorld* InWorld);
+
+	// game thread
+	void SetEnabled(bool bInEnabled) {
+		bEnabled = bInEnabled;
+	}
+
+	bool IsEnabled() const {
+		return bEnabled;
+	}
+
+	// cheap when the target did not change. call again after the target was resized, its resource is recreated
+	void SetTarget(UTextureRenderTarget2D* Target);
+
+	// render thread: view of the last copy, sized to the target. invalid until something was copied
+	FCaptureView GetCopiedView_RenderThread() const {
+		return CopiedView;
+	}
+
+	// centered crop of a view with the aspect of TargetSize, and its horizontal field of view
+	static FIntRect GetCropRect(const FIntRect& ViewRect, FIntPoint TargetSize);
+	static float GetCroppedFOV(float FOVDegrees, FIntPoint ViewSize, FIntPoint TargetSize);
+
+	virtual void SetupViewFamily(FSceneViewFamily& InViewFamily) override {}
+	virtual void SetupView(FSceneViewFamily& InViewFamily, FSceneView& InView) override {}
+	virtual void BeginRenderViewFamily(FSceneViewFamily& InViewFamily) override {}
+	virtual void SubscribeToPostProcessingPass(EPostProcessingPass Pass, FAfterPassCallbackDelegateArray& InOutPassCallbacks, bool bIsPassEnabled) override;
+
+protected:
+	virtual bool IsActiveThisFrame_Internal(const FSceneViewExtensionContext& Context) const override;
+
+private:
+	FScreenPassTexture CopyAfterTonemap_RenderThread(FRDGBuilder& GraphBuilder, const FSceneView& View, const FPostProcessMaterialInputs& Inputs);
+
+	TWeakObjectPtr<UWorld> World;
+	std::atomic<bool> bEnabled{ false };
+	// last target handed to the render thread, to spot a recreated resource
+	FTextureRenderTargetResource* GameThreadTarget = nullptr;
+	// render thread
+	FTextureRenderTargetResource* Target = nullptr;
+	FCaptureView CopiedView;
+};
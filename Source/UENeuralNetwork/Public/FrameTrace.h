@@ -0,0 +1,62 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+// how a slice takes part in the per-frame flow arrows of the trace
+enum class EFrameTraceFlow : uint8 {
+	None,
+	Start, // first stage of a frame (capture)
+	Step, // any stage in between
+	End, // last stage (overlay draw)
+};
+
+// pseudo threads for spans that are waiting rather than running, so they get their own track in the viewer
+enum class EFrameTraceTrack : uint32 {
+	CurrentThread = 0,
+	FenceWait = 0x7FFF0001,
+	QueueWait = 0x7FFF0002,
+};
+
+/**
+ * Records the lifecycle of captured frames as Chrome trace JSON (chrome://tracing, ui.perfetto.dev): one track per thread,
+ * one slice per stage, flow arrows linking the stages of the same frame id.
+ *
+ * Every thread writes into its own single-producer queue, a writer thread drains them and streams the JSON to disk, so
+ * recording costs a few stores per slice on the measured threads. Slice names must be string literals.
+ * Console: nn.Trace.Start [file], nn.Trace.Stop.
+ */
+class UENEURALNETWORK_API FFrameTrace {
+public:
+	static bool IsEnabled() { return bEnabled.load(std::memory_order_relaxed); }
+
+	static void Start(const FString& Filename);
+	static void Stop();
+
+	// StartCycles/EndCycles from FPlatformTime::Cycles64
+	static void AddSlice(const TCHAR* Name, int64 FrameId, uint64 StartCycles, uint64 EndCycles,
+		EFrameTraceFlow Flow = EFrameTraceFlow::None, EFrameTraceTrack Track = EFrameTraceTrack::CurrentThread);
+
+private:
+	static std::atomic<bool> bEnabled;
+};
+
+// records a slice from construction to destruction
+class FScopedFrameTrace {
+public:
+	FScopedFrameTrace(const TCHAR* InName, int64 InFrameId = -1, EFrameTraceFlow InFlow = EFrameTraceFlow::None)
+		: Name(InName), FrameId(InFrameId), Flow(InFlow), StartCycles(FFrameTrace::IsEnabled() ? FPlatformTime::Cycles64() : 0) {}
+
+	~FScopedFrameTrace() {
+		if (StartCycles != 0 && FFrameTrace::IsEnabled()) {
+			FFrameTrace::AddSlice(Name, FrameId, StartCycles, FPlatformTime::Cycles64(), Flow);
+		}
+	}
+
+private:
+	const TCHAR* Name;
+	int64 FrameId;
+	EFrameTraceFlow Flow;
+	uint64 StartCycles;
+};
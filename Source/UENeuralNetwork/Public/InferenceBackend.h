@@ -0,0 +1,63 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UNeuralNetwork;
+
+// shape and size of one tensor of a backend
+struct FInferenceTensorInfo {
+	TArray<int64> Sizes;
+	int64 Bytes = 0;
+	// 4 for float, 1 for uint8 inputs
+	int32 ElementBytes = 4;
+};
+
+/**
+ * Runtime that executes a detection model for UMyNeuralNetwork. The network binds the preprocessed input, runs, and
+ * decodes straight from the output views, so the capture and decode code does not care which runtime is behind it.
+ *
+ * nn.Backend picks the runtime when a model is set (CaptureManager SetModel / SetModelVariants). The network starts on NNI
+ * (it only wraps the loaded asset) and the requested runtime is created on the detection pool during warm-up, then swapped in
+ * on the game thread before the pipeline runs a frame (UMyNeuralNetwork::PrepareRequestedBackend):
+ * - NNI: the engine's NeuralNetworkInference plugin on the model asset itself. CPU or GPU (nn.UseGPU).
+ * - ORT: ONNX Runtime on the CPU (ThirdParty/OnnxRuntime), loading <nn.ORT.ModelDir>/<asset name>.onnx like the
+ *   inference server does. Exposes the intra/inter-op threads and the graph optimization level, see OnnxRuntimeBackend.cpp.
+ *   The optimized graph is cached per machine and memory-mapped on later runs (nn.ORT.ModelCache).
+ *   Falls back to NNI when the runtime is not compiled in or the model can not be loaded. Content/Models/*.onnx is
+ *   staged as loose files, so packaged builds find it under the default nn.ORT.ModelDir.
+ *
+ * One frame at a time: the caller serializes SetInput/Run/GetOutput (the network runs one inference task at a time).
+ */
+class UENEURALNETWORK_API IInferenceBackend {
+public:
+	virtual ~IInferenceBackend() = default;
+
+	virtual const TCHAR* GetName() const = 0;
+
+	virtual FInferenceTensorInfo GetInputInfo() const = 0;
+	virtual int32 GetNumOutputs() const = 0;
+	virtual FInferenceTensorInfo GetOutputInfo(int32 Index) const = 0;
+
+	// copies GetInputInfo().Bytes bytes from Data into the bound input
+	virtual void SetInput(const void* Data) = 0;
+	virtual bool Run() = 0;
+	// float output of the last Run, valid until the next one
+	virtual const float* GetOutput(int32 Index) const = 0;
+
+	// free the input and output buffers while nothing runs, the next SetInput allocates them again. NNI's tensors belong
+	// to the model asset and stay
+	virtual void ReleaseBuffers() {}
+};
+
+// nn.Backend, read on the game thread when a model is set
+UENEURALNETWORK_API FString GetRequestedInferenceBackend();
+
+// the backend Requested names (see nn.Backend) on Network's model, NNI when that is not available. null if Network is not
+// loaded. anything but NNI is slow to create (ORT hashes the model file and builds or maps its session), keep it off the
+// game thread
+UENEURALNETWORK_API TUniquePtr<IInferenceBackend> CreateInferenceBackend(UNeuralNetwork* Network, const FString& Requested);
+
+// null when onnx runtime is not compiled in or the model file is missing or does not fit the pipeline (OnnxRuntimeBackend.cpp)
+TUniquePtr<IInferenceBackend> CreateOnnxRuntimeBackend(const FString& ModelName);
@@ -0,0 +1,44 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Rolling window of inference latencies (seconds). Only used from the game thread: samples are collected when a finished
+ * inference task is harvested in UCaptureManager::TickComponent, so no locking is needed.
+ */
+class UENEURALNETWORK_API FInferenceLatencyTracker {
+public:
+	explicit FInferenceLatencyTracker(int32 InWindowSize = 60);
+
+	void AddSample(double Seconds);
+	void Reset();
+
+	int32 Num() const { return Samples.Num(); }
+
+	// percentile in [0, 1] over the current window, 0 if there are no samples
+	double Percentile(double Fraction) const;
+
+private:
+	TArray<double> Samples;
+	int32 WindowSize;
+	int32 NextIndex = 0;
+};
+
+/**
+ * Picks which model variant to run. Variants are ordered cheapest first: when the p95 latency goes over the budget the
+ * controller steps down one variant, when it stays well under the budget it steps up one.
+ */
+class UENEURALNETWORK_API FModelQualityController {
+public:
+	// latency budget per inference, in seconds
+	double BudgetSeconds = 0.05;
+	// step up only if p95 is below this fraction of the budget, so we don't oscillate between two variants
+	double UpgradeHeadroom = 0.6;
+	// samples needed after a switch before the next decision
+	int32 MinSamples = 30;
+
+	// returns the variant index to use next (may be ActiveIndex)
+	int32 Evaluate(const FInferenceLatencyTracker& Tracker, int32 ActiveIndex, int32 NumVariants) const;
+};
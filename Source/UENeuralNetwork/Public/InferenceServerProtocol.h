@@ -0,0 +1,119 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+// Protocol between the game (RemoteInference.h) and the out-of-process inference server (Tools/InferenceServer). Plain
+// C++17 with no engine types, both sides include this header.
+//
+// Every game process creates its own shared-memory region and connects to the server's unix domain socket:
+//
+//   Region: [RegionHeader][SlotHeader x SlotCount][slot data x SlotCount]
+//
+// - the client writes the input tensor to the data of a free slot, fills its SlotHeader, sets the state to Submitted
+//   and sends a Run message naming the slot (the doorbell).
+// - the server runs the model, writes the outputs behind the input in the same slot, sets Done (or Failed with a
+//   message) and sends a Done message back. the slot state is the truth, the messages only wake the other side.
+// - the client copies the outputs out and sets the slot Free again.
+//
+// Slots are owned by one side at a time (Submitted: server, anything else: client), so no locks are shared across
+// processes. One server serves any number of game processes, each on its own connection and region.
+
+#include <atomic>
+#include <cstdint>
+
+namespace InferenceServer {
+
+constexpr uint32_t kMagic = 0x53494E4E; // "NNIS"
+constexpr uint32_t kVersion = 1;
+constexpr const char* kDefaultSocketPath = "/tmp/uenn-inference.sock";
+constexpr uint32_t kMaxDims = 4;
+constexpr uint32_t kMaxOutputs = 2;
+constexpr uint32_t kNameLength = 64;
+// tensors inside a slot start on this boundary
+constexpr uint64_t kDataAlignment = 64;
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "shared memory atomics must be lock free");
+
+enum class EDataType : uint32_t {
+	Float32 = 0,
+	UInt8 = 1,
+};
+
+struct TensorDesc {
+	EDataType Type;
+	uint32_t NumDims;
+	int64_t Dims[kMaxDims];
+	uint64_t Offset; // from the start of the slot data
+	uint64_t Bytes;
+};
+
+enum class ESlotState : uint32_t {
+	Free = 0,
+	Submitted = 1, // input written, owned by the server
+	Done = 2,
+	Failed = 3, // Error holds the reason
+};
+
+struct alignas(64) SlotHeader {
+	std::atomic<uint32_t> State;
+	uint32_t NumOutputs;
+	uint64_t RequestId;
+	char Model[kNameLength]; // name the server knows the model by (see the server's --model / --model-dir)
+	TensorDesc Input;
+	TensorDesc Outputs[kMaxOutputs];
+	float ServerMs; // time spent running the model
+	char Error[128];
+};
+
+struct alignas(64) RegionHeader {
+	std::atomic<uint32_t> Magic; // written last by the client
+	uint32_t Version;
+	uint32_t SlotCount;
+	uint32_t SlotHeaderSize;
+	uint64_t SlotDataBytes; // per slot, input plus outputs
+	uint64_t SlotsOffset;
+	uint64_t DataOffset;
+};
+
+inline uint64_t AlignData(uint64_t Bytes) {
+	return (Bytes + kDataAlignment - 1) & ~(kDataAlignment - 1);
+}
+
+inline uint64_t SlotsOffset() {
+	return sizeof(RegionHeader);
+}
+
+inline uint64_t DataOffset(uint32_t SlotCount) {
+	return AlignData(SlotsOffset() + static_cast<uint64_t>(SlotCount) * sizeof(SlotHeader));
+}
+
+inline uint64_t RegionSize(uint32_t SlotCount, uint64_t SlotDataBytes) {
+	return DataOffset(SlotCount) + static_cast<uint64_t>(SlotCount) * SlotDataBytes;
+}
+
+inline uint64_t TensorBytes(const TensorDesc& Desc) {
+	uint64_t Count = 1;
+	for (uint32_t i = 0; i < Desc.NumDims && i < kMaxDims; i++) {
+		Count *= static_cast<uint64_t>(Desc.Dims[i]);
+	}
+	return Count * (Desc.Type == EDataType::Float32 ? 4 : 1);
+}
+
+enum class EMessageType : uint32_t {
+	Hello = 1, // client -> server: Region names the shared-memory region
+	Welcome = 2, // server -> client: Status 0 if the region was attached
+	Run = 3, // client -> server: Slot was submitted
+	Done = 4, // server -> client: Slot is Done or Failed
+};
+
+// every message on the socket has this fixed size
+struct Message {
+	EMessageType Type;
+	uint32_t Slot;
+	uint64_t RequestId;
+	int32_t Status;
+	uint32_t Reserved;
+	char Region[kNameLength];
+};
+
+} // namespace InferenceServer
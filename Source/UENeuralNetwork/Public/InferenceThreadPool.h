@@ -0,0 +1,53 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/QueuedThreadPool.h"
+
+/**
+ * Thread pool owned by the detection pipeline. Inference tasks, warm-up, the auto-tuner and every preprocessing/decode
+ * ParallelFor run here instead of the global thread pool and task graph, so the pipeline's own work never takes more
+ * than nn.Pool.NumThreads cores and never delays game, physics or rendering tasks. Threads the runtimes start
+ * themselves (NNI, onnx runtime's intra/inter-op pools, OpenCV) are not confined to it.
+ *
+ * Thread count, affinity mask and priority come from nn.Pool.* and are read when the pool is created (first use, or
+ * nn.Pool.Restart). GetPool hands out a reference that keeps the pool alive; a restart swaps in a new pool right away
+ * and destroys the old one once nobody holds it anymore and its queue ran empty.
+ */
+class UENEURALNETWORK_API FInferenceThreadPool {
+public:
+	static FInferenceThreadPool& Get();
+
+	using FPoolRef = TSharedPtr<FQueuedThreadPool, ESPMode::ThreadSafe>;
+
+	// keep the reference for as long as work is being added to the pool
+	FPoolRef GetPool();
+
+	// creates the pool if needed
+	int32 GetNumThreads();
+
+	// runs Body(0..Num-1) on the pool. the calling thread takes part, and only waits for indices that were actually
+	// claimed by a pool thread, so this is safe to call from work that is itself running on the pool
+	void ParallelFor(int32 Num, TFunctionRef<void(int32)> Body);
+
+	// applies the affinity mask to the calling thread once; every entry point of work on the pool calls this
+	void EnterPoolThread();
+
+	// detaches the pool, it is recreated with the current settings on next use. waits (outside the pool lock) until
+	// the old pool is no longer referenced and all work queued on it ran, then destroys it. nothing queued is dropped.
+	// game thread only
+	void Restart();
+
+private:
+	FInferenceThreadPool() = default;
+	void CreatePool();
+
+	FPoolRef Pool;
+	// read locked to hand out the pool, write locked only to create or detach it
+	FRWLock PoolLock;
+	std::atomic<int32> NumThreads{ 0 };
+	std::atomic<uint64> AffinityMask{ 0 };
+	// bumped on restart so pool threads of a new pool re-apply the affinity
+	std::atomic<int32> Generation{ 0 };
+};
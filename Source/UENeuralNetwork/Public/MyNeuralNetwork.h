@@ -4,8 +4,17 @@
 
 #include "CoreMinimal.h"
 #include "NeuralNetwork.h"
+#include "InferenceBackend.h"
 #include "MyNeuralNetwork.generated.h"
 
+// layout and element type of the model's input tensor. detected from the network when it is set, so models whose graph
+// takes uint8 pixels and normalizes internally can be fed straight from the captured FColor buffer.
+enum class EModelInputFormat : uint8 {
+	Float32NCHW, // float [0, 1], one plane per channel (default yolov8 export)
+	UInt8NCHW, // uint8 [0, 255], one plane per channel
+	UInt8NHWC, // uint8 [0, 255], interleaved rgb
+};
+
 /**
  * 
  */
@@ -17,7 +26,58 @@ public:
 	UPROPERTY(Transient)
 		UNeuralNetwork* Network = nullptr;
 	UMyNeuralNetwork();
-	void URunModel(TArray<float>& image, TArray<uint8>& results);
+	// FrameId is only used to label the trace and the published results. with Depth the boxes are also deprojected to
+	// world space before they are published
+	// bDecodeMasks computes instance masks for segmentation models. without bPublish the results stay in
+	// BoundingBoxCoordinatesMap only (measurement runs of the auto-tuner)
+	// false if the model did not run or its output could not be decoded, nothing is published then and the results are empty
+	bool URunModel(TArray<float>& image, TArray<uint8>& results, int64 FrameId = -1, const struct FCaptureDepth* Depth = nullptr,
+		bool bDecodeMasks = false, bool bPublish = true);
+	bool URunModel(TArray<uint8>& image, TArray<uint8>& results, int64 FrameId = -1, const struct FCaptureDepth* Depth = nullptr,
+		bool bDecodeMasks = false, bool bPublish = true);
+
+	// publish an empty result for a frame that was not run through the network (cascade gate said nothing is in view)
+	void PublishEmpty(int64 FrameId);
+
+	// run the network Count times on zeroed input without decoding, so operator initialization is not paid on a live frame
+	void WarmUp(int32 Count);
+
+	// free the per-frame buffers (partial batch padding, last decoded results, the backend's tensor buffers where it owns
+	// them), they grow back with the next frame. only with no inference running on this network
+	void ReleaseScratchMemory();
+
+	// put Network on the NNI backend and inspect its input and output tensors: sets InputFormat, the model geometry and the
+	// kernels to use. nn.Backend is read here, a different runtime is created by PrepareRequestedBackend
+	void ConfigureFromModel();
+
+	// create the backend nn.Backend asked for if it is not the one in use. blocking (ORT builds or maps its session), call
+	// from a pool thread with no inference running on this network; ApplyPendingBackend switches to it
+	void PrepareRequestedBackend();
+
+	// switch to the backend PrepareRequestedBackend created and read the geometry again. game thread, no inference running.
+	// false if there was none
+	bool ApplyPendingBackend();
+
+	// runtime the model runs on, null until ConfigureFromModel found Network loaded
+	IInferenceBackend* GetBackend() const { return Backend.Get(); }
+
+	EModelInputFormat InputFormat = EModelInputFormat::Float32NCHW;
+	// model geometry, read from the tensors in ConfigureFromModel
+	int32 ModelWidth = 640;
+	int32 ModelHeight = 480;
+	int32 NumClasses = 80;
+	int32 NumAnchors = 6300;
+	// first dimension of the input tensor. a single frame fills the first entry, the rest of the batch is zeroed
+	int32 BatchSize = 1;
+	// bytes of one batch entry of the input tensor
+	int64 ItemInputBytes = 0;
+	// yolov8-seg: mask coefficient rows after the class rows and a second output with the prototypes
+	bool bSegmentation = false;
+	int32 NumMaskCoefficients = 0;
+	int32 ProtoWidth = 0;
+	int32 ProtoHeight = 0;
+	// preprocessing/decode kernels for this geometry (specialized or generic)
+	const struct FDetectionKernels* Kernels = nullptr;
 
 	//define struct
 	struct FBoxCoordinates {
@@ -28,13 +88,47 @@ public:
 		float x1; // top left x
 		float y1; // top left y
 		float confidence = 0.0f;
+		// column of the output tensor the box was decoded from (mask coefficients of segmentation models)
+		int32 anchor = -1;
+		// scene depth at the box in cm, 0 if there was no depth capture (see DetectionDeprojection.h)
+		float depth = 0.0f;
+		// world position of the box center at that depth, and half its width/height in cm
+		FVector worldLocation = FVector::ZeroVector;
+		FVector2D worldExtent = FVector2D::ZeroVector;
 	};
 
 	TMap<int, TArray<FBoxCoordinates>> BoundingBoxCoordinatesMap;
-	float ConfidenceThreshold = 0.65f;
+	// masks of the boxes left after suppression, only for segmentation models
+	TArray<struct FDetectionMask> DetectionMasks;
+
+	// run NumItems images at once (Input holds exactly NumItems entries of the input tensor's batch) and decode each into
+	// OutResults[i]. boxes only, nothing is published; used for atlas captures (UCaptureManager::AtlasSensors). false if
+	// the model did not run
+	bool URunModelBatch(const void* Input, int64 InputBytes, int32 NumItems, int64 FrameId, TArray<TMap<int, TArray<FBoxCoordinates>>>& OutResults);
 
-	// Define a function that takes a file path as a parameter and returns a TMap
+	// Define a function that takes a file path as a parameter and returns a TMap ("index: label" lines, see nn.Labels.Load)
 	static TMap<int, FString> ReadFileToMap(FString FilePath);
 
-	TMap<int, FString> CocoDatasetClassIntToStringMap;
+private:
+	TUniquePtr<IInferenceBackend> Backend;
+	// nn.Backend when the model was set, and the backend created for it off the game thread
+	FString RequestedBackend;
+	TUniquePtr<IInferenceBackend> PendingBackend;
+	// input of a partial batch, padded to the whole tensor
+	TArray<uint8> PaddedInput;
+
+	// run the network on Input (the exact bytes of the input tensor) and fill BoundingBoxCoordinatesMap from the output
+	// tensor. runs on the inference server when nn.Remote.Enable is set and it answers
+	bool RunAndDecode(const void* Input, int64 InputBytes, int64 FrameId, const struct FCaptureDepth* Depth, bool bDecodeMasks,
+		bool bPublish);
+	// run Input on the backend or the inference server. OutOutput (OutOutputNum floats for the whole batch) and OutPrototypes
+	// are valid until the next run, RemoteOutputs holds them when the server ran it. false if nothing ran
+	bool Execute(const void* Input, int64 InputBytes, int64 FrameId, const float*& OutOutput, int64& OutOutputNum, const float*& OutPrototypes,
+		TArray<TArray<float>>& RemoteOutputs);
+	// false if the server could not run the frame
+	bool RunRemote(const void* Input, int64 InputBytes, int64 FrameId, TArray<TArray<float>>& OutOutputs);
+	// InputFormat, geometry and kernels from the tensors of Backend
+	void ReadModelGeometry();
+	// hand BoundingBoxCoordinatesMap to the thread safe consumers (spatial index)
+	void PublishResults(int64 FrameId);
 };
@@ -0,0 +1,50 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "CaptureManager.h"
+
+// values of the pipeline console variables (see PipelineSettings.h) that the tuner sweeps and persists
+struct FPipelineTuningConfig {
+	int32 FrameMod = 5;
+	float ConfidenceThreshold = 0.65f;
+	bool bUseGPU = false;
+	int32 WorkerCount = 0;
+	int32 ParallelForMinBatch = 4096;
+};
+
+struct FPipelineTuningResult {
+	FPipelineTuningConfig Config;
+	double MeanLatencySeconds = 0.0;
+	double P95LatencySeconds = 0.0;
+	double FramesPerSecond = 0.0;
+};
+
+/**
+ * Sweeps device, worker count and ParallelFor granularity against frames recorded by a UCaptureManager, keeps the
+ * configuration with the lowest p95 latency and derives nn.FrameMod from it so capture never outruns inference.
+ * The winner is saved per machine (cpu, gpu and core count) to Saved/Config/DetectionPipelineTuning.ini and applied to the
+ * console variables on the next start, so retuning only happens on new hardware or on demand (nn.AutoTune).
+ */
+class UENEURALNETWORK_API FPipelineAutoTuner {
+public:
+	// blocking, call from a background thread while the pipeline is paused. Network is switched between cpu and gpu
+	// during the sweep and left on the winning device; only on the NNI backend without the inference server, otherwise
+	// the device stays at nn.UseGPU. no console variable is touched and no frame is published, values
+	// the user set (ini, command line, console) are not swept
+	static FPipelineTuningResult Run(const TArray<TArray<FColor>>& Frames, FScreenImageProperties ScreenImage,
+		FModelImageProperties ModelImage, UMyNeuralNetwork* Network, double GameFrameSeconds);
+
+	static FPipelineTuningConfig ReadConsoleVariables();
+	// game thread only. variables the user set keep their value
+	static void ApplyToConsoleVariables(const FPipelineTuningConfig& Config);
+
+	// false if this machine has not been tuned yet
+	static bool LoadMachineConfig(FPipelineTuningConfig& OutConfig);
+	static void SaveMachineConfig(const FPipelineTuningConfig& Config);
+
+private:
+	static FString GetConfigFilename();
+	static FString GetMachineSection();
+};
@@ -0,0 +1,74 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/LowLevelMemTracker.h"
+
+// low level memory tags of the detection pipeline, shown under DetectionPipeline with -llm (stat LLMFULL, memreport)
+LLM_DECLARE_TAG_API(DetectionPipeline, UENEURALNETWORK_API);
+// render requests, readback images and render targets
+LLM_DECLARE_TAG_API(DetectionPipeline_Capture, UENEURALNETWORK_API);
+// inference tasks, their frame copy and the resize / conversion buffers (including opencv mats)
+LLM_DECLARE_TAG_API(DetectionPipeline_Preprocess, UENEURALNETWORK_API);
+// networks, input / output tensors and the decode copy of the output
+LLM_DECLARE_TAG_API(DetectionPipeline_Inference, UENEURALNETWORK_API);
+// decoded boxes and masks, snapshots handed to gameplay
+LLM_DECLARE_TAG_API(DetectionPipeline_Results, UENEURALNETWORK_API);
+// overlay drawing
+LLM_DECLARE_TAG_API(DetectionPipeline_Overlay, UENEURALNETWORK_API);
+
+// where the buffers of a frame are right now
+enum class EPipelineMemoryStage : uint8 {
+	Readback, // render request waiting for its fence (color + depth readback)
+	Queued, // inference task waiting for the pool (frame copy + depth)
+	Inference, // task running or waiting to be harvested (frame copy, depth, results)
+	Scratch, // transient buffers of running tasks (resize, tensors, output copy), counted in bytes only
+	Num
+};
+
+/**
+ * Live counters of frames and bytes per pipeline stage, readable from any thread. The LLM tags above say where memory was
+ * allocated, these say how much the pipeline is holding right now and where it sits, which is what shows queue growth.
+ *
+ * Anything that does not change per frame (render targets, network tensors, the published results) is reported by its
+ * owner, see UCaptureManager::GetResidentMemory. Console: nn.Memory.Dump, nn.Memory.BudgetMB.
+ */
+class UENEURALNETWORK_API FPipelineMemory {
+public:
+	static void Add(EPipelineMemoryStage Stage, int64 Bytes, int32 Frames = 1);
+	static void Remove(EPipelineMemoryStage Stage, int64 Bytes, int32 Frames = 1);
+	static void Move(EPipelineMemoryStage From, EPipelineMemoryStage To, int64 Bytes, int32 Frames = 1) {
+		Add(To, Bytes, Frames);
+		Remove(From, Bytes, Frames);
+	}
+
+	static int64 GetBytes(EPipelineMemoryStage Stage);
+	static int64 GetPeakBytes(EPipelineMemoryStage Stage);
+	static int32 GetFrames(EPipelineMemoryStage Stage);
+	static int64 GetTotalBytes();
+	static const TCHAR* GetStageName(EPipelineMemoryStage Stage);
+
+	// logs every stage
+	static void LogStages();
+
+	// warns (at most every few seconds) with a breakdown when the stages plus ResidentBytes are over nn.Memory.BudgetMB
+	static void CheckBudget(int64 ResidentBytes);
+};
+
+// counts Bytes against a stage until the end of the scope
+class FScopedPipelineMemory {
+public:
+	FScopedPipelineMemory(EPipelineMemoryStage InStage, int64 InBytes)
+		: Stage(InStage), Bytes(InBytes) {
+		FPipelineMemory::Add(Stage, Bytes, 0);
+	}
+
+	~FScopedPipelineMemory() {
+		FPipelineMemory::Remove(Stage, Bytes, 0);
+	}
+
+private:
+	EPipelineMemoryStage Stage;
+	int64 Bytes;
+};
@@ -0,0 +1,26 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/IConsoleManager.h"
+
+// runtime knobs of the detection pipeline. the auto-tuner (see PipelineAutoTuner.h) writes the best values per machine
+// to a config file and sets these at startup, they can also be changed from the console at any time.
+extern UENEURALNETWORK_API TAutoConsoleVariable<int32> CVarNNFrameMod;
+extern UENEURALNETWORK_API TAutoConsoleVariable<float> CVarNNConfidenceThreshold;
+extern UENEURALNETWORK_API TAutoConsoleVariable<int32> CVarNNUseGPU;
+extern UENEURALNETWORK_API TAutoConsoleVariable<int32> CVarNNWorkerCount;
+extern UENEURALNETWORK_API TAutoConsoleVariable<int32> CVarNNParallelForMinBatch;
+
+/**
+ * ParallelFor over [0, Num) in contiguous ranges, honoring nn.WorkerCount (max ranges in flight) and
+ * nn.ParallelForMinBatch (min elements per range). ElementsPerItem is the number of elements one index stands for (e.g. the
+ * width when iterating rows). All preprocessing parallelism goes through here.
+ */
+UENEURALNETWORK_API void PipelineParallelFor(int32 Num, TFunctionRef<void(int32 Begin, int32 End)> Body, int32 ElementsPerItem = 1);
+
+// make PipelineParallelFor use these instead of nn.WorkerCount / nn.ParallelForMinBatch until cleared. the auto-tuner measures
+// its sweep with this, so the console variables are never written from a pool thread
+UENEURALNETWORK_API void SetPipelineParallelForOverride(int32 WorkerCount, int32 MinBatch);
+UENEURALNETWORK_API void ClearPipelineParallelForOverride();
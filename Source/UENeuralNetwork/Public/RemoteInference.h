@@ -0,0 +1,68 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "InferenceServerProtocol.h"
+
+/**
+ * Client of the out-of-process inference server (protocol in InferenceServerProtocol.h, server in Tools/InferenceServer).
+ * With nn.Remote.Enable the networks hand their preprocessed input tensor to the server instead of running NNI in the
+ * game process, and decode the outputs that come back exactly like local ones. A heavy model then no longer competes
+ * with the engine for cores and cache, and a crash in the runtime only costs the frames in flight.
+ *
+ * Each game process maps its own region with nn.Remote.Slots slots, so that many tasks can be in flight at once. When the
+ * server cannot be reached, is too slow (nn.Remote.TimeoutMs) or fails a request, Run returns false and the caller runs
+ * the model locally; reconnecting is retried every few seconds. The server loads a model on its first request, so that
+ * one waits up to nn.Remote.LoadTimeoutMs instead (UMyNeuralNetwork::WarmUp sends it before the pipeline runs). Unix only
+ * (unix domain socket), elsewhere IsEnabled is always false.
+ */
+class UENEURALNETWORK_API FRemoteInferenceClient {
+public:
+	static FRemoteInferenceClient& Get();
+	static bool IsEnabled();
+
+	// runs Model (the name the server knows it by) on InputBytes of Type with shape Dims. OutputBytes is the total size of
+	// the model outputs. every output is copied out as floats
+	bool Run(const FString& Model, InferenceServer::EDataType Type, const TArray<int64>& Dims, const void* Input, int64 InputBytes,
+		int64 OutputBytes, TArray<TArray<float>>& OutOutputs);
+
+	// waits for the requests in flight (new ones run locally meanwhile), then drops the connection and unmaps the region
+	void Close();
+
+private:
+	FRemoteInferenceClient() = default;
+	// without Lock, only by the thread that set bConnecting: opens the socket, maps the region and waits for the server to
+	// accept it, then installs the connection under Lock
+	bool Connect(uint64 InSlotDataBytes);
+	// with Lock held and no slot in use
+	void CloseLocked();
+	bool WaitForSlot(int32 Slot, double TimeoutSeconds);
+	bool SendMessage(const InferenceServer::Message& Message);
+	void ReleaseSlot(int32 Slot, bool bBroken);
+
+	// connection state and slot ownership
+	FCriticalSection Lock;
+	// whoever holds it reads the socket and wakes the owners of the slots that finished
+	FCriticalSection ReceiveLock;
+	FCriticalSection SendLock;
+
+	FPlatformMemory::FSharedMemoryRegion* Region = nullptr;
+	InferenceServer::RegionHeader* Header = nullptr;
+	int32 Socket = -1;
+	uint64 SlotDataBytes = 0;
+	TArray<bool> SlotInUse;
+	TArray<FEvent*> SlotEvents;
+	int32 NumSlotsInUse = 0;
+	// a request timed out or the server went away: close once the last slot is released
+	bool bBroken = false;
+	// a thread is in Connect, everyone else runs locally meanwhile
+	bool bConnecting = false;
+	// Close is waiting for the slots in use, no new requests
+	bool bClosing = false;
+	// models the server has run on this connection, the first request of any other one includes loading it
+	TSet<FString> LoadedModels;
+	std::atomic<uint64> NextRequestId{ 1 };
+	uint32 ConnectCount = 0;
+	double NextConnectSeconds = 0.0;
+};
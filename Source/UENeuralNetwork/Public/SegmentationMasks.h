@@ -0,0 +1,41 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MyNeuralNetwork.h"
+
+// instance mask of one detection, cropped to its box
+struct FDetectionMask {
+	int32 ClassIndex = -1;
+	float Score = 0.f;
+	// crop in model image pixels
+	int32 X = 0;
+	int32 Y = 0;
+	int32 Width = 0;
+	int32 Height = 0;
+	// run lengths over the crop in row major order, alternating background and foreground, starting with background
+	TArray<int32> Runs;
+};
+
+struct FMaskPrototypes {
+	// {NumCoefficients, Height, Width} prototype planes (yolov8-seg output1)
+	const float* Data = nullptr;
+	int32 NumCoefficients = 32;
+	int32 Width = 0;
+	int32 Height = 0;
+};
+
+/**
+ * Masks for yolov8-seg style models: mask = sigmoid(coefficients . prototypes), cropped to the box, upsampled to the model
+ * image and thresholded at 0.5.
+ *
+ * Only the prototype pixels inside each box are computed, as a blocked multiply (one crop row is accumulated over all
+ * coefficients while it stays in cache, 4-wide). sigmoid(x) > 0.5 is x > 0, so the sigmoid is never evaluated; the logits
+ * are bilinearly upsampled and run length encoded in one pass. Boxes are spread over the pipeline workers.
+ *
+ * Coefficients points at the first coefficient row of the detection output ({NumCoefficients, NumAnchors} after the
+ * class rows), Boxes must have their anchor set.
+ */
+UENEURALNETWORK_API void DecodeMasks(const float* Coefficients, int32 NumAnchors, const FMaskPrototypes& Prototypes, int32 ModelWidth,
+	int32 ModelHeight, const TArray<TPair<int, UMyNeuralNetwork::FBoxCoordinates>>& Boxes, TArray<FDetectionMask>& OutMasks);
@@ -24,5 +24,10 @@ public class UENeuralNetwork : ModuleRules
             "OpenCV",
             "OpenCVHelper",
         });
+
+        // inference backends (InferenceBackend.h). onnx runtime is used through its c api, no exceptions needed
+        PrivateDependencyModuleNames.Add("OnnxRuntime");
+        // nn.Backend ORT reads <asset name>.onnx from Content/Models as a loose file, stage it next to the cooked content
+        RuntimeDependencies.Add("$(ProjectDir)/Content/Models/*.onnx", StagedFileType.NonUFS);
 	}
 }
@@ -0,0 +1,185 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+// Header-only reader for the shared-memory detection stream published by the game (nn.Stream.Enable 1). No engine
+// dependency, any number of readers can attach and none of them can slow the game down: records are copied out of the
+// ring and validated against their sequence number afterwards, frames are read in place under a seqlock.
+//
+//   DetectionStream::Reader Reader;
+//   if (Reader.Open()) {
+//       DetectionStream::Record Rec;
+//       while (Reader.TryRead(Rec)) { ... }
+//   }
+
+#include "../../Source/UENeuralNetwork/Public/DetectionStreamLayout.h"
+
+#include <string>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace DetectionStream {
+
+class Reader {
+public:
+	Reader() = default;
+	Reader(const Reader&) = delete;
+	Reader& operator=(const Reader&) = delete;
+	~Reader() { Close(); }
+
+	// false if the game is not publishing (yet). StartAtLatest skips what is already in the ring
+	bool Open(const char* Name = kDefaultName, bool bStartAtLatest = true) {
+		Close();
+#if defined(_WIN32)
+		// the engine prefixes named regions with "Local\" on windows
+		const std::string MappingName = std::string("Local\\") + Name;
+		Mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, MappingName.c_str());
+		if (Mapping == nullptr) {
+			return false;
+		}
+		Base = static_cast<const uint8_t*>(MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0));
+		if (Base == nullptr) {
+			Close();
+			return false;
+		}
+		MEMORY_BASIC_INFORMATION Info;
+		VirtualQuery(Base, &Info, sizeof(Info));
+		Size = Info.RegionSize;
+#else
+		const std::string ShmName = std::string("/") + Name;
+		const int Fd = shm_open(ShmName.c_str(), O_RDONLY, 0);
+		if (Fd < 0) {
+			return false;
+		}
+		struct stat St;
+		if (fstat(Fd, &St) != 0 || static_cast<size_t>(St.st_size) < sizeof(Header)) {
+			close(Fd);
+			return false;
+		}
+		Size = static_cast<size_t>(St.st_size);
+		void* Mapped = mmap(nullptr, Size, PROT_READ, MAP_SHARED, Fd, 0);
+		close(Fd);
+		if (Mapped == MAP_FAILED) {
+			return false;
+		}
+		Base = static_cast<const uint8_t*>(Mapped);
+#endif
+		const Header* H = GetHeader();
+		if (H->Magic.load(std::memory_order_acquire) != kMagic || H->Version != kVersion || H->RecordSlotSize != sizeof(RecordSlot)
+			|| RegionSize(H->RecordCapacity, H->FrameMaxBytes) > Size) {
+			Close();
+			return false;
+		}
+		Slots = reinterpret_cast<const RecordSlot*>(Base + H->RecordsOffset);
+		Mask = H->RecordCapacity - 1;
+		Cursor = bStartAtLatest ? H->WriteSequence.load(std::memory_order_acquire) : OldestAvailable();
+		return true;
+	}
+
+	void Close() {
+#if defined(_WIN32)
+		if (Base != nullptr) {
+			UnmapViewOfFile(Base);
+		}
+		if (Mapping != nullptr) {
+			CloseHandle(Mapping);
+		}
+		Mapping = nullptr;
+#else
+		if (Base != nullptr) {
+			munmap(const_cast<uint8_t*>(Base), Size);
+		}
+#endif
+		Base = nullptr;
+		Slots = nullptr;
+		Size = 0;
+		Cursor = 0;
+		Dropped = 0;
+	}
+
+	bool IsOpen() const { return Base != nullptr; }
+
+	// next record, false if the reader has caught up with the producer
+	bool TryRead(Record& Out) {
+		if (Base == nullptr) {
+			return false;
+		}
+		for (;;) {
+			const uint64_t Written = GetHeader()->WriteSequence.load(std::memory_order_acquire);
+			if (Cursor >= Written) {
+				return false;
+			}
+			if (Written - Cursor > Mask + 1) {
+				// lapped by the producer, skip to the oldest record still in the ring
+				Dropped += Written - (Mask + 1) - Cursor;
+				Cursor = Written - (Mask + 1);
+			}
+			const RecordSlot& Slot = Slots[Cursor & Mask];
+			const uint64_t Expected = Cursor * 2 + 2;
+			if (Slot.Sequence.load(std::memory_order_acquire) != Expected) {
+				// overwritten between the two loads, go around again
+				continue;
+			}
+			Out = Slot.Data;
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (Slot.Sequence.load(std::memory_order_relaxed) != Expected) {
+				continue;
+			}
+			Cursor++;
+			return true;
+		}
+	}
+
+	// records lost because this reader fell behind
+	uint64_t GetDropped() const { return Dropped; }
+
+	bool HasFrames() const { return Base != nullptr && GetHeader()->FrameSlotOffset != 0; }
+
+	// calls Visit(const FrameSlotHeader&, const uint8_t* Pixels) on the latest frame in place, no copy. the visitor must be
+	// short and must not keep the pointer: if the producer replaced the frame meanwhile the result is discarded and false
+	// is returned
+	template <typename VisitorType>
+	bool VisitLatestFrame(VisitorType&& Visit) const {
+		if (!HasFrames()) {
+			return false;
+		}
+		const FrameSlotHeader* Slot = reinterpret_cast<const FrameSlotHeader*>(Base + GetHeader()->FrameSlotOffset);
+		const uint64_t Before = Slot->Sequence.load(std::memory_order_acquire);
+		if (Before == 0 || (Before & 1) != 0 || Slot->Bytes > GetHeader()->FrameMaxBytes) {
+			return false;
+		}
+		Visit(*Slot, reinterpret_cast<const uint8_t*>(Slot + 1));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return Slot->Sequence.load(std::memory_order_relaxed) == Before;
+	}
+
+private:
+	const Header* GetHeader() const { return reinterpret_cast<const Header*>(Base); }
+
+	uint64_t OldestAvailable() const {
+		const uint64_t Written = GetHeader()->WriteSequence.load(std::memory_order_acquire);
+		return Written > Mask + 1 ? Written - (Mask + 1) : 0;
+	}
+
+#if defined(_WIN32)
+	HANDLE Mapping = nullptr;
+#endif
+	const uint8_t* Base = nullptr;
+	size_t Size = 0;
+	const RecordSlot* Slots = nullptr;
+	uint64_t Mask = 0;
+	uint64_t Cursor = 0;
+	uint64_t Dropped = 0;
+};
+
+} // namespace DetectionStream
@@ -0,0 +1,60 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+// Minimal consumer of the detection stream: prints every frame's detections as they arrive.
+//
+//   g++ -std=c++17 -O2 detection_stream_consumer.cpp -o detection_stream_consumer -lrt
+//   cl /std:c++17 /O2 detection_stream_consumer.cpp
+//
+// run with the game playing and `nn.Stream.Enable 1` (add `nn.Stream.PublishFrames 1` to also see the frame slot).
+
+#include "DetectionStreamReader.h"
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <thread>
+
+int main(int argc, char** argv) {
+	const char* Name = argc > 1 ? argv[1] : DetectionStream::kDefaultName;
+
+	DetectionStream::Reader Reader;
+	while (!Reader.Open(Name)) {
+		std::printf("waiting for %s...\n", Name);
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+	}
+	std::printf("attached to %s%s\n", Name, Reader.HasFrames() ? " (with frames)" : "");
+
+	uint64_t LastFrame = UINT64_MAX;
+	uint64_t LastDropped = 0;
+	for (;;) {
+		DetectionStream::Record Rec;
+		bool bAny = false;
+		while (Reader.TryRead(Rec)) {
+			bAny = true;
+			if (Rec.FrameId != LastFrame) {
+				LastFrame = Rec.FrameId;
+				std::printf("frame %" PRIu64 " t=%" PRIu64 " detections=%u\n", Rec.FrameId, Rec.TimestampNs,
+					Rec.ClassIndex < 0 ? 0u : Rec.CountInFrame);
+			}
+			if (Rec.ClassIndex >= 0) {
+				std::printf("  class %d score %.2f box %.0f %.0f %.0f %.0f\n", Rec.ClassIndex, Rec.Score, Rec.X1, Rec.Y1, Rec.Width, Rec.Height);
+			}
+		}
+		if (Reader.GetDropped() != LastDropped) {
+			std::printf("dropped %" PRIu64 " records\n", Reader.GetDropped() - LastDropped);
+			LastDropped = Reader.GetDropped();
+		}
+		if (bAny && Reader.HasFrames()) {
+			uint32_t Width = 0, Height = 0;
+			uint64_t FrameId = 0;
+			if (Reader.VisitLatestFrame([&](const DetectionStream::FrameSlotHeader& Frame, const uint8_t*) {
+				Width = Frame.Width;
+				Height = Frame.Height;
+				FrameId = Frame.FrameId;
+			})) {
+				std::printf("  latest frame %" PRIu64 " %ux%u\n", FrameId, Width, Height);
+			}
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	}
+}
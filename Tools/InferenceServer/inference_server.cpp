@@ -0,0 +1,410 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+// Out-of-process inference server for the detection pipeline (nn.Remote.Enable 1 in the game). Runs the models with ONNX
+// Runtime on its own worker threads, optionally bound to one NUMA node, and serves any number of game processes on this
+// host through the shared-memory protocol in InferenceServerProtocol.h.
+//
+//   g++ -std=c++17 -O2 inference_server.cpp -I$ORT/include -L$ORT/lib -lonnxruntime -lpthread -o inference_server
+//
+//   ./inference_server --model yolov8n=/models/yolov8n.onnx --model-dir /models --workers 4 --intra-op 4 --numa-node 0
+//
+// The game asks for models by the name of their NNI asset: --model NAME=PATH maps a name explicitly, otherwise NAME.onnx
+// is loaded from --model-dir on first use. Linux only (unix domain socket, NUMA binding through sysfs).
+
+#include "../../Source/UENeuralNetwork/Public/InferenceServerProtocol.h"
+
+#include <onnxruntime_cxx_api.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace InferenceServer;
+
+namespace {
+
+struct Options {
+	std::string SocketPath = kDefaultSocketPath;
+	std::map<std::string, std::string> Models;
+	std::string ModelDir;
+	int Workers = 2;
+	int IntraOpThreads = 0; // 0 = onnx runtime default
+	int NumaNode = -1;
+};
+
+// cpus of a node from sysfs, "0-7,16-23"
+bool ReadNodeCpus(int Node, cpu_set_t& OutCpus) {
+	std::ifstream File("/sys/devices/system/node/node" + std::to_string(Node) + "/cpulist");
+	std::string List;
+	if (!std::getline(File, List)) {
+		return false;
+	}
+	CPU_ZERO(&OutCpus);
+	std::stringstream Ranges(List);
+	std::string Range;
+	while (std::getline(Ranges, Range, ',')) {
+		const size_t Dash = Range.find('-');
+		const int First = std::stoi(Range.substr(0, Dash));
+		const int Last = Dash == std::string::npos ? First : std::stoi(Range.substr(Dash + 1));
+		for (int Cpu = First; Cpu <= Last; Cpu++) {
+			CPU_SET(Cpu, &OutCpus);
+		}
+	}
+	return true;
+}
+
+// pins this thread (and every thread created after it, onnx runtime's pools included) to the node's cpus and binds its
+// allocations to the node's memory
+bool BindToNumaNode(int Node) {
+	cpu_set_t Cpus;
+	if (!ReadNodeCpus(Node, Cpus) || sched_setaffinity(0, sizeof(Cpus), &Cpus) != 0) {
+		return false;
+	}
+	constexpr int MpolBind = 2;
+	unsigned long NodeMask[16] = {};
+	NodeMask[Node / (8 * sizeof(unsigned long))] = 1ul << (Node % (8 * sizeof(unsigned long)));
+	return syscall(SYS_set_mempolicy, MpolBind, NodeMask, sizeof(NodeMask) * 8) == 0;
+}
+
+struct Model {
+	std::unique_ptr<Ort::Session> Session;
+	std::string InputName;
+	std::vector<std::string> OutputNames;
+	std::vector<const char*> OutputNamePointers;
+};
+
+class ModelRegistry {
+public:
+	ModelRegistry(const Options& InOptions) : Opts(InOptions), Env(ORT_LOGGING_LEVEL_WARNING, "uenn-inference") {
+		if (Opts.IntraOpThreads > 0) {
+			SessionOptions.SetIntraOpNumThreads(Opts.IntraOpThreads);
+		}
+		// requests are already spread over the workers, one session runs its graph sequentially
+		SessionOptions.SetInterOpNumThreads(1);
+		SessionOptions.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
+	}
+
+	// loads on first use, nullptr if there is no such model
+	std::shared_ptr<Model> Get(const std::string& Name, std::string& OutError) {
+		std::lock_guard<std::mutex> Lock(Mutex);
+		auto Found = Loaded.find(Name);
+		if (Found != Loaded.end()) {
+			return Found->second;
+		}
+		std::string Path;
+		auto Mapped = Opts.Models.find(Name);
+		if (Mapped != Opts.Models.end()) {
+			Path = Mapped->second;
+		} else if (!Opts.ModelDir.empty()) {
+			Path = Opts.ModelDir + "/" + Name + ".onnx";
+		} else {
+			OutError = "unknown model " + Name;
+			return nullptr;
+		}
+
+		try {
+			auto Loading = std::make_shared<Model>();
+			Loading->Session = std::make_unique<Ort::Session>(Env, Path.c_str(), SessionOptions);
+			Ort::AllocatorWithDefaultOptions Allocator;
+			Loading->InputName = Loading->Session->GetInputNameAllocated(0, Allocator).get();
+			for (size_t i = 0; i < Loading->Session->GetOutputCount() && i < kMaxOutputs; i++) {
+				Loading->OutputNames.push_back(Loading->Session->GetOutputNameAllocated(i, Allocator).get());
+			}
+			for (const std::string& OutputName : Loading->OutputNames) {
+				Loading->OutputNamePointers.push_back(OutputName.c_str());
+			}
+			std::printf("loaded %s from %s (%zu outputs)\n", Name.c_str(), Path.c_str(), Loading->OutputNames.size());
+			Loaded[Name] = Loading;
+			return Loading;
+		} catch (const Ort::Exception& Error) {
+			OutError = "could not load " + Path + ": " + Error.what();
+			return nullptr;
+		}
+	}
+
+private:
+	const Options& Opts;
+	Ort::Env Env;
+	Ort::SessionOptions SessionOptions;
+	std::mutex Mutex;
+	std::map<std::string, std::shared_ptr<Model>> Loaded;
+};
+
+// one game process: its socket and its mapped region
+struct Client {
+	int Socket = -1;
+	uint8_t* Base = nullptr;
+	size_t Size = 0;
+	std::mutex SendMutex;
+
+	~Client() {
+		if (Base != nullptr) {
+			munmap(Base, Size);
+		}
+		if (Socket >= 0) {
+			close(Socket);
+		}
+	}
+
+	RegionHeader& Header() const { return *reinterpret_cast<RegionHeader*>(Base); }
+	SlotHeader& Slot(uint32_t Index) const { return reinterpret_cast<SlotHeader*>(Base + Header().SlotsOffset)[Index]; }
+	uint8_t* SlotData(uint32_t Index) const { return Base + Header().DataOffset + Index * Header().SlotDataBytes; }
+
+	bool Attach(const char* RegionName) {
+		const std::string ShmName = std::string("/") + RegionName;
+		const int Fd = shm_open(ShmName.c_str(), O_RDWR, 0);
+		if (Fd < 0) {
+			return false;
+		}
+		struct stat St;
+		if (fstat(Fd, &St) != 0 || static_cast<size_t>(St.st_size) < sizeof(RegionHeader)) {
+			close(Fd);
+			return false;
+		}
+		Size = static_cast<size_t>(St.st_size);
+		void* Mapped = mmap(nullptr, Size, PROT_READ | PROT_WRITE, MAP_SHARED, Fd, 0);
+		close(Fd);
+		if (Mapped == MAP_FAILED) {
+			return false;
+		}
+		Base = static_cast<uint8_t*>(Mapped);
+		const RegionHeader& H = Header();
+		return H.Magic.load(std::memory_order_acquire) == kMagic && H.Version == kVersion && H.SlotHeaderSize == sizeof(SlotHeader)
+			&& H.SlotsOffset == SlotsOffset() && H.DataOffset == DataOffset(H.SlotCount) && RegionSize(H.SlotCount, H.SlotDataBytes) <= Size;
+	}
+
+	void Send(const Message& Msg) {
+		std::lock_guard<std::mutex> Lock(SendMutex);
+		send(Socket, &Msg, sizeof(Msg), MSG_NOSIGNAL);
+	}
+};
+
+struct Job {
+	std::shared_ptr<Client> Owner;
+	uint32_t Slot;
+};
+
+class Server {
+public:
+	explicit Server(const Options& InOptions) : Opts(InOptions), Models(InOptions) {}
+
+	int Run() {
+		for (int i = 0; i < Opts.Workers; i++) {
+			Workers.emplace_back([this]() { WorkerLoop(); });
+		}
+
+		const int Listener = socket(AF_UNIX, SOCK_STREAM, 0);
+		sockaddr_un Address = {};
+		Address.sun_family = AF_UNIX;
+		std::strncpy(Address.sun_path, Opts.SocketPath.c_str(), sizeof(Address.sun_path) - 1);
+		unlink(Opts.SocketPath.c_str());
+		if (Listener < 0 || bind(Listener, reinterpret_cast<sockaddr*>(&Address), sizeof(Address)) != 0 || listen(Listener, 16) != 0) {
+			std::perror("listen");
+			return 1;
+		}
+		std::printf("listening on %s with %d workers\n", Opts.SocketPath.c_str(), Opts.Workers);
+
+		for (;;) {
+			const int Socket = accept(Listener, nullptr, nullptr);
+			if (Socket < 0) {
+				continue;
+			}
+			std::thread([this, Socket]() { ClientLoop(Socket); }).detach();
+		}
+	}
+
+private:
+	void ClientLoop(int Socket) {
+		auto Connection = std::make_shared<Client>();
+		Connection->Socket = Socket;
+
+		Message Hello;
+		if (recv(Socket, &Hello, sizeof(Hello), MSG_WAITALL) != sizeof(Hello) || Hello.Type != EMessageType::Hello) {
+			return;
+		}
+		Hello.Region[kNameLength - 1] = 0;
+		Message Welcome = {};
+		Welcome.Type = EMessageType::Welcome;
+		Welcome.Status = Connection->Attach(Hello.Region) ? 0 : 1;
+		Connection->Send(Welcome);
+		if (Welcome.Status != 0) {
+			std::printf("rejected region %s\n", Hello.Region);
+			return;
+		}
+		std::printf("client attached %s (%u slots of %llu bytes)\n", Hello.Region, Connection->Header().SlotCount,
+			static_cast<unsigned long long>(Connection->Header().SlotDataBytes));
+
+		Message Doorbell;
+		while (recv(Socket, &Doorbell, sizeof(Doorbell), MSG_WAITALL) == sizeof(Doorbell)) {
+			if (Doorbell.Type == EMessageType::Run && Doorbell.Slot < Connection->Header().SlotCount) {
+				std::lock_guard<std::mutex> Lock(QueueMutex);
+				Queue.push_back(Job{ Connection, Doorbell.Slot });
+				QueueReady.notify_one();
+			}
+		}
+		// jobs still queued keep the region mapped until they are done
+		std::printf("client detached %s\n", Hello.Region);
+	}
+
+	void WorkerLoop() {
+		for (;;) {
+			Job Next;
+			{
+				std::unique_lock<std::mutex> Lock(QueueMutex);
+				QueueReady.wait(Lock, [this]() { return !Queue.empty(); });
+				Next = std::move(Queue.front());
+				Queue.pop_front();
+			}
+			Process(*Next.Owner, Next.Slot);
+		}
+	}
+
+	void Process(Client& Owner, uint32_t Index) {
+		SlotHeader& Request = Owner.Slot(Index);
+		if (Request.State.load(std::memory_order_acquire) != static_cast<uint32_t>(ESlotState::Submitted)) {
+			return;
+		}
+		uint8_t* Data = Owner.SlotData(Index);
+		const uint64_t SlotBytes = Owner.Header().SlotDataBytes;
+		const auto Start = std::chrono::steady_clock::now();
+
+		std::string Error;
+		Request.NumOutputs = 0;
+		const TensorDesc Input = Request.Input;
+		Request.Model[kNameLength - 1] = 0;
+		std::shared_ptr<Model> Runner = Models.Get(Request.Model, Error);
+		if (Runner != nullptr && (Input.NumDims > kMaxDims || Input.Offset != 0 || Input.Bytes != TensorBytes(Input) || Input.Bytes > SlotBytes)) {
+			Error = "malformed input tensor";
+		}
+
+		if (Error.empty()) {
+			try {
+				// the input is read in place from the game's region
+				Ort::MemoryInfo Memory = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+				const size_t Count = Input.Type == EDataType::Float32 ? Input.Bytes / 4 : Input.Bytes;
+				Ort::Value InputValue = Input.Type == EDataType::Float32
+					? Ort::Value::CreateTensor<float>(Memory, reinterpret_cast<float*>(Data), Count, Input.Dims, Input.NumDims)
+					: Ort::Value::CreateTensor<uint8_t>(Memory, Data, Count, Input.Dims, Input.NumDims);
+				const char* InputName = Runner->InputName.c_str();
+				std::vector<Ort::Value> Outputs = Runner->Session->Run(Ort::RunOptions{ nullptr }, &InputName, &InputValue, 1,
+					Runner->OutputNamePointers.data(), Runner->OutputNamePointers.size());
+
+				// outputs go behind the input, each aligned
+				uint64_t Offset = AlignData(Input.Bytes);
+				for (size_t i = 0; i < Outputs.size() && Error.empty(); i++) {
+					Ort::TensorTypeAndShapeInfo Info = Outputs[i].GetTensorTypeAndShapeInfo();
+					const std::vector<int64_t> Shape = Info.GetShape();
+					const uint64_t Bytes = Info.GetElementCount() * sizeof(float);
+					if (Info.GetElementType() != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT || Shape.size() > kMaxDims || Offset + Bytes > SlotBytes) {
+						Error = "output " + std::to_string(i) + " is not a float tensor that fits the slot";
+						break;
+					}
+					TensorDesc& Desc = Request.Outputs[i];
+					Desc.Type = EDataType::Float32;
+					Desc.NumDims = static_cast<uint32_t>(Shape.size());
+					for (size_t d = 0; d < Shape.size(); d++) {
+						Desc.Dims[d] = Shape[d];
+					}
+					Desc.Offset = Offset;
+					Desc.Bytes = Bytes;
+					std::memcpy(Data + Offset, Outputs[i].GetTensorData<float>(), Bytes);
+					Offset = AlignData(Offset + Bytes);
+					Request.NumOutputs = static_cast<uint32_t>(i + 1);
+				}
+			} catch (const Ort::Exception& Exception) {
+				Error = Exception.what();
+			}
+		}
+
+		Request.ServerMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - Start).count();
+		if (!Error.empty()) {
+			std::strncpy(Request.Error, Error.c_str(), sizeof(Request.Error) - 1);
+			Request.Error[sizeof(Request.Error) - 1] = 0;
+		}
+		Request.State.store(static_cast<uint32_t>(Error.empty() ? ESlotState::Done : ESlotState::Failed), std::memory_order_release);
+
+		Message Done = {};
+		Done.Type = EMessageType::Done;
+		Done.Slot = Index;
+		Done.RequestId = Request.RequestId;
+		Done.Status = Error.empty() ? 0 : 1;
+		Owner.Send(Done);
+	}
+
+	const Options& Opts;
+	ModelRegistry Models;
+	std::vector<std::thread> Workers;
+	std::mutex QueueMutex;
+	std::condition_variable QueueReady;
+	std::deque<Job> Queue;
+};
+
+void PrintUsage() {
+	std::printf("inference_server [--socket PATH] [--model NAME=PATH]... [--model-dir DIR] [--workers N] [--intra-op N] [--numa-node N]\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+	Options Opts;
+	for (int i = 1; i < argc; i++) {
+		const std::string Arg = argv[i];
+		const bool bHasValue = i + 1 < argc;
+		if (Arg == "--socket" && bHasValue) {
+			Opts.SocketPath = argv[++i];
+		} else if (Arg == "--model" && bHasValue) {
+			const std::string Mapping = argv[++i];
+			const size_t Equals = Mapping.find('=');
+			if (Equals == std::string::npos) {
+				PrintUsage();
+				return 1;
+			}
+			Opts.Models[Mapping.substr(0, Equals)] = Mapping.substr(Equals + 1);
+		} else if (Arg == "--model-dir" && bHasValue) {
+			Opts.ModelDir = argv[++i];
+		} else if (Arg == "--workers" && bHasValue) {
+			Opts.Workers = std::max(1, std::atoi(argv[++i]));
+		} else if (Arg == "--intra-op" && bHasValue) {
+			Opts.IntraOpThreads = std::atoi(argv[++i]);
+		} else if (Arg == "--numa-node" && bHasValue) {
+			Opts.NumaNode = std::atoi(argv[++i]);
+		} else {
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+	// before any thread exists, so all of them inherit the placement
+	if (Opts.NumaNode >= 0) {
+		if (!BindToNumaNode(Opts.NumaNode)) {
+			std::fprintf(stderr, "could not bind to numa node %d\n", Opts.NumaNode);
+			return 1;
+		}
+		std::printf("bound to numa node %d\n", Opts.NumaNode);
+	}
+
+	Server Instance(Opts);
+	return Instance.Run();
+}